@@ -0,0 +1,124 @@
+#ifndef ASSET_MANAGER_H
+#define ASSET_MANAGER_H
+
+#include <learnopengl/model.h>
+#include <learnopengl/mpsc_queue.h>
+#include <learnopengl/thread_pool.h>
+
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Loads models in the background while the render loop keeps running. load() hands out the model right
+// away; it draws as a placeholder until its import (on the thread pool) is done and update() has uploaded
+// it on the render thread. Workers report finished imports through a lock-free queue, so the render
+// thread never blocks on them. A model whose import throws is reported as failed and never uploaded; it
+// draws nothing.
+//
+// Everything but the workers' imports happens on the thread that owns the GL context, and the models
+// (with their GL objects) are freed by clear() or the destructor, so call clear() before the context goes away.
+class AssetManager
+{
+public:
+    // threadCount 0 means one worker per hardware thread.
+    explicit AssetManager(unsigned int threadCount = 0) : inFlight(0), pool(threadCount) {}
+
+    ~AssetManager()
+    {
+        clear();
+    }
+
+    AssetManager(const AssetManager&) = delete;
+    AssetManager &operator=(const AssetManager&) = delete;
+
+    // starts importing the model at path and returns it; the manager keeps ownership.
+    Model *load(const string &path, bool gamma = false, ModelOptions const &options = ModelOptions())
+    {
+        Model *model = new Model();
+        models.push_back(unique_ptr<Model>(model));
+        inFlight++;
+        MPSCQueue<Import> *done = &completed;
+        pool.submit([model, path, gamma, options, done]()
+        {
+            // the future is dropped, so an exception has to be caught here for the model to be reported at all
+            bool failed = true;
+            try
+            {
+                model->import(path, gamma, options);
+                failed = false;
+            }
+            catch(const exception &e)
+            {
+                cout << "ERROR::ASSET_MANAGER:: failed to load " << path << ": " << e.what() << endl;
+            }
+            catch(...)
+            {
+                cout << "ERROR::ASSET_MANAGER:: failed to load " << path << endl;
+            }
+            done->push(Import(model, failed));
+        });
+        return model;
+    }
+
+    // uploads the models whose import finished since the last call, at most maxUploads of them (uploads
+    // left over wait for the next call), and gives up on the ones whose import failed. Call once per frame;
+    // returns the number of models uploaded.
+    unsigned int update(unsigned int maxUploads = ~0u)
+    {
+        completed.drain([this](const Import &import)
+        {
+            if(import.failed)
+            {
+                import.model->failed = true;
+                inFlight--;
+            }
+            else
+                ready.push_back(import.model);
+        });
+        unsigned int uploaded = 0;
+        while(uploaded < maxUploads && uploaded < ready.size())
+            ready[uploaded++]->upload();
+        ready.erase(ready.begin(), ready.begin() + uploaded);
+        inFlight -= uploaded;
+        return uploaded;
+    }
+
+    // models that aren't resident yet, and haven't failed
+    unsigned int pending() const { return inFlight; }
+
+    // waits for the imports still running and frees all models. GL thread only.
+    void clear()
+    {
+        while(inFlight > 0)
+        {
+            inFlight -= static_cast<unsigned int>(ready.size());
+            ready.clear();
+            inFlight -= static_cast<unsigned int>(completed.drain([](const Import&) {}));
+            if(inFlight > 0)
+                this_thread::yield();
+        }
+        models.clear();
+    }
+
+private:
+    // a finished import, handed from a worker to the GL thread
+    struct Import
+    {
+        Model *model;
+        bool failed;    // import() threw
+
+        Import(Model *model, bool failed) : model(model), failed(failed) {}
+    };
+
+    vector<unique_ptr<Model> > models;
+    vector<Model*> ready;           // imported, waiting for upload
+    unsigned int inFlight;          // loaded but not yet uploaded or failed
+    MPSCQueue<Import> completed;    // filled by the workers
+    ThreadPool pool;                // last, so it is joined before anything the workers use goes away
+};
+
+#endif
@@ -0,0 +1,394 @@
+#ifndef DXT_ENCODER_H
+#define DXT_ENCODER_H
+
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DXT_ENCODER_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define DXT_ENCODER_AVX2 1
+#include <immintrin.h>
+#endif
+
+// DXT1/DXT5 block compression producing the same bytes as convert_image_to_DXT1/5 of image_DXT.c, only
+// faster: several blocks are encoded at once, one per SIMD lane (8 with AVX2, 4 with SSE2, 1 elsewhere), and
+// rows of blocks are spread over ThreadPool::shared().
+// Every lane goes through exactly the floating point operations of the C encoder, in the same order, so the
+// output is bit for bit identical. That holds as long as neither side is compiled with FMA contraction
+// (e.g. -march=native with GCC's default -ffp-contract=fast), which rounds differently.
+// The AVX2 path is picked at compile time, when building with -mavx2 or /arch:AVX2.
+
+// the operations the encoder needs, on one float / int per lane
+struct DXTLanes1
+{
+    enum { LANES = 1 };
+    typedef float F;
+    typedef int I;
+    static I loadBytes(const unsigned char *p) { return *p; }
+    static void storei(int *p, I v) { *p = v; }
+    static F set(float v) { return v; }
+    static I seti(int v) { return v; }
+    static F add(F a, F b) { return a + b; }
+    static F sub(F a, F b) { return a - b; }
+    static F mul(F a, F b) { return a * b; }
+    static F div(F a, F b) { return a / b; }
+    static F min(F a, F b) { return b < a ? b : a; }
+    static F max(F a, F b) { return b > a ? b : a; }
+    static F selectGreaterZero(F test, F a, F b) { return test > 0.0f ? a : b; }
+    // like x86's cvttss2si and ARM's fcvtzs for the values the encoder produces: NaN becomes a multiple of 8
+    static I truncate(F a) { return a != a ? 0 : (int)a; }
+    static F toFloat(I a) { return (float)a; }
+    static I addi(I a, I b) { return a + b; }
+    static I subi(I a, I b) { return a - b; }
+    static I mulSmall(I a, int b) { return a * b; }
+    static I andi(I a, int b) { return a & b; }
+    static I ori(I a, I b) { return a | b; }
+    static I shl(I a, int n) { return a << n; }
+    static I shr(I a, int n) { return a >> n; }
+    static I mini(I a, I b) { return b < a ? b : a; }
+    static I maxi(I a, I b) { return b > a ? b : a; }
+};
+
+#ifdef DXT_ENCODER_SSE2
+struct DXTLanes4
+{
+    enum { LANES = 4 };
+    typedef __m128 F;
+    typedef __m128i I;
+    static I loadBytes(const unsigned char *p)
+    {
+        int bytes;
+        memcpy(&bytes, p, sizeof(bytes));
+        __m128i zero = _mm_setzero_si128();
+        return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+    }
+    static void storei(int *p, I v) { _mm_store_si128(reinterpret_cast<__m128i*>(p), v); }
+    static F set(float v) { return _mm_set1_ps(v); }
+    static I seti(int v) { return _mm_set1_epi32(v); }
+    static F add(F a, F b) { return _mm_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm_div_ps(a, b); }
+    static F min(F a, F b) { return _mm_min_ps(a, b); }
+    static F max(F a, F b) { return _mm_max_ps(a, b); }
+    static F selectGreaterZero(F test, F a, F b)
+    {
+        __m128 mask = _mm_cmpgt_ps(test, _mm_setzero_ps());
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+    static I truncate(F a) { return _mm_cvttps_epi32(a); }
+    static F toFloat(I a) { return _mm_cvtepi32_ps(a); }
+    static I addi(I a, I b) { return _mm_add_epi32(a, b); }
+    static I subi(I a, I b) { return _mm_sub_epi32(a, b); }
+    // SSE2 has no 32-bit multiply; the 16-bit one is exact while a and the product stay below 65536
+    static I mulSmall(I a, int b) { return _mm_mullo_epi16(a, _mm_set1_epi32(b)); }
+    static I andi(I a, int b) { return _mm_and_si128(a, _mm_set1_epi32(b)); }
+    static I ori(I a, I b) { return _mm_or_si128(a, b); }
+    static I shl(I a, int n) { return _mm_slli_epi32(a, n); }
+    static I shr(I a, int n) { return _mm_srai_epi32(a, n); }
+    static I mini(I a, I b)
+    {
+        __m128i greater = _mm_cmpgt_epi32(a, b);
+        return _mm_or_si128(_mm_and_si128(greater, b), _mm_andnot_si128(greater, a));
+    }
+    static I maxi(I a, I b)
+    {
+        __m128i greater = _mm_cmpgt_epi32(a, b);
+        return _mm_or_si128(_mm_and_si128(greater, a), _mm_andnot_si128(greater, b));
+    }
+};
+#endif
+
+#ifdef DXT_ENCODER_AVX2
+struct DXTLanes8
+{
+    enum { LANES = 8 };
+    typedef __m256 F;
+    typedef __m256i I;
+    static I loadBytes(const unsigned char *p) { return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))); }
+    static void storei(int *p, I v) { _mm256_store_si256(reinterpret_cast<__m256i*>(p), v); }
+    static F set(float v) { return _mm256_set1_ps(v); }
+    static I seti(int v) { return _mm256_set1_epi32(v); }
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F div(F a, F b) { return _mm256_div_ps(a, b); }
+    static F min(F a, F b) { return _mm256_min_ps(a, b); }
+    static F max(F a, F b) { return _mm256_max_ps(a, b); }
+    static F selectGreaterZero(F test, F a, F b) { return _mm256_blendv_ps(b, a, _mm256_cmp_ps(test, _mm256_setzero_ps(), _CMP_GT_OQ)); }
+    static I truncate(F a) { return _mm256_cvttps_epi32(a); }
+    static F toFloat(I a) { return _mm256_cvtepi32_ps(a); }
+    static I addi(I a, I b) { return _mm256_add_epi32(a, b); }
+    static I subi(I a, I b) { return _mm256_sub_epi32(a, b); }
+    static I mulSmall(I a, int b) { return _mm256_mullo_epi32(a, _mm256_set1_epi32(b)); }
+    static I andi(I a, int b) { return _mm256_and_si256(a, _mm256_set1_epi32(b)); }
+    static I ori(I a, I b) { return _mm256_or_si256(a, b); }
+    static I shl(I a, int n) { return _mm256_slli_epi32(a, n); }
+    static I shr(I a, int n) { return _mm256_srai_epi32(a, n); }
+    static I mini(I a, I b) { return _mm256_min_epi32(a, b); }
+    static I maxi(I a, I b) { return _mm256_max_epi32(a, b); }
+};
+typedef DXTLanes8 DXTLanes;
+#elif defined(DXT_ENCODER_SSE2)
+typedef DXTLanes4 DXTLanes;
+#else
+typedef DXTLanes1 DXTLanes;
+#endif
+
+// the 4x4 pixels of LANES blocks, pixel major: channel[pixel * LANES + lane]
+template <typename V>
+struct DXTBlocks
+{
+    unsigned char r[16 * V::LANES];
+    unsigned char g[16 * V::LANES];
+    unsigned char b[16 * V::LANES];
+    unsigned char a[16 * V::LANES];
+};
+
+// convert_bit_range of image_DXT.c
+template <typename V>
+inline typename V::I DXTConvertBitRange(typename V::I c, int fromBits, int toBits)
+{
+    typename V::I b = V::addi(V::seti(1 << (fromBits - 1)), V::mulSmall(c, (1 << toBits) - 1));
+    return V::shr(V::addi(b, V::shr(b, fromBits)), fromBits);
+}
+
+template <typename V>
+inline typename V::I DXTClamp(typename V::I c, int high)
+{
+    return V::maxi(V::mini(c, V::seti(high)), V::seti(0));
+}
+
+// compute_color_line_STDEV, LSE_master_colors_max_min and compress_DDS_color_block of image_DXT.c:
+// the 565 end points and the 2-bit index of every pixel, before the swizzle into DXT order.
+template <typename V>
+inline void DXTEncodeColor(const DXTBlocks<V> &blocks, int *color0, int *color1, int *indices)
+{
+    typedef typename V::F F;
+    typedef typename V::I I;
+    const int L = V::LANES;
+
+    F red[16], green[16], blue[16];
+    for (int i = 0; i < 16; i++)
+    {
+        red[i] = V::toFloat(V::loadBytes(blocks.r + i * L));
+        green[i] = V::toFloat(V::loadBytes(blocks.g + i * L));
+        blue[i] = V::toFloat(V::loadBytes(blocks.b + i * L));
+    }
+
+    // covariance of the colors; every sum is an integer below 2^24, so any summation order is exact
+    F sumR = V::set(0.0f), sumG = sumR, sumB = sumR;
+    F sumRR = sumR, sumGG = sumR, sumBB = sumR, sumRG = sumR, sumRB = sumR, sumGB = sumR;
+    for (int i = 0; i < 16; i++)
+    {
+        F r = red[i], g = green[i], b = blue[i];
+        sumR = V::add(sumR, r);
+        sumG = V::add(sumG, g);
+        sumB = V::add(sumB, b);
+        sumRR = V::add(sumRR, V::mul(r, r));
+        sumGG = V::add(sumGG, V::mul(g, g));
+        sumBB = V::add(sumBB, V::mul(b, b));
+        sumRG = V::add(sumRG, V::mul(r, g));
+        sumRB = V::add(sumRB, V::mul(r, b));
+        sumGB = V::add(sumGB, V::mul(g, b));
+    }
+    F inv16 = V::set(1.0f / 16.0f), sixteen = V::set(16.0f);
+    sumR = V::mul(sumR, inv16);
+    sumG = V::mul(sumG, inv16);
+    sumB = V::mul(sumB, inv16);
+    sumRR = V::sub(sumRR, V::mul(V::mul(sixteen, sumR), sumR));
+    sumGG = V::sub(sumGG, V::mul(V::mul(sixteen, sumG), sumG));
+    sumBB = V::sub(sumBB, V::mul(V::mul(sixteen, sumB), sumB));
+    sumRG = V::sub(sumRG, V::mul(V::mul(sixteen, sumR), sumG));
+    sumRB = V::sub(sumRB, V::mul(V::mul(sixteen, sumR), sumB));
+    sumGB = V::sub(sumGB, V::mul(V::mul(sixteen, sumG), sumB));
+
+    // three power iterations for the main axis
+    F x = V::set(1.0f), y = V::set(2.718281828f), z = V::set(3.141592654f);
+    for (int iteration = 0; iteration < 3; iteration++)
+    {
+        F dx = V::add(V::add(V::mul(x, sumRR), V::mul(y, sumRG)), V::mul(z, sumRB));
+        F dy = V::add(V::add(V::mul(x, sumRG), V::mul(y, sumGG)), V::mul(z, sumGB));
+        F dz = V::add(V::add(V::mul(x, sumRB), V::mul(y, sumGB)), V::mul(z, sumBB));
+        x = dx;
+        y = dy;
+        z = dz;
+    }
+
+    // extent of the colors along the axis
+    F lengthSquared = V::div(V::set(1.0f), V::add(V::add(V::add(V::set(0.00001f), V::mul(x, x)), V::mul(y, y)), V::mul(z, z)));
+    F dotMax = V::add(V::add(V::mul(x, red[0]), V::mul(y, green[0])), V::mul(z, blue[0]));
+    F dotMin = dotMax;
+    for (int i = 1; i < 16; i++)
+    {
+        F dot = V::add(V::add(V::mul(x, red[i]), V::mul(y, green[i])), V::mul(z, blue[i]));
+        dotMin = V::min(dotMin, dot);
+        dotMax = V::max(dotMax, dot);
+    }
+    F offset = V::add(V::add(V::mul(x, sumR), V::mul(y, sumG)), V::mul(z, sumB));
+    dotMin = V::mul(V::sub(dotMin, offset), lengthSquared);
+    dotMax = V::mul(V::sub(dotMax, offset), lengthSquared);
+
+    // end points, rounded to 565
+    F half = V::set(0.5f);
+    I r0 = DXTClamp<V>(V::truncate(V::add(V::add(half, sumR), V::mul(dotMax, x))), 255);
+    I g0 = DXTClamp<V>(V::truncate(V::add(V::add(half, sumG), V::mul(dotMax, y))), 255);
+    I b0 = DXTClamp<V>(V::truncate(V::add(V::add(half, sumB), V::mul(dotMax, z))), 255);
+    I r1 = DXTClamp<V>(V::truncate(V::add(V::add(half, sumR), V::mul(dotMin, x))), 255);
+    I g1 = DXTClamp<V>(V::truncate(V::add(V::add(half, sumG), V::mul(dotMin, y))), 255);
+    I b1 = DXTClamp<V>(V::truncate(V::add(V::add(half, sumB), V::mul(dotMin, z))), 255);
+    I packed0 = V::ori(V::ori(V::shl(DXTConvertBitRange<V>(r0, 8, 5), 11), V::shl(DXTConvertBitRange<V>(g0, 8, 6), 5)), DXTConvertBitRange<V>(b0, 8, 5));
+    I packed1 = V::ori(V::ori(V::shl(DXTConvertBitRange<V>(r1, 8, 5), 11), V::shl(DXTConvertBitRange<V>(g1, 8, 6), 5)), DXTConvertBitRange<V>(b1, 8, 5));
+    I encoded0 = V::maxi(packed0, packed1), encoded1 = V::mini(packed0, packed1);
+    V::storei(color0, encoded0);
+    V::storei(color1, encoded1);
+
+    // the line between the end points as they decode
+    I c0r = DXTConvertBitRange<V>(V::shr(encoded0, 11), 5, 8);
+    I c0g = DXTConvertBitRange<V>(V::andi(V::shr(encoded0, 5), 63), 6, 8);
+    I c0b = DXTConvertBitRange<V>(V::andi(encoded0, 31), 5, 8);
+    I c1r = DXTConvertBitRange<V>(V::shr(encoded1, 11), 5, 8);
+    I c1g = DXTConvertBitRange<V>(V::andi(V::shr(encoded1, 5), 63), 6, 8);
+    I c1b = DXTConvertBitRange<V>(V::andi(encoded1, 31), 5, 8);
+    F lineR = V::toFloat(V::subi(c1r, c0r)), lineG = V::toFloat(V::subi(c1g, c0g)), lineB = V::toFloat(V::subi(c1b, c0b));
+    F lineLength = V::add(V::add(V::mul(lineR, lineR), V::mul(lineG, lineG)), V::mul(lineB, lineB));
+    lineLength = V::selectGreaterZero(lineLength, V::div(V::set(1.0f), lineLength), lineLength);
+    lineR = V::mul(lineR, lineLength);
+    lineG = V::mul(lineG, lineLength);
+    lineB = V::mul(lineB, lineLength);
+    F lineOffset = V::add(V::add(V::mul(lineR, V::toFloat(c0r)), V::mul(lineG, V::toFloat(c0g))), V::mul(lineB, V::toFloat(c0b)));
+
+    // project every pixel onto it
+    F three = V::set(3.0f);
+    for (int i = 0; i < 16; i++)
+    {
+        F dot = V::sub(V::add(V::add(V::mul(lineR, red[i]), V::mul(lineG, green[i])), V::mul(lineB, blue[i])), lineOffset);
+        V::storei(indices + i * L, DXTClamp<V>(V::truncate(V::add(V::mul(dot, three), half)), 3));
+    }
+}
+
+// compress_DDS_alpha_block of image_DXT.c: the alpha end points and the 3-bit index of every pixel.
+template <typename V>
+inline void DXTEncodeAlpha(const DXTBlocks<V> &blocks, int *alpha0, int *alpha1, int *indices)
+{
+    typedef typename V::I I;
+    const int L = V::LANES;
+    I high = V::loadBytes(blocks.a), low = high;
+    for (int i = 1; i < 16; i++)
+    {
+        I a = V::loadBytes(blocks.a + i * L);
+        high = V::maxi(high, a);
+        low = V::mini(low, a);
+    }
+    V::storei(alpha0, high);
+    V::storei(alpha1, low);
+    // flat blocks divide by zero here, like the C encoder, and end up with index 0 everywhere
+    typename V::F scale = V::div(V::set(7.9999f), V::toFloat(V::subi(high, low)));
+    for (int i = 0; i < 16; i++)
+        V::storei(indices + i * L, V::andi(V::truncate(V::mul(V::toFloat(V::subi(V::loadBytes(blocks.a + i * L), low)), scale)), 7));
+}
+
+// encodes the blocks of one block row; out points at the row's first block.
+template <typename V>
+inline void DXTEncodeRow(const unsigned char *pixels, int width, int height, int channels, bool alpha, int blockRow, unsigned char *out)
+{
+    static const int swizzle4[] = { 0, 2, 3, 1 };
+    static const int swizzle8[] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+    const int L = V::LANES;
+    const int blockBytes = alpha ? 16 : 8;
+    const int blocksPerRow = (width + 3) / 4;
+    const int step = channels < 3 ? 0 : 1;
+    const bool hasAlpha = (channels & 1) == 0;
+    const int j = blockRow * 4;
+
+    DXTBlocks<V> blocks;
+    alignas(32) int color0[L], color1[L], colorIndices[16 * L];
+    alignas(32) int alpha0[L], alpha1[L], alphaIndices[16 * L];
+    for (int first = 0; first < blocksPerRow; first += L)
+    {
+        // gather like convert_image_to_DXT1/5: pixels outside the image repeat the block's first pixel;
+        // lanes past the end of the row repeat the last block
+        for (int lane = 0; lane < L; lane++)
+        {
+            int i = std::min(first + lane, blocksPerRow - 1) * 4;
+            int mx = std::min(4, width - i), my = std::min(4, height - j);
+            const unsigned char *corner = pixels + (size_t(j) * width + i) * channels;
+            for (int y = 0; y < 4; y++)
+            {
+                const unsigned char *row = corner + size_t(y) * width * channels;
+                for (int x = 0; x < 4; x++)
+                {
+                    const unsigned char *pixel = (y < my && x < mx) ? row + x * channels : corner;
+                    int slot = (y * 4 + x) * L + lane;
+                    blocks.r[slot] = pixel[0];
+                    blocks.g[slot] = pixel[step];
+                    blocks.b[slot] = pixel[step + step];
+                    blocks.a[slot] = hasAlpha ? pixel[channels - 1] : 255;
+                }
+            }
+        }
+        DXTEncodeColor<V>(blocks, color0, color1, colorIndices);
+        if (alpha)
+            DXTEncodeAlpha<V>(blocks, alpha0, alpha1, alphaIndices);
+
+        for (int lane = 0; lane < L && first + lane < blocksPerRow; lane++)
+        {
+            unsigned char *block = out + size_t(first + lane) * blockBytes;
+            if (alpha)
+            {
+                uint64_t bits = 0;
+                for (int p = 0; p < 16; p++)
+                    bits |= uint64_t(swizzle8[alphaIndices[p * L + lane]]) << (3 * p);
+                block[0] = static_cast<unsigned char>(alpha0[lane]);
+                block[1] = static_cast<unsigned char>(alpha1[lane]);
+                for (int k = 0; k < 6; k++)
+                    block[2 + k] = static_cast<unsigned char>(bits >> (8 * k));
+                block += 8;
+            }
+            uint32_t bits = 0;
+            for (int p = 0; p < 16; p++)
+                bits |= uint32_t(swizzle4[colorIndices[p * L + lane]]) << (2 * p);
+            block[0] = static_cast<unsigned char>(color0[lane]);
+            block[1] = static_cast<unsigned char>(color0[lane] >> 8);
+            block[2] = static_cast<unsigned char>(color1[lane]);
+            block[3] = static_cast<unsigned char>(color1[lane] >> 8);
+            for (int k = 0; k < 4; k++)
+                block[4 + k] = static_cast<unsigned char>(bits >> (8 * k));
+        }
+    }
+}
+
+// size of the DXT1 (alpha false) or DXT5 data of an image.
+inline size_t DXTCompressedSize(int width, int height, bool alpha)
+{
+    return size_t((width + 3) / 4) * ((height + 3) / 4) * (alpha ? 16 : 8);
+}
+
+// compresses 8-bit pixels with 1 to 4 channels to DXT1 (alpha false) or DXT5 into out, which must hold
+// DXTCompressedSize bytes. The result is identical to convert_image_to_DXT1/5. Without a pool everything
+// runs on the calling thread.
+inline bool CompressDXT(const unsigned char *pixels, int width, int height, int channels, bool alpha, unsigned char *out,
+                        ThreadPool *pool = &ThreadPool::shared())
+{
+    if (!pixels || !out || width < 1 || height < 1 || channels < 1 || channels > 4)
+        return false;
+    size_t rowBytes = size_t((width + 3) / 4) * (alpha ? 16 : 8);
+    size_t rows = (height + 3) / 4;
+    if (pool)
+        pool->parallelFor(rows, [=](size_t row) {
+            DXTEncodeRow<DXTLanes>(pixels, width, height, channels, alpha, static_cast<int>(row), out + row * rowBytes);
+        });
+    else
+        for (size_t row = 0; row < rows; row++)
+            DXTEncodeRow<DXTLanes>(pixels, width, height, channels, alpha, static_cast<int>(row), out + row * rowBytes);
+    return true;
+}
+
+#endif
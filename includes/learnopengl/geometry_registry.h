@@ -0,0 +1,135 @@
+#ifndef GEOMETRY_REGISTRY_H
+#define GEOMETRY_REGISTRY_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/hash.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+using namespace std;
+
+// the GPU side of a mesh: a vertex array with its vertex and index buffers. Shared by every mesh whose
+// processed vertex and index data is identical; the GL objects are deleted with the last reference,
+// which therefore has to be dropped on the thread that owns the GL context.
+struct GeometryBuffer
+{
+    unsigned int VAO, VBO, EBO;
+    unsigned int indexCount;
+    GLenum indexType;   // GL_UNSIGNED_INT or GL_UNSIGNED_SHORT
+    size_t bytes;       // vertex + index bytes uploaded
+
+private:
+    friend class GeometryRegistry;
+    uint64_t key;
+};
+
+// content hash of processed mesh data; computed once at import time so that only the lookup is left
+// for the GL thread.
+inline uint64_t GeometryKey(const void *vertices, size_t vertexBytes, const void *indices, size_t indexBytes)
+{
+    uint64_t key = hashBytes(&vertexBytes, sizeof(vertexBytes));
+    key = hashBytes(&indexBytes, sizeof(indexBytes), key);
+    key = hashBytes(vertices, vertexBytes, key);
+    return hashBytes(indices, indexBytes, key);
+}
+
+// Hands out one refcounted GeometryBuffer per distinct geometry. All functions must be called on the GL thread.
+class GeometryRegistry
+{
+public:
+    struct Stats
+    {
+        unsigned int hits;
+        unsigned int misses;
+        size_t bytesSaved;      // uploads avoided by hits
+        unsigned int buffers;   // currently alive
+        size_t bytes;           // GPU memory of the buffers currently alive
+    };
+
+    static GeometryRegistry &instance()
+    {
+        static GeometryRegistry registry;
+        return registry;
+    }
+
+    // returns the buffer holding this geometry. If no mesh holds it yet it is uploaded, and setupAttributes
+    // is called with the new VAO and buffers bound to set the vertex attribute pointers.
+    shared_ptr<GeometryBuffer> acquire(uint64_t key, const void *vertices, size_t vertexBytes, const void *indices, size_t indexBytes,
+                                       unsigned int indexCount, GLenum indexType, const function<void()> &setupAttributes)
+    {
+        unordered_map<uint64_t, weak_ptr<GeometryBuffer> >::iterator it = buffers.find(key);
+        if (it != buffers.end())
+        {
+            shared_ptr<GeometryBuffer> shared = it->second.lock();
+            if (shared)
+            {
+                counters.hits++;
+                counters.bytesSaved += shared->bytes;
+                return shared;
+            }
+        }
+
+        shared_ptr<GeometryBuffer> buffer(new GeometryBuffer(), [this](GeometryBuffer *b) { release(b); });
+        buffer->key = key;
+        buffer->indexCount = indexCount;
+        buffer->indexType = indexType;
+        buffer->bytes = vertexBytes + indexBytes;
+
+        glGenVertexArrays(1, &buffer->VAO);
+        glGenBuffers(1, &buffer->VBO);
+        glGenBuffers(1, &buffer->EBO);
+
+        glBindVertexArray(buffer->VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer->VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertices, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer->EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices, GL_STATIC_DRAW);
+        setupAttributes();
+        glBindVertexArray(0);
+
+        buffers[key] = buffer;
+        counters.misses++;
+        counters.buffers++;
+        counters.bytes += buffer->bytes;
+        return buffer;
+    }
+
+    Stats stats() const { return counters; }
+
+    void printStats() const
+    {
+        cout << "GEOMETRY_REGISTRY:: " << counters.buffers << " buffers (" << counters.bytes / 1024 << " KB), "
+             << counters.hits << " hits, " << counters.misses << " misses, " << counters.bytesSaved / 1024 << " KB saved" << endl;
+    }
+
+private:
+    unordered_map<uint64_t, weak_ptr<GeometryBuffer> > buffers;
+    Stats counters;
+
+    GeometryRegistry()
+    {
+        counters.hits = counters.misses = counters.buffers = 0;
+        counters.bytesSaved = counters.bytes = 0;
+    }
+
+    // deleter of the shared buffers
+    void release(GeometryBuffer *buffer)
+    {
+        unordered_map<uint64_t, weak_ptr<GeometryBuffer> >::iterator it = buffers.find(buffer->key);
+        if (it != buffers.end() && it->second.expired())
+            buffers.erase(it);
+        counters.buffers--;
+        counters.bytes -= buffer->bytes;
+        glDeleteVertexArrays(1, &buffer->VAO);
+        glDeleteBuffers(1, &buffer->VBO);
+        glDeleteBuffers(1, &buffer->EBO);
+        delete buffer;
+    }
+};
+
+#endif
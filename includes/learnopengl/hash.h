@@ -0,0 +1,30 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 64-bit FNV-1a. Not cryptographic, but cheap, stable across runs and platforms, which is all
+// the on-disk caches need to decide whether their contents still match the source data.
+const uint64_t FNV1A_OFFSET_BASIS = 14695981039346656037ULL;
+const uint64_t FNV1A_PRIME        = 1099511628211ULL;
+
+inline uint64_t hashBytes(const void *data, size_t size, uint64_t seed = FNV1A_OFFSET_BASIS)
+{
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= FNV1A_PRIME;
+    }
+    return hash;
+}
+
+inline uint64_t hashString(const std::string &str, uint64_t seed = FNV1A_OFFSET_BASIS)
+{
+    return hashBytes(str.data(), str.size(), seed);
+}
+
+#endif
@@ -0,0 +1,922 @@
+#ifndef JPEG_DECODER_H
+#define JPEG_DECODER_H
+
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JPEG_DECODER_SSE2 1
+#include <emmintrin.h>
+#endif
+using namespace std;
+
+// A decoder for baseline JPEG files (8-bit samples, Huffman coded, all components in one interleaved scan),
+// which is how nearly all of the planet textures are saved, that is faster than stb_image and uses every core:
+//  - files with restart markers have their restart intervals entropy decoded (and transformed) in parallel;
+//  - other files are entropy decoded on the calling thread, while the pool transforms the MCU rows behind it;
+//  - chroma upsampling and YCbCr to RGB conversion run in parallel over bands of rows.
+// The IDCT, upsampling and color conversion use SSE2 where available. The result has the channels stbi_load
+// gives (1 for grayscale, 3 otherwise) and uses the same triangle filter for chroma, but a float IDCT and its
+// own fixed point color conversion, so some pixels differ by up to three levels. Progressive, arithmetic
+// coded, 12-bit, CMYK, RGB and multi scan files are left to stb_image: DecodeJPEG returns nullptr for them.
+
+// MCU rows of a file without restart markers, and pixel rows, handed to the pool at a time
+const int JPEG_BAND_MCU_ROWS = 2;
+const int JPEG_BAND_ROWS = 32;
+const int JPEG_FAST_BITS = 9;
+
+// natural order index, transposed (column * 8 + row), of each coefficient in zigzag order. Blocks are kept
+// transposed so the first IDCT pass runs down the SIMD lanes and the second one leaves rows of pixels.
+const unsigned char JPEG_TRANSPOSED_ORDER[64] = {
+     0,  8,  1,  2,  9, 16, 24, 17, 10,  3,  4, 11, 18, 25, 32, 40, 33, 26, 19, 12,  5,  6, 13, 20, 27, 34, 41, 48, 56, 49, 42, 35,
+    28, 21, 14,  7, 15, 22, 29, 36, 43, 50, 57, 58, 51, 44, 37, 30, 23, 31, 38, 45, 52, 59, 60, 53, 46, 39, 47, 54, 61, 62, 55, 63
+};
+
+struct JPEGHuffman
+{
+    uint16_t fast[1 << JPEG_FAST_BITS];     // length << 8 | symbol for codes of up to JPEG_FAST_BITS bits, 0 for longer ones
+    int16_t fastAC[1 << JPEG_FAST_BITS];    // value << 8 | run << 4 | length for AC codes whose value fits as well, else 0
+    int maxCode[18];                        // codes of each length are below this...
+    int delta[17];                          // ...and their symbol is symbols[code + delta]
+    unsigned char symbols[256];
+    bool defined;
+
+    JPEGHuffman() : defined(false) {}
+
+    bool build(const unsigned char *counts, const unsigned char *values, int total)
+    {
+        memset(fast, 0, sizeof(fast));
+        memset(fastAC, 0, sizeof(fastAC));
+        memcpy(symbols, values, total);
+        int code = 0, k = 0;
+        for (int length = 1; length <= 16; length++)
+        {
+            delta[length] = k - code;
+            for (int i = 0; i < counts[length - 1]; i++, code++, k++)
+                if (length <= JPEG_FAST_BITS)
+                {
+                    int first = code << (JPEG_FAST_BITS - length), count = 1 << (JPEG_FAST_BITS - length);
+                    for (int j = 0; j < count; j++)
+                        fast[first + j] = static_cast<uint16_t>(length << 8 | values[k]);
+                }
+            if (code > (1 << length))
+                return false;
+            maxCode[length] = code;
+            code <<= 1;
+        }
+        maxCode[17] = INT32_MAX;
+        defined = true;
+        return true;
+    }
+
+    // fills fastAC, for an AC table: run, value and length of a code together in one lookup
+    void buildFastAC()
+    {
+        for (int i = 0; i < (1 << JPEG_FAST_BITS); i++)
+        {
+            if (!fast[i])
+                continue;
+            int length = fast[i] >> 8, run = (fast[i] >> 4) & 15, size = fast[i] & 15;
+            if (size == 0 || length + size > JPEG_FAST_BITS)
+                continue;
+            int value = (i >> (JPEG_FAST_BITS - length - size)) & ((1 << size) - 1);
+            if (value < (1 << (size - 1)))
+                value -= (1 << size) - 1;
+            if (value >= -128 && value <= 127)
+                fastAC[i] = static_cast<int16_t>(value * 256 + run * 16 + length + size);
+        }
+    }
+};
+
+// the entropy coded bits of a scan, with the stuffed zero bytes taken out. At a marker (the next restart
+// interval or the end of the scan) it stops and returns zeros.
+struct JPEGBitReader
+{
+    const unsigned char *cursor, *end;
+    uint64_t bits;      // next bits of the stream, starting at the top bit
+    int count;          // how many of them are valid
+
+    JPEGBitReader(const unsigned char *data, const unsigned char *dataEnd) : cursor(data), end(dataEnd), bits(0), count(0) {}
+
+    void refill()
+    {
+        while (count <= 56)
+        {
+            unsigned int byte = 0;
+            if (cursor < end)
+            {
+                byte = *cursor;
+                if (byte != 0xFF)
+                    cursor++;
+                else if (cursor + 1 < end && cursor[1] == 0)
+                    cursor += 2;
+                else
+                {
+                    byte = 0;
+                    end = cursor;
+                }
+            }
+            bits |= uint64_t(byte) << (56 - count);
+            count += 8;
+        }
+    }
+    unsigned int peek(int n) const { return static_cast<unsigned int>(bits >> (64 - n)); }
+    void skip(int n) { bits <<= n; count -= n; }
+    // the signed value of the next n (1 to 16) bits
+    int receive(int n)
+    {
+        int value = static_cast<int>(peek(n));
+        skip(n);
+        return value < (1 << (n - 1)) ? value - (1 << n) + 1 : value;
+    }
+
+    int decode(const JPEGHuffman &table)
+    {
+        unsigned int entry = table.fast[peek(JPEG_FAST_BITS)];
+        if (entry)
+        {
+            skip(entry >> 8);
+            return entry & 255;
+        }
+        for (int length = JPEG_FAST_BITS + 1; length <= 16; length++)
+        {
+            int code = static_cast<int>(peek(length));
+            if (code < table.maxCode[length])
+            {
+                skip(length);
+                return table.symbols[code + table.delta[length]];
+            }
+        }
+        return -1;
+    }
+};
+
+// decodes the next block of a component into block (transposed), returning the zigzag index of its last
+// nonzero coefficient (0 when there is only DC), or -1 on corrupt data.
+inline int JPEGDecodeBlock(JPEGBitReader &reader, const JPEGHuffman &dc, const JPEGHuffman &ac, int &predictor, int16_t *block)
+{
+    memset(block, 0, 64 * sizeof(int16_t));
+    if (reader.count < 32)
+        reader.refill();
+    int size = reader.decode(dc);
+    if (size < 0 || size > 11)
+        return -1;
+    predictor += size ? reader.receive(size) : 0;
+    block[0] = static_cast<int16_t>(predictor);
+    int last = 0;
+    for (int k = 1; k < 64; k++)
+    {
+        if (reader.count < 32)
+            reader.refill();
+        int fast = ac.fastAC[reader.peek(JPEG_FAST_BITS)];
+        if (fast)
+        {
+            k += (fast >> 4) & 15;
+            if (k > 63)
+                return -1;
+            reader.skip(fast & 15);
+            block[JPEG_TRANSPOSED_ORDER[k]] = static_cast<int16_t>(fast >> 8);
+            last = k;
+            continue;
+        }
+        int symbol = reader.decode(ac);
+        if (symbol < 0)
+            return -1;
+        int run = symbol >> 4;
+        size = symbol & 15;
+        if (size == 0)
+        {
+            if (run != 15)
+                break;      // end of block
+            k += 15;        // sixteen zeros
+            continue;
+        }
+        k += run;
+        if (k > 63)
+            return -1;
+        block[JPEG_TRANSPOSED_ORDER[k]] = static_cast<int16_t>(reader.receive(size));
+        last = k;
+    }
+    return last;
+}
+
+// ---------------------------------------------------------------------------------------------------------
+
+// the AAN float IDCT (jidctflt.c of libjpeg), on one float / four floats at a time
+struct JPEGLanes1
+{
+    typedef float F;
+    static F add(F a, F b) { return a + b; }
+    static F sub(F a, F b) { return a - b; }
+    static F mul(F a, F b) { return a * b; }
+    static F set(float v) { return v; }
+};
+
+#ifdef JPEG_DECODER_SSE2
+struct JPEGLanes4
+{
+    typedef __m128 F;
+    static F add(F a, F b) { return _mm_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static F set(float v) { return _mm_set1_ps(v); }
+};
+#endif
+
+// one dimension of the IDCT, in place. The dequantization table carries the AAN scale factors.
+template <typename L>
+inline void JPEGInverseDCT8(typename L::F *v)
+{
+    typedef typename L::F F;
+    // even part
+    F tmp10 = L::add(v[0], v[4]), tmp11 = L::sub(v[0], v[4]);
+    F tmp13 = L::add(v[2], v[6]);
+    F tmp12 = L::sub(L::mul(L::sub(v[2], v[6]), L::set(1.414213562f)), tmp13);
+    F even0 = L::add(tmp10, tmp13), even3 = L::sub(tmp10, tmp13);
+    F even1 = L::add(tmp11, tmp12), even2 = L::sub(tmp11, tmp12);
+    // odd part
+    F z13 = L::add(v[5], v[3]), z10 = L::sub(v[5], v[3]);
+    F z11 = L::add(v[1], v[7]), z12 = L::sub(v[1], v[7]);
+    F odd7 = L::add(z11, z13);
+    F odd11 = L::mul(L::sub(z11, z13), L::set(1.414213562f));
+    F z5 = L::mul(L::add(z10, z12), L::set(1.847759065f));
+    F odd10 = L::sub(z5, L::mul(z12, L::set(1.082392200f)));
+    F odd12 = L::sub(z5, L::mul(z10, L::set(2.613125930f)));
+    F odd6 = L::sub(odd12, odd7);
+    F odd5 = L::sub(odd11, odd6);
+    F odd4 = L::sub(odd10, odd5);
+
+    v[0] = L::add(even0, odd7); v[7] = L::sub(even0, odd7);
+    v[1] = L::add(even1, odd6); v[6] = L::sub(even1, odd6);
+    v[2] = L::add(even2, odd5); v[5] = L::sub(even2, odd5);
+    v[3] = L::add(even3, odd4); v[4] = L::sub(even3, odd4);
+}
+
+// the dequantization table of a component: the quantizer of each coefficient times the AAN scale factors of
+// its row and column, over 8, transposed like the blocks
+inline void JPEGDequantTable(const uint16_t *zigzag, float *table)
+{
+    static const double scale[8] = { 1.0, 1.387039845, 1.306562965, 1.175875602, 1.0, 0.785694958, 0.541196100, 0.275899379 };
+    for (int k = 0; k < 64; k++)
+    {
+        int index = JPEG_TRANSPOSED_ORDER[k];
+        table[index] = static_cast<float>(zigzag[k] * scale[index / 8] * scale[index % 8] / 8.0);
+    }
+}
+
+// transforms a (transposed) block into 8x8 pixels at out, rows stride bytes apart
+inline void JPEGInverseDCT(const int16_t *block, const float *table, bool dcOnly, unsigned char *out, size_t stride)
+{
+    if (dcOnly)
+    {
+        int value = static_cast<int>(block[0] * table[0] + 128.5f);
+        value = std::min(255, std::max(0, value));
+        for (int y = 0; y < 8; y++)
+            memset(out + y * stride, value, 8);
+        return;
+    }
+#ifdef JPEG_DECODER_SSE2
+    // first pass along the rows of the stored block (the columns of the image), four image rows per vector
+    alignas(16) float transposed[64];
+    for (int half = 0; half < 2; half++)
+    {
+        __m128 v[8];
+        for (int u = 0; u < 8; u++)
+        {
+            __m128i coefficients = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(block + u * 8 + half * 4));
+            __m128i wide = _mm_srai_epi32(_mm_unpacklo_epi16(coefficients, coefficients), 16);
+            v[u] = _mm_mul_ps(_mm_cvtepi32_ps(wide), _mm_loadu_ps(table + u * 8 + half * 4));
+        }
+        JPEGInverseDCT8<JPEGLanes4>(v);
+        _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+        _MM_TRANSPOSE4_PS(v[4], v[5], v[6], v[7]);
+        for (int i = 0; i < 4; i++)
+        {
+            _mm_store_ps(transposed + (half * 4 + i) * 8, v[i]);
+            _mm_store_ps(transposed + (half * 4 + i) * 8 + 4, v[4 + i]);
+        }
+    }
+    // second pass down the image columns, leaving rows of pixels
+    __m128 left[8], right[8];
+    for (int i = 0; i < 8; i++)
+    {
+        left[i] = _mm_load_ps(transposed + i * 8);
+        right[i] = _mm_load_ps(transposed + i * 8 + 4);
+    }
+    JPEGInverseDCT8<JPEGLanes4>(left);
+    JPEGInverseDCT8<JPEGLanes4>(right);
+    __m128 bias = _mm_set1_ps(128.0f);
+    for (int y = 0; y < 8; y++)
+    {
+        __m128i low = _mm_cvtps_epi32(_mm_add_ps(left[y], bias)), high = _mm_cvtps_epi32(_mm_add_ps(right[y], bias));
+        __m128i words = _mm_packs_epi32(low, high);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + y * stride), _mm_packus_epi16(words, words));
+    }
+#else
+    float transposed[64];
+    for (int row = 0; row < 8; row++)
+    {
+        float v[8];
+        for (int u = 0; u < 8; u++)
+            v[u] = block[u * 8 + row] * table[u * 8 + row];
+        JPEGInverseDCT8<JPEGLanes1>(v);
+        for (int x = 0; x < 8; x++)
+            transposed[row * 8 + x] = v[x];
+    }
+    for (int x = 0; x < 8; x++)
+    {
+        float v[8];
+        for (int row = 0; row < 8; row++)
+            v[row] = transposed[row * 8 + x];
+        JPEGInverseDCT8<JPEGLanes1>(v);
+        for (int y = 0; y < 8; y++)
+            out[y * stride + x] = static_cast<unsigned char>(std::min(255, std::max(0, static_cast<int>(v[y] + 128.5f))));
+    }
+#endif
+}
+
+// ---------------------------------------------------------------------------------------------------------
+
+struct JPEGComponent
+{
+    int id, h, v, quant;        // sampling factors and quantization table
+    int dcTable, acTable;
+    int width, height;          // samples it has, rounded up
+    int blocksWide, blocksHigh; // blocks its plane has, whole MCUs
+    float dequant[64];
+    vector<unsigned char> plane;
+};
+
+struct JPEGFrame
+{
+    int width, height, hmax, vmax;
+    int mcusWide, mcusHigh, restartInterval;
+    int adobeTransform;                 // of an Adobe APP14 segment, -1 without one
+    vector<JPEGComponent> components;
+    uint16_t quant[4][64];
+    bool quantDefined[4];
+    JPEGHuffman dc[4], ac[4];
+    const unsigned char *scan, *scanEnd; // the entropy coded data
+
+    JPEGFrame() : width(0), height(0), hmax(1), vmax(1), mcusWide(0), mcusHigh(0), restartInterval(0), adobeTransform(-1),
+                  scan(nullptr), scanEnd(nullptr)
+    {
+        quantDefined[0] = quantDefined[1] = quantDefined[2] = quantDefined[3] = false;
+    }
+};
+
+// reads the segments up to the first scan. False for anything but a baseline JPEG this decoder handles.
+inline bool JPEGParseHeaders(const unsigned char *bytes, size_t size, JPEGFrame &frame)
+{
+    if (size < 4 || bytes[0] != 0xFF || bytes[1] != 0xD8)
+        return false;
+    size_t p = 2;
+    for (;;)
+    {
+        if (p + 4 > size || bytes[p] != 0xFF)
+            return false;
+        while (p + 4 < size && bytes[p + 1] == 0xFF) // fill bytes
+            p++;
+        unsigned int marker = bytes[p + 1];
+        size_t length = bytes[p + 2] << 8 | bytes[p + 3];
+        if (length < 2 || p + 2 + length > size)
+            return false;
+        const unsigned char *segment = bytes + p + 4, *segmentEnd = bytes + p + 2 + length;
+        switch (marker)
+        {
+        case 0xDB: // quantization tables
+            while (segment < segmentEnd)
+            {
+                int precision = segment[0] >> 4, id = segment[0] & 15;
+                if (id > 3 || segment + 1 + 64 * (precision + 1) > segmentEnd)
+                    return false;
+                for (int k = 0; k < 64; k++)
+                    frame.quant[id][k] = precision ? uint16_t(segment[1 + 2 * k] << 8 | segment[2 + 2 * k]) : segment[1 + k];
+                frame.quantDefined[id] = true;
+                segment += 1 + 64 * (precision + 1);
+            }
+            break;
+        case 0xC4: // Huffman tables
+            while (segment < segmentEnd)
+            {
+                int tableClass = segment[0] >> 4, id = segment[0] & 15;
+                if (tableClass > 1 || id > 3 || segment + 17 > segmentEnd)
+                    return false;
+                int total = 0;
+                for (int i = 0; i < 16; i++)
+                    total += segment[1 + i];
+                if (total > 256 || segment + 17 + total > segmentEnd)
+                    return false;
+                JPEGHuffman &table = tableClass ? frame.ac[id] : frame.dc[id];
+                if (!table.build(segment + 1, segment + 17, total))
+                    return false;
+                if (tableClass)
+                    table.buildFastAC();
+                segment += 17 + total;
+            }
+            break;
+        case 0xDD: // restart interval
+            if (length < 4)
+                return false;
+            frame.restartInterval = segment[0] << 8 | segment[1];
+            break;
+        case 0xEE: // Adobe APP14: tells whether 3 components are YCbCr or RGB
+            if (length >= 14 && memcmp(segment, "Adobe", 5) == 0)
+                frame.adobeTransform = segment[11];
+            break;
+        case 0xC0: // baseline
+        case 0xC1: // extended sequential, Huffman coded
+        {
+            if (length < 8 || segment[0] != 8)
+                return false;
+            frame.height = segment[1] << 8 | segment[2];
+            frame.width = segment[3] << 8 | segment[4];
+            int count = segment[5];
+            if (frame.width < 1 || frame.height < 1 || (count != 1 && count != 3) || length < size_t(8 + 3 * count))
+                return false;
+            frame.components.resize(count);
+            for (int i = 0; i < count; i++)
+            {
+                JPEGComponent &component = frame.components[i];
+                component.id = segment[6 + 3 * i];
+                component.h = count == 1 ? 1 : segment[7 + 3 * i] >> 4; // a single component is never interleaved
+                component.v = count == 1 ? 1 : segment[7 + 3 * i] & 15;
+                component.quant = segment[8 + 3 * i];
+                if (component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4 || component.quant > 3)
+                    return false;
+                frame.hmax = std::max(frame.hmax, component.h);
+                frame.vmax = std::max(frame.vmax, component.v);
+            }
+            if (count == 3 && frame.components[0].id == 'R' && frame.components[1].id == 'G' && frame.components[2].id == 'B')
+                return false;
+            break;
+        }
+        case 0xDA: // start of scan
+        {
+            int count = segment[0];
+            if (frame.components.empty() || count != int(frame.components.size()) || length != size_t(6 + 2 * count))
+                return false; // one scan per component (or no frame yet)
+            for (int i = 0; i < count; i++)
+            {
+                JPEGComponent &component = frame.components[i];
+                if (segment[1 + 2 * i] != component.id)
+                    return false;
+                component.dcTable = segment[2 + 2 * i] >> 4;
+                component.acTable = segment[2 + 2 * i] & 15;
+                if (component.dcTable > 3 || component.acTable > 3 ||
+                    !frame.dc[component.dcTable].defined || !frame.ac[component.acTable].defined || !frame.quantDefined[component.quant])
+                    return false;
+            }
+            if (segment[1 + 2 * count] != 0 || segment[2 + 2 * count] != 63 || segment[3 + 2 * count] != 0)
+                return false;
+            if (count == 3 && frame.adobeTransform == 0)
+                return false;
+            frame.scan = segmentEnd;
+            // the scan ends at the first marker that isn't a restart marker
+            const unsigned char *end = bytes + size, *cursor = frame.scan;
+            while ((cursor = static_cast<const unsigned char*>(memchr(cursor, 0xFF, end - cursor))) != nullptr && cursor + 1 < end &&
+                   (cursor[1] == 0 || (cursor[1] >= 0xD0 && cursor[1] <= 0xD7)))
+                cursor += 2;
+            frame.scanEnd = cursor && cursor < end ? cursor : end;
+            return true;
+        }
+        case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+        case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+            return false; // progressive, lossless, hierarchical or arithmetic coded
+        case 0xD9:
+            return false;
+        default:
+            break;
+        }
+        p += 2 + length;
+    }
+}
+
+// entropy decodes a scan (or a restart interval of it) from data on, MCU by MCU, handing every block to
+// sink(component, blockX, blockY, coefficients, dcOnly)
+struct JPEGScanDecoder
+{
+    const JPEGFrame &frame;
+    JPEGBitReader reader;
+    int predictors[3];
+
+    JPEGScanDecoder(const JPEGFrame &frame, const unsigned char *data) : frame(frame), reader(data, frame.scanEnd)
+    {
+        predictors[0] = predictors[1] = predictors[2] = 0;
+    }
+
+    // decodes MCUs [first, last), false on corrupt data
+    template <typename Sink>
+    bool decode(int first, int last, Sink &sink)
+    {
+        alignas(16) int16_t block[64];
+        for (int mcu = first; mcu < last; mcu++)
+        {
+            int mcuX = mcu % frame.mcusWide, mcuY = mcu / frame.mcusWide;
+            for (unsigned int c = 0; c < frame.components.size(); c++)
+            {
+                const JPEGComponent &component = frame.components[c];
+                for (int y = 0; y < component.v; y++)
+                    for (int x = 0; x < component.h; x++)
+                    {
+                        int lastIndex = JPEGDecodeBlock(reader, frame.dc[component.dcTable], frame.ac[component.acTable], predictors[c], block);
+                        if (lastIndex < 0)
+                            return false;
+                        sink(c, mcuX * component.h + x, mcuY * component.v + y, block, lastIndex == 0);
+                    }
+            }
+        }
+        return true;
+    }
+};
+
+// transforms every block straight into the component planes
+struct JPEGPlaneSink
+{
+    JPEGFrame &frame;
+    explicit JPEGPlaneSink(JPEGFrame &frame) : frame(frame) {}
+    void operator()(int c, int blockX, int blockY, const int16_t *block, bool dcOnly)
+    {
+        JPEGComponent &component = frame.components[c];
+        size_t stride = component.blocksWide * 8;
+        JPEGInverseDCT(block, component.dequant, dcOnly, &component.plane[blockY * 8 * stride + blockX * 8], stride);
+    }
+};
+
+// keeps the coefficients of a band of MCU rows for the pool to transform. Bands go through a ring of slots.
+struct JPEGBandSink
+{
+    JPEGFrame &frame;
+    vector<int16_t> &coefficients;      // of every slot
+    vector<unsigned char> &dcOnly;      // per block of every slot
+    size_t slotBlocks;                  // blocks per slot
+    vector<size_t> componentOffset;     // first block of each component within a slot
+    int band;                           // the band being decoded
+
+    JPEGBandSink(JPEGFrame &frame, vector<int16_t> &coefficients, vector<unsigned char> &dcOnly, int slots)
+        : frame(frame), coefficients(coefficients), dcOnly(dcOnly), slotBlocks(0), band(0)
+    {
+        for (unsigned int c = 0; c < frame.components.size(); c++)
+        {
+            componentOffset.push_back(slotBlocks);
+            slotBlocks += size_t(frame.components[c].blocksWide) * frame.components[c].v * JPEG_BAND_MCU_ROWS;
+        }
+        coefficients.resize(slotBlocks * slots * 64);
+        dcOnly.resize(slotBlocks * slots);
+    }
+
+    size_t blockIndex(int slot, int c, int blockX, int bandBlockY) const
+    {
+        return slot * slotBlocks + componentOffset[c] + size_t(bandBlockY) * frame.components[c].blocksWide + blockX;
+    }
+
+    void operator()(int c, int blockX, int blockY, const int16_t *block, bool onlyDC)
+    {
+        int slot = band % (dcOnly.size() / slotBlocks);
+        size_t index = blockIndex(slot, c, blockX, blockY - band * JPEG_BAND_MCU_ROWS * frame.components[c].v);
+        memcpy(&coefficients[index * 64], block, 64 * sizeof(int16_t));
+        dcOnly[index] = onlyDC;
+    }
+
+    // transforms band b, kept in its slot, into the planes
+    void transform(int b)
+    {
+        int slot = b % (dcOnly.size() / slotBlocks);
+        for (unsigned int c = 0; c < frame.components.size(); c++)
+        {
+            JPEGComponent &component = frame.components[c];
+            size_t stride = component.blocksWide * 8;
+            int firstRow = b * JPEG_BAND_MCU_ROWS * component.v;
+            int lastRow = std::min(component.blocksHigh, firstRow + JPEG_BAND_MCU_ROWS * component.v);
+            for (int blockY = firstRow; blockY < lastRow; blockY++)
+                for (int blockX = 0; blockX < component.blocksWide; blockX++)
+                {
+                    size_t index = blockIndex(slot, c, blockX, blockY - firstRow);
+                    JPEGInverseDCT(&coefficients[index * 64], component.dequant, dcOnly[index] != 0,
+                                   &component.plane[blockY * 8 * stride + blockX * 8], stride);
+                }
+        }
+    }
+};
+
+// entropy decodes a scan without restart markers on the calling thread while the pool transforms the bands it
+// has finished. Every band is transformed by exactly one thread: a helper that claims it, or the decoder itself
+// when it needs the slot back before a helper got there.
+inline bool JPEGDecodePipelined(JPEGFrame &frame, ThreadPool &pool)
+{
+    enum { PENDING, DECODED, CLAIMED, DONE };
+    int bands = (frame.mcusHigh + JPEG_BAND_MCU_ROWS - 1) / JPEG_BAND_MCU_ROWS;
+    int slots = static_cast<int>(std::min<size_t>(bands, 2 * (pool.size() + 1)));
+    vector<int16_t> coefficients;
+    vector<unsigned char> dcOnly;
+    JPEGBandSink sink(frame, coefficients, dcOnly, slots);
+    unique_ptr<atomic<int>[]> state(new atomic<int>[bands]);
+    for (int b = 0; b < bands; b++)
+        state[b] = PENDING;
+    atomic<int> nextBand(0);
+    atomic<bool> failed(false);
+    mutex stateMutex;
+    condition_variable changed;
+    auto publish = [&](int b, int value) {
+        {
+            lock_guard<mutex> lock(stateMutex);
+            state[b] = value;
+        }
+        changed.notify_all();
+    };
+
+    // index 0 is always claimed first, by a running thread, so helpers never wait for a decoder that doesn't run
+    pool.parallelFor(pool.size() + 1, [&](size_t index) {
+        if (index == 0)
+        {
+            JPEGScanDecoder decoder(frame, frame.scan);
+            for (int b = 0; b < bands; b++)
+            {
+                if (b >= slots)
+                {
+                    // the slot still holds band b - slots: transform it here unless a helper is at it already
+                    int previous = b - slots, expected = DECODED;
+                    if (state[previous].compare_exchange_strong(expected, CLAIMED))
+                    {
+                        sink.transform(previous);
+                        publish(previous, DONE);
+                    }
+                    else
+                    {
+                        unique_lock<mutex> lock(stateMutex);
+                        changed.wait(lock, [&]() { return state[previous] == DONE; });
+                    }
+                }
+                sink.band = b;
+                int last = std::min(frame.mcusHigh, (b + 1) * JPEG_BAND_MCU_ROWS) * frame.mcusWide;
+                if (!decoder.decode(b * JPEG_BAND_MCU_ROWS * frame.mcusWide, last, sink))
+                {
+                    // give up: nobody transforms anything any more
+                    failed = true;
+                    for (int rest = b; rest < bands; rest++)
+                        publish(rest, DONE);
+                    return;
+                }
+                publish(b, DECODED);
+            }
+            return;
+        }
+        for (int b = nextBand++; b < bands; b = nextBand++)
+        {
+            {
+                unique_lock<mutex> lock(stateMutex);
+                changed.wait(lock, [&]() { return state[b] != PENDING; });
+            }
+            int expected = DECODED;
+            if (state[b].compare_exchange_strong(expected, CLAIMED))
+            {
+                sink.transform(b);
+                publish(b, DONE);
+            }
+        }
+    });
+    return !failed;
+}
+
+// ---------------------------------------------------------------------------------------------------------
+
+// one row of a subsampled component at full resolution, with the triangle filter of stb_image (and libjpeg's
+// "fancy" upsampling): each output sample weighs the nearest input 3:1 against the next one over, in each
+// direction that was subsampled. scratch holds the component's width + 2 values.
+inline void JPEGUpsampleRow(const JPEGComponent &component, int hs, int vs, int y, int16_t *scratch, unsigned char *out)
+{
+    size_t stride = component.blocksWide * 8;
+    int width = component.width;
+    int nearRow = y / vs;
+    int farRow = vs == 1 ? nearRow : std::min(component.height - 1, std::max(0, (y & 1) ? nearRow + 1 : nearRow - 1));
+    const unsigned char *nearSamples = &component.plane[nearRow * stride], *farSamples = &component.plane[farRow * stride];
+    // vertically: 3 near + far, or 4 near, into scratch[1..width]
+    int16_t *t = scratch + 1;
+    int x = 0;
+#ifdef JPEG_DECODER_SSE2
+    __m128i zero = _mm_setzero_si128();
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i n = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(nearSamples + x)), zero);
+        __m128i f = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(farSamples + x)), zero);
+        __m128i sum = vs == 1 ? _mm_slli_epi16(n, 2) : _mm_add_epi16(_mm_add_epi16(_mm_slli_epi16(n, 1), n), f);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(t + x), sum);
+    }
+#endif
+    for (; x < width; x++)
+        t[x] = static_cast<int16_t>(vs == 1 ? nearSamples[x] * 4 : nearSamples[x] * 3 + farSamples[x]);
+    if (hs == 1)
+    {
+        for (x = 0; x < width; x++)
+            out[x] = static_cast<unsigned char>((t[x] + 2) >> 2);
+        return;
+    }
+    // horizontally: 3 near + the neighbour on that side, both samples stay put at the edges
+    t[-1] = t[0];
+    t[width] = t[width - 1];
+    x = 0;
+#ifdef JPEG_DECODER_SSE2
+    __m128i eight = _mm_set1_epi16(8);
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t + x));
+        __m128i previous = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t + x - 1));
+        __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t + x + 1));
+        __m128i triple = _mm_add_epi16(_mm_add_epi16(current, current), _mm_add_epi16(current, eight));
+        __m128i even = _mm_srli_epi16(_mm_add_epi16(triple, previous), 4);
+        __m128i odd = _mm_srli_epi16(_mm_add_epi16(triple, next), 4);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * x),
+                         _mm_packus_epi16(_mm_unpacklo_epi16(even, odd), _mm_unpackhi_epi16(even, odd)));
+    }
+#endif
+    for (; x < width; x++)
+    {
+        out[2 * x] = static_cast<unsigned char>((3 * t[x] + t[x - 1] + 8) >> 4);
+        out[2 * x + 1] = static_cast<unsigned char>((3 * t[x] + t[x + 1] + 8) >> 4);
+    }
+}
+
+// YCbCr to RGB (JFIF), in fixed point: the chroma differences are scaled by 128 and multiplied by the
+// coefficients times 4096, keeping 3 fractional bits.
+const int JPEG_CR_R = 5743;     // 1.402
+const int JPEG_CB_G = -1410;    // -0.344136
+const int JPEG_CR_G = -2925;    // -0.714136
+const int JPEG_CB_B = 7258;     // 1.772
+
+inline void JPEGColorConvertRow(const unsigned char *Y, const unsigned char *Cb, const unsigned char *Cr, int width, unsigned char *out)
+{
+    int x = 0;
+#ifdef JPEG_DECODER_SSE2
+    __m128i zero = _mm_setzero_si128(), half = _mm_set1_epi16(4), center = _mm_set1_epi16(128);
+    __m128i crR = _mm_set1_epi16(JPEG_CR_R), cbG = _mm_set1_epi16(JPEG_CB_G), crG = _mm_set1_epi16(JPEG_CR_G), cbB = _mm_set1_epi16(JPEG_CB_B);
+    alignas(16) unsigned char rgb[3][16];
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i y = _mm_add_epi16(_mm_slli_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(Y + x)), zero), 3), half);
+        __m128i cb = _mm_slli_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(Cb + x)), zero), center), 7);
+        __m128i cr = _mm_slli_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(Cr + x)), zero), center), 7);
+        __m128i r = _mm_srai_epi16(_mm_add_epi16(y, _mm_mulhi_epi16(cr, crR)), 3);
+        __m128i g = _mm_srai_epi16(_mm_add_epi16(y, _mm_add_epi16(_mm_mulhi_epi16(cb, cbG), _mm_mulhi_epi16(cr, crG))), 3);
+        __m128i b = _mm_srai_epi16(_mm_add_epi16(y, _mm_mulhi_epi16(cb, cbB)), 3);
+        _mm_store_si128(reinterpret_cast<__m128i*>(rgb[0]), _mm_packus_epi16(r, r));
+        _mm_store_si128(reinterpret_cast<__m128i*>(rgb[1]), _mm_packus_epi16(g, g));
+        _mm_store_si128(reinterpret_cast<__m128i*>(rgb[2]), _mm_packus_epi16(b, b));
+        unsigned char *pixel = out + 3 * x;
+        for (int i = 0; i < 8; i++, pixel += 3)
+        {
+            pixel[0] = rgb[0][i];
+            pixel[1] = rgb[1][i];
+            pixel[2] = rgb[2][i];
+        }
+    }
+#endif
+    for (; x < width; x++)
+    {
+        int y = Y[x] * 8 + 4, cb = (Cb[x] - 128) * 128, cr = (Cr[x] - 128) * 128;
+        int r = (y + ((cr * JPEG_CR_R) >> 16)) >> 3;
+        int g = (y + ((cb * JPEG_CB_G) >> 16) + ((cr * JPEG_CR_G) >> 16)) >> 3;
+        int b = (y + ((cb * JPEG_CB_B) >> 16)) >> 3;
+        out[3 * x + 0] = static_cast<unsigned char>(std::min(255, std::max(0, r)));
+        out[3 * x + 1] = static_cast<unsigned char>(std::min(255, std::max(0, g)));
+        out[3 * x + 2] = static_cast<unsigned char>(std::min(255, std::max(0, b)));
+    }
+}
+
+// writes output rows [first, last) from the component planes
+inline void JPEGOutputRows(const JPEGFrame &frame, int first, int last, unsigned char *out)
+{
+    if (frame.components.size() == 1)
+    {
+        const JPEGComponent &gray = frame.components[0];
+        for (int y = first; y < last; y++)
+            memcpy(out + size_t(y) * frame.width, &gray.plane[size_t(y) * gray.blocksWide * 8], frame.width);
+        return;
+    }
+    vector<int16_t> scratch(frame.width + 2);
+    vector<unsigned char> upsampled[3];
+    for (int y = first; y < last; y++)
+    {
+        const unsigned char *rows[3];
+        for (int c = 0; c < 3; c++)
+        {
+            const JPEGComponent &component = frame.components[c];
+            int hs = frame.hmax / component.h, vs = frame.vmax / component.v;
+            if (hs == 1 && vs == 1)
+                rows[c] = &component.plane[size_t(y) * component.blocksWide * 8];
+            else
+            {
+                upsampled[c].resize(component.width * hs + 16);
+                JPEGUpsampleRow(component, hs, vs, y, scratch.data(), upsampled[c].data());
+                rows[c] = upsampled[c].data();
+            }
+        }
+        JPEGColorConvertRow(rows[0], rows[1], rows[2], frame.width, out + size_t(y) * frame.width * 3);
+    }
+}
+
+// decodes a baseline JPEG held in memory into 8-bit pixels, with 1 (grayscale) or 3 (RGB) channels. Returns
+// nullptr for files it doesn't handle or can't decode; stbi_load_from_memory may still read those. The pixels
+// are allocated with malloc(), so they are freed with free() or stbi_image_free() like those of stb_image.
+// Without a pool everything runs on the calling thread.
+inline unsigned char *DecodeJPEG(const unsigned char *bytes, size_t size, int &width, int &height, int &channels,
+                                 ThreadPool *pool = &ThreadPool::shared())
+{
+    JPEGFrame frame;
+    if (!bytes || !JPEGParseHeaders(bytes, size, frame))
+        return nullptr;
+    // chroma may be subsampled by 2 at most, in either direction
+    for (unsigned int c = 0; c < frame.components.size(); c++)
+    {
+        const JPEGComponent &component = frame.components[c];
+        if (frame.hmax % component.h != 0 || frame.vmax % component.v != 0 ||
+            frame.hmax / component.h > 2 || frame.vmax / component.v > 2)
+            return nullptr;
+    }
+    frame.mcusWide = (frame.width + 8 * frame.hmax - 1) / (8 * frame.hmax);
+    frame.mcusHigh = (frame.height + 8 * frame.vmax - 1) / (8 * frame.vmax);
+    for (unsigned int c = 0; c < frame.components.size(); c++)
+    {
+        JPEGComponent &component = frame.components[c];
+        component.width = (frame.width * component.h + frame.hmax - 1) / frame.hmax;
+        component.height = (frame.height * component.v + frame.vmax - 1) / frame.vmax;
+        component.blocksWide = frame.mcusWide * component.h;
+        component.blocksHigh = frame.mcusHigh * component.v;
+        component.plane.resize(size_t(component.blocksWide) * component.blocksHigh * 64);
+        JPEGDequantTable(frame.quant[component.quant], component.dequant);
+    }
+
+    int mcus = frame.mcusWide * frame.mcusHigh;
+    bool decoded = true;
+    if (frame.restartInterval > 0)
+    {
+        // every restart interval starts on a byte boundary right after its marker, with fresh predictors
+        vector<const unsigned char*> intervals(1, frame.scan);
+        for (const unsigned char *cursor = frame.scan; cursor + 1 < frame.scanEnd; )
+        {
+            cursor = static_cast<const unsigned char*>(memchr(cursor, 0xFF, frame.scanEnd - cursor - 1));
+            if (!cursor)
+                break;
+            if (cursor[1] >= 0xD0 && cursor[1] <= 0xD7)
+                intervals.push_back(cursor + 2);
+            cursor += 2;
+        }
+        size_t expected = (mcus + frame.restartInterval - 1) / frame.restartInterval;
+        if (intervals.size() < expected)
+            return nullptr;
+        intervals.resize(expected);
+        atomic<bool> failed(false);
+        auto decodeInterval = [&](size_t i) {
+            JPEGPlaneSink sink(frame);
+            JPEGScanDecoder decoder(frame, intervals[i]);
+            int first = static_cast<int>(i) * frame.restartInterval;
+            if (!decoder.decode(first, std::min(mcus, first + frame.restartInterval), sink))
+                failed = true;
+        };
+        if (pool)
+            pool->parallelFor(intervals.size(), decodeInterval);
+        else
+            for (size_t i = 0; i < intervals.size(); i++)
+                decodeInterval(i);
+        decoded = !failed;
+    }
+    else if (pool)
+        decoded = JPEGDecodePipelined(frame, *pool);
+    else
+    {
+        JPEGPlaneSink sink(frame);
+        JPEGScanDecoder decoder(frame, frame.scan);
+        decoded = decoder.decode(0, mcus, sink);
+    }
+    if (!decoded)
+        return nullptr;
+
+    int count = static_cast<int>(frame.components.size());
+    unsigned char *pixels = static_cast<unsigned char*>(malloc(size_t(frame.width) * frame.height * count));
+    if (!pixels)
+        return nullptr;
+    size_t bands = (frame.height + JPEG_BAND_ROWS - 1) / JPEG_BAND_ROWS;
+    auto output = [&](size_t band) {
+        JPEGOutputRows(frame, int(band) * JPEG_BAND_ROWS, std::min(frame.height, int(band + 1) * JPEG_BAND_ROWS), pixels);
+    };
+    if (pool)
+        pool->parallelFor(bands, output);
+    else
+        for (size_t band = 0; band < bands; band++)
+            output(band);
+    width = frame.width;
+    height = frame.height;
+    channels = count;
+    return pixels;
+}
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+// size and modification time of a file on disk, used by the asset caches to detect stale entries.
+struct FileStamp
+{
+    uint64_t size;
+    int64_t  mtime;
+
+    FileStamp() : size(0), mtime(0) {}
+
+    bool operator==(const FileStamp &other) const { return size == other.size && mtime == other.mtime; }
+    bool operator!=(const FileStamp &other) const { return !(*this == other); }
+
+    // returns false if the file does not exist (or can't be queried).
+    static bool query(const std::string &path, FileStamp &stamp)
+    {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            return false;
+        stamp.size  = static_cast<uint64_t>(info.st_size);
+        stamp.mtime = static_cast<int64_t>(info.st_mtime);
+        return true;
+    }
+};
+
+// reads a byte of every page in [data, data + size), so the pages of a mapping are in memory before a
+// thread that mustn't wait for the disk (like the render thread) reads them.
+inline void PrefetchMemory(const void *data, size_t size)
+{
+    const volatile unsigned char *bytes = static_cast<const volatile unsigned char*>(data);
+    unsigned char sum = 0;
+    for (size_t offset = 0; offset < size; offset += 4096)
+        sum += bytes[offset];
+    if (size > 0)
+        sum += bytes[size - 1];
+    (void)sum;
+}
+
+// read-only memory mapping of a whole file. The mapping lives as long as the object, so pointers
+// handed out by data() must not outlive it. Empty files open successfully with a null data pointer.
+class MappedFile
+{
+public:
+    MappedFile() : fileData(nullptr), fileSize(0), opened(false)
+#ifdef _WIN32
+        , fileHandle(INVALID_HANDLE_VALUE), mappingHandle(NULL)
+#endif
+    {
+    }
+
+    explicit MappedFile(const std::string &path) : MappedFile()
+    {
+        open(path);
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    bool open(const std::string &path)
+    {
+        close();
+#ifdef _WIN32
+        fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (fileHandle == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(fileHandle, &size))
+        {
+            close();
+            return false;
+        }
+        fileSize = static_cast<size_t>(size.QuadPart);
+        if (fileSize > 0)
+        {
+            mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mappingHandle == NULL)
+            {
+                close();
+                return false;
+            }
+            fileData = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+            if (fileData == nullptr)
+            {
+                close();
+                return false;
+            }
+        }
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        fileSize = static_cast<size_t>(info.st_size);
+        if (fileSize > 0)
+        {
+            void *mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED)
+            {
+                ::close(fd);
+                fileSize = 0;
+                return false;
+            }
+            fileData = static_cast<const char*>(mapping);
+        }
+        // the mapping keeps the file referenced, the descriptor itself is no longer needed
+        ::close(fd);
+#endif
+        opened = true;
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (fileData)
+            UnmapViewOfFile(fileData);
+        if (mappingHandle != NULL)
+            CloseHandle(mappingHandle);
+        if (fileHandle != INVALID_HANDLE_VALUE)
+            CloseHandle(fileHandle);
+        mappingHandle = NULL;
+        fileHandle = INVALID_HANDLE_VALUE;
+#else
+        if (fileData)
+            munmap(const_cast<char*>(fileData), fileSize);
+#endif
+        fileData = nullptr;
+        fileSize = 0;
+        opened = false;
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+
+    // exchanges the mappings; pointers into either stay valid
+    void swap(MappedFile &other)
+    {
+        std::swap(fileData, other.fileData);
+        std::swap(fileSize, other.fileSize);
+        std::swap(opened, other.opened);
+#ifdef _WIN32
+        std::swap(fileHandle, other.fileHandle);
+        std::swap(mappingHandle, other.mappingHandle);
+#endif
+    }
+
+    bool isOpen() const { return opened; }
+    const char *data() const { return fileData; }
+    size_t size() const { return fileSize; }
+
+private:
+    const char *fileData;
+    size_t fileSize;
+    bool opened;
+#ifdef _WIN32
+    HANDLE fileHandle;
+    HANDLE mappingHandle;
+#endif
+};
+
+#endif
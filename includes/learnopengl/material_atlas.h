@@ -0,0 +1,377 @@
+#ifndef MATERIAL_ATLAS_H
+#define MATERIAL_ATLAS_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/mip_stream.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/texture_budget.h>
+#include <learnopengl/texture_cache.h>
+#include <learnopengl/texture_upload.h>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// the texture units the atlas pages stay bound to, out of the way of the units Mesh::Draw binds plain textures to
+const unsigned int MATERIAL_DIFFUSE_UNIT  = 14;
+const unsigned int MATERIAL_SPECULAR_UNIT = 15;
+// vertex attribute the layers of a mesh's diffuse and specular maps go in (a vec2, -1 for none). No array is
+// bound to it: Mesh::Draw sets its current value, which is a lot cheaper than a uniform.
+const unsigned int MATERIAL_ATTRIBUTE = 5;
+// the specular layer of meshes whose specular map is packed into the alpha of their diffuse map (see
+// TextureCache::acquirePacked())
+const int MATERIAL_SPECULAR_IN_DIFFUSE_ALPHA = -2;
+
+// where a texture ended up in the atlas; layer -1 if it isn't in there
+struct MaterialLayer {
+    int page, layer;
+};
+
+// one GL_TEXTURE_2D_ARRAY, holding textures of the same size and format as its layers
+struct MaterialAtlasPage {
+    unsigned int id;
+    int width, height;
+    GLenum format;          // the compressed format of the layers, 0 if they are uncompressed
+    int channels;           // of uncompressed layers
+    bool gamma;
+    MipStream stream;       // streamed like the textures of the TextureCache, but all layers at once
+    int capacity;           // layers allocated on the GPU
+    vector<shared_ptr<CachedTexture> > layers;  // kept for their mips, which are uploaded again when the page grows
+    int stagedLayers;       // layers in the load in flight, back to back in its staging if any (pages may grow during a load)
+};
+
+// Packs the diffuse and specular maps of models loaded with ModelOptions::materialAtlas into texture arrays,
+// so drawing them needs no texture binds or sampler uniforms of its own: the pages stay bound to
+// MATERIAL_DIFFUSE_UNIT and MATERIAL_SPECULAR_UNIT, and Mesh::Draw hands the shader the layers through
+// MATERIAL_ATTRIBUTE. Textures are resampled to one layer size (see setLayerSize()) when they are decoded, so
+// all textures with the same format share a page; with compression that is usually a single page for everything.
+// With TextureCache streaming on, each page streams its mips like a texture, at the finest mip any of its
+// layers asks for, and gives mips back to the TextureBudget as a whole.
+// Layers are never freed on their own: the atlas keeps its textures until clear(). GL thread only, apart from acquire().
+class MaterialAtlas
+{
+public:
+    static MaterialAtlas &instance()
+    {
+        static MaterialAtlas atlas;
+        return atlas;
+    }
+
+    // the size every texture is resampled to; call it before loading anything. 1024x512 by default.
+    void setLayerSize(int width, int height)
+    {
+        layerWidth = width;
+        layerHeight = height;
+    }
+
+    // acquires a texture from the TextureCache, resampled to the layer size. Any thread.
+    shared_ptr<CachedTexture> acquire(const string &path, bool gamma = false)
+    {
+        return TextureCache::instance().acquire(path, gamma, layerWidth, layerHeight);
+    }
+
+    // the same for a texture with another one packed into it (see TextureCache::acquirePacked()). Any thread.
+    shared_ptr<CachedTexture> acquirePacked(const string &path, const string &packedPath, const string &layout, bool gamma = false)
+    {
+        return TextureCache::instance().acquirePacked(path, packedPath, layout, gamma, layerWidth, layerHeight);
+    }
+
+    // points the shader's material_diffuse and material_specular samplers at the units the pages are bound to
+    void setSamplers(Shader &shader)
+    {
+        shader.use();
+        shader.setInt("material_diffuse", MATERIAL_DIFFUSE_UNIT);
+        shader.setInt("material_specular", MATERIAL_SPECULAR_UNIT);
+    }
+
+    // puts an acquired texture into a page (once; later calls return the same layer)
+    MaterialLayer add(const shared_ptr<CachedTexture> &texture)
+    {
+        MaterialLayer result = { -1, -1 };
+        unordered_map<CachedTexture*, MaterialLayer>::iterator it = byTexture.find(texture.get());
+        if (it != byTexture.end())
+            return it->second;
+        if (texture->stream.levels == 0)
+            return result;
+        if (maxLayers == 0)
+        {
+            GLint layers = 0;
+            glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &layers);
+            maxLayers = std::max(1, std::min(256, int(layers)));
+        }
+
+        int channels = texture->compressed.format != 0 ? 0 : texture->mips.channels;
+        for (unsigned int i = 0; i < pages.size() && result.page < 0; i++)
+        {
+            MaterialAtlasPage &page = *pages[i];
+            if (page.width == texture->width && page.height == texture->height && page.format == texture->compressed.format &&
+                page.channels == channels && page.gamma == texture->gamma && int(page.layers.size()) < maxLayers)
+                result.page = i;
+        }
+        if (result.page < 0)
+        {
+            result.page = static_cast<int>(pages.size());
+            pages.push_back(unique_ptr<MaterialAtlasPage>(new MaterialAtlasPage()));
+            MaterialAtlasPage &page = *pages.back();
+            glGenTextures(1, &page.id);
+            page.width = texture->width;
+            page.height = texture->height;
+            page.format = texture->compressed.format;
+            page.channels = channels;
+            page.gamma = texture->gamma;
+            page.stream.reset(texture->stream.levels, texture->stream.coarseLevel);
+            page.capacity = 0;
+            page.stagedLayers = 0;
+            bindForUpload(result.page);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, page.stream.residentLevel);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, page.stream.levels - 1);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+
+        MaterialAtlasPage &page = *pages[result.page];
+        result.layer = static_cast<int>(page.layers.size());
+        page.layers.push_back(texture);
+        bindForUpload(result.page);
+        if (page.layers.size() > size_t(page.capacity))
+        {
+            // reallocating the levels drops what they held, so every layer goes up again
+            page.capacity = std::min(maxLayers, std::max(4, page.capacity * 2));
+            allocateLevels(page, page.stream.residentLevel, page.stream.levels);
+            for (unsigned int i = 0; i < page.layers.size(); i++)
+                uploadLayer(page, i, page.stream.residentLevel, page.stream.levels);
+        }
+        else
+            uploadLayer(page, result.layer, page.stream.residentLevel, page.stream.levels);
+        glActiveTexture(GL_TEXTURE0);
+        byTexture[texture.get()] = result;
+        return result;
+    }
+
+    // the array texture of a page
+    unsigned int pageTexture(int page) const { return pages[page]->id; }
+
+    // binds a page to a texture unit, unless it is bound there already. Only a bind makes that unit active; when
+    // the page is bound there already the active unit stays what it was.
+    void bind(int page, unsigned int unit)
+    {
+        unsigned int &bound = unit == MATERIAL_SPECULAR_UNIT ? boundSpecular : boundDiffuse;
+        if (bound == pages[page]->id)
+            return;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, pages[page]->id);
+        bound = pages[page]->id;
+    }
+
+    // marks a page as drawn in the current frame, for the TextureBudget
+    void use(int page)
+    {
+        pages[page]->stream.lastUsed = TextureBudget::instance().frame();
+    }
+
+    // like TextureCache::request(), for the layers of a page
+    void request(int page, float texelsAcross)
+    {
+        pages[page]->stream.request(pages[page]->width, texelsAcross);
+    }
+
+    // like TextureCache::update(), for the pages; returns the number of pages that got finer mips
+    unsigned int update(size_t maxUploadBytes = 16 * 1024 * 1024)
+    {
+        unsigned int streamed = 0;
+        size_t uploaded = 0;
+        for (unsigned int i = 0; i < pages.size(); i++)
+        {
+            StreamedPage target(*this, i);
+            pages[i]->stream.update(target, maxUploadBytes, uploaded, streamed);
+        }
+        return streamed;
+    }
+
+    // GPU size of the resident mips of all pages, allocated layers included
+    size_t residentBytes() const
+    {
+        size_t total = 0;
+        for (unsigned int i = 0; i < pages.size(); i++)
+            total += levelBytes(*pages[i], pages[i]->stream.residentLevel, pages[i]->stream.levels);
+        return total;
+    }
+
+    void printStats()
+    {
+        size_t layers = 0;
+        for (unsigned int i = 0; i < pages.size(); i++)
+            layers += pages[i]->layers.size();
+        cout << "MATERIAL_ATLAS:: " << layers << " layers of " << layerWidth << "x" << layerHeight << " in " << pages.size()
+             << " pages (" << residentBytes() / (1024 * 1024) << " MB resident)" << endl;
+    }
+
+    // frees all pages and lets go of their textures. Call it before the GL context goes away.
+    void clear()
+    {
+        for (unsigned int i = 0; i < pages.size(); i++)
+        {
+            StreamedPage target(*this, i);
+            pages[i]->stream.release(target);
+            glDeleteTextures(1, &pages[i]->id);
+        }
+        pages.clear();
+        byTexture.clear();
+        boundDiffuse = boundSpecular = 0;
+    }
+
+private:
+    int layerWidth, layerHeight;
+    int maxLayers;
+    vector<unique_ptr<MaterialAtlasPage> > pages;
+    unordered_map<CachedTexture*, MaterialLayer> byTexture;
+    unsigned int boundDiffuse, boundSpecular;   // what bind() last bound to the units
+
+    MaterialAtlas() : layerWidth(1024), layerHeight(512), maxLayers(0), boundDiffuse(0), boundSpecular(0)
+    {
+        TextureBudget::Source source;
+        source.residentBytes = [this]() { return residentBytes(); };
+        source.candidates = [this](vector<TextureBudget::Candidate> &candidates) { budgetCandidates(candidates); };
+        TextureBudget::instance().addSource(source);
+    }
+
+    // the pages that can drop mips, for the TextureBudget
+    void budgetCandidates(vector<TextureBudget::Candidate> &candidates)
+    {
+        for (unsigned int i = 0; i < pages.size(); i++)
+        {
+            TextureBudget::Candidate candidate;
+            if (pages[i]->layers.empty() || !pages[i]->stream.budgetCandidate(candidate))
+                continue;
+            candidate.demote = [this, i]()
+            {
+                StreamedPage target(*this, i);
+                return pages[i]->stream.demote(target);
+            };
+            candidates.push_back(candidate);
+        }
+    }
+
+    // GPU size of levels [first, last) of a page, allocated layers included
+    static size_t levelBytes(const MaterialAtlasPage &page, int first, int last)
+    {
+        return page.layers.empty() ? 0 : TextureCache::levelBytes(*page.layers[0], first, last) * page.capacity;
+    }
+
+    // the GL side of the MipStream of a page: all of its layers at once
+    struct StreamedPage
+    {
+        MaterialAtlas &atlas;
+        int index;
+
+        StreamedPage(MaterialAtlas &atlas, int index) : atlas(atlas), index(index) {}
+
+        size_t levelBytes(int first, int last) const { return MaterialAtlas::levelBytes(*atlas.pages[index], first, last); }
+
+        // the levels of every layer, which the load takes on as its stagedLayers
+        void levelRanges(int first, int last, vector<pair<const unsigned char*, size_t> > &ranges)
+        {
+            MaterialAtlasPage &page = *atlas.pages[index];
+            ranges.resize(page.layers.size());
+            for (unsigned int layer = 0; layer < page.layers.size(); layer++)
+                TextureCache::levelRange(*page.layers[layer], first, last, ranges[layer].first, ranges[layer].second);
+            page.stagedLayers = static_cast<int>(page.layers.size());
+        }
+
+        // layers added during the load weren't staged, so they go up from client memory
+        void uploadLevels(int first, int last)
+        {
+            MaterialAtlasPage &page = *atlas.pages[index];
+            atlas.bindForUpload(index);
+            atlas.allocateLevels(page, first, last);
+            TextureUploadRing &ring = TextureUploadRing::instance();
+            TextureStaging staged = page.stream.staging;
+            for (unsigned int layer = 0; layer < page.layers.size(); layer++)
+            {
+                bool fromRing = staged.size > 0 && int(layer) < page.stagedLayers;
+                if (fromRing)
+                    ring.bind();
+                atlas.uploadLayer(page, layer, first, last, fromRing ? &staged : nullptr);
+                if (fromRing)
+                    ring.unbind();
+                staged.offset += TextureCache::levelBytes(*page.layers[layer], first, last);
+            }
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, first);
+            glActiveTexture(GL_TEXTURE0);
+        }
+
+        // like TextureCache does it for a texture
+        void dropLevels(int level)
+        {
+            MaterialAtlasPage &page = *atlas.pages[index];
+            atlas.bindForUpload(index);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, level);
+            for (int i = page.stream.residentLevel; i < level; i++)
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, i, GL_RGBA8, 0, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glActiveTexture(GL_TEXTURE0);
+        }
+
+        void residentChanged() {}
+    };
+
+    // binds a page for changing it, through the diffuse unit so bind() stays in the know
+    void bindForUpload(int page)
+    {
+        bind(page, MATERIAL_DIFFUSE_UNIT);
+        glActiveTexture(GL_TEXTURE0 + MATERIAL_DIFFUSE_UNIT);
+    }
+
+    // (re)allocates levels [first, last) of the bound page for all of its layers, without contents
+    void allocateLevels(const MaterialAtlasPage &page, int first, int last)
+    {
+        GLenum internalFormat, format;
+        MipChainFormat(page.channels, page.gamma, internalFormat, format);
+        for (int level = first; level < last; level++)
+        {
+            int width = std::max(1, page.width >> level), height = std::max(1, page.height >> level);
+            if (page.format != 0)
+            {
+                const CompressedImage &image = page.layers[0]->compressed;
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, CompressedImageFormat(image, page.gamma), width, height, page.capacity, 0,
+                                       static_cast<GLsizei>(image.levels[level].size * page.capacity), NULL);
+            }
+            else
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, width, height, page.capacity, 0, format, GL_UNSIGNED_BYTE, NULL);
+        }
+    }
+
+    // uploads levels [first, last) of a layer into the bound page, from staging if they were copied there (with
+    // the ring bound)
+    void uploadLayer(const MaterialAtlasPage &page, int layer, int first, int last, const TextureStaging *staging = nullptr)
+    {
+        const CachedTexture &texture = *page.layers[layer];
+        if (page.format != 0)
+        {
+            GLenum format = CompressedImageFormat(texture.compressed, page.gamma);
+            for (int level = first; level < last; level++)
+            {
+                const CompressedLevel &data = texture.compressed.levels[level];
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, data.width, data.height, 1, format,
+                                          static_cast<GLsizei>(data.size), StagedPointer(data.data, texture.compressed.levels[first].data, staging));
+            }
+            return;
+        }
+        GLenum internalFormat, format;
+        MipChainFormat(page.channels, page.gamma, internalFormat, format);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int level = first; level < last; level++)
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, texture.mips.levels[level].width, texture.mips.levels[level].height, 1,
+                            format, GL_UNSIGNED_BYTE, StagedPointer(texture.mips.data(level), texture.mips.data(first), staging));
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+};
+
+#endif
@@ -6,8 +6,13 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <learnopengl/geometry_registry.h>
+#include <learnopengl/material_atlas.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/vertex_format.h>
 
+#include <algorithm>
+#include <memory>
 #include <string>
 #include <vector>
 using namespace std;
@@ -29,6 +34,19 @@ struct Texture {
     unsigned int id;
     string type;
     string path;
+    shared_ptr<CachedTexture> cached; // keeps the shared GL texture alive (see texture_cache.h)
+    // set for textures packed into the MaterialAtlas; id is then the array texture of their page
+    bool atlas;
+    int page, layer;
+
+    Texture() : id(0), atlas(false), page(-1), layer(-1) {}
+};
+
+// what a mesh keeps in client memory once its buffers are on the GPU
+enum MeshResidency {
+    MESH_KEEP_CPU,              // vertices and indices stay as they are
+    MESH_DISCARD_AFTER_UPLOAD,  // both are freed
+    MESH_KEEP_POSITIONS         // only positions and indices are kept, e.g. for picking
 };
 
 class Mesh {
@@ -37,80 +55,265 @@ public:
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
+    vector<glm::vec3>    positions;	// filled by releaseCPUData(MESH_KEEP_POSITIONS) only
     unsigned int VAO;
+    shared_ptr<GeometryBuffer> geometry;	// GPU buffers, shared with every mesh that has identical data
+    uint64_t geometryKey;
+    // GPU layout, picked per mesh
+    VertexLayout layout;    // see vertex_format.h
+    GLenum indexType;       // GL_UNSIGNED_INT; compact meshes with fewer than 65536 vertices use GL_UNSIGNED_SHORT
+    // bounding sphere of the vertices (around the center of their box), kept when they are released
+    glm::vec3 boundsCenter;
+    float boundsRadius;
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor; with upload set to false no GL calls are made, so the mesh can be built on a loader
+    // thread and uploaded later on the thread that owns the GL context. Only the given attributes are
+    // uploaded, and with compact set in the quantized form of vertex_format.h, which shaders reading normals
+    // or tangents have to decode.
+    // The data is taken over rather than copied: pass it with std::move to keep a single copy around.
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool upload = true,
+         bool compact = false, unsigned int attributes = VERTEX_ALL)
+        : VAO(0), mappedVertices(nullptr), mappedIndices(nullptr), mappedVertexCount(0), mappedIndexCount(0)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices.swap(vertices);
+        this->indices.swap(indices);
+        this->textures.swap(textures);
+        prepare(compact, attributes);
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        if(upload)
+            setupMesh();
+    }
+
+    // a mesh whose vertices and indices stay in memory that mapping keeps mapped (a MeshCache): the full layout
+    // uploads straight from there, and others are packed from there, so the vectors above stay empty.
+    // releaseCPUData() lets go of mapping; a mesh that has to keep its data (MESH_KEEP_CPU) is built from
+    // copies instead. No GL calls are made: call upload() on the thread that owns the GL context.
+    Mesh(shared_ptr<const void> mapping, const Vertex *vertices, unsigned int vertexCount, const unsigned int *indices, unsigned int indexCount,
+         vector<Texture> textures, bool compact = false, unsigned int attributes = VERTEX_ALL)
+        : VAO(0), mapping(mapping), mappedVertices(vertices), mappedIndices(indices), mappedVertexCount(vertexCount), mappedIndexCount(indexCount)
+    {
+        this->textures.swap(textures);
+        prepare(compact, attributes);
+    }
+
+    // meshes are moved, never copied: a copy would duplicate all of the geometry
+    Mesh(const Mesh &) = delete;
+    Mesh &operator=(const Mesh &) = delete;
+    Mesh(Mesh &&) = default;
+    Mesh &operator=(Mesh &&) = default;
+
+    // creates the vertex buffers of a mesh that was constructed without uploading them.
+    void upload()
+    {
+        if(VAO == 0)
+            setupMesh();
+    }
+
+    // frees the client side geometry the residency policy doesn't ask for. Only after upload(), since the
+    // data can't be uploaded again afterwards.
+    void releaseCPUData(MeshResidency residency)
+    {
+        if(residency == MESH_KEEP_CPU)
+            return;
+        if(residency == MESH_KEEP_POSITIONS && positions.empty())
+        {
+            const Vertex *source = vertexSource();
+            positions.reserve(vertexCount());
+            for(unsigned int i = 0; i < vertexCount(); i++)
+                positions.push_back(source[i].Position);
+            if(mapping)
+                indices.assign(mappedIndices, mappedIndices + mappedIndexCount);
+        }
+        vector<Vertex>().swap(vertices);
+        if(residency == MESH_DISCARD_AFTER_UPLOAD)
+            vector<unsigned int>().swap(indices);
+        mapping.reset();
+        mappedVertices = nullptr;
+        mappedIndices = nullptr;
+        mappedVertexCount = mappedIndexCount = 0;
     }
 
     // render the mesh
     void Draw(Shader &shader) 
     {
         // bind appropriate textures
+        if(samplerNames.size() != textures.size())
+            nameSamplers();
+        unsigned int unit       = 0;
+        glm::vec2 layers(-1.0f);
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            // textures in the material atlas need neither a bind nor a sampler uniform of their own: their page
+            // stays bound to a fixed unit and the shader gets the layer through the material attribute
+            if(textures[i].atlas && textures[i].layer >= 0)
+            {
+                bool specular = textures[i].type == "texture_specular";
+                MaterialAtlas::instance().bind(textures[i].page, specular ? MATERIAL_SPECULAR_UNIT : MATERIAL_DIFFUSE_UNIT);
+                MaterialAtlas::instance().use(textures[i].page);
+                layers[specular ? 1 : 0] = float(textures[i].layer);
+                // a packed material is one diffuse layer with the specular map in its alpha
+                if(textures[i].type == "texture_material")
+                    layers[1] = float(MATERIAL_SPECULAR_IN_DIFFUSE_ALPHA);
+                continue;
+            }
+            glActiveTexture(GL_TEXTURE0 + unit); // active proper texture unit before binding
+            // now set the sampler to the correct texture unit
+            shader.setInt(samplerNames[i], unit++);
+            // and finally bind the texture, keeping it off the TextureBudget's list of textures to demote first
+            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            if(textures[i].cached)
+                TextureCache::instance().use(*textures[i].cached);
+        }
+        glVertexAttrib2f(MATERIAL_ATTRIBUTE, layers.x, layers.y);
+        
+        // draw mesh
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, geometry->indexCount, geometry->indexType, 0);
+        glBindVertexArray(0);
+
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    // vertices and indices as they go to the GPU, unless that is exactly the vertices and indices above
+    vector<unsigned char>  packedVertices;
+    vector<unsigned short> shortIndices;
+    // or the vertices and indices in mapped memory, until releaseCPUData() (see the mapped constructor)
+    shared_ptr<const void> mapping;
+    const Vertex           *mappedVertices;
+    const unsigned int     *mappedIndices;
+    unsigned int           mappedVertexCount, mappedIndexCount;
+    // the sampler uniform of each texture (empty for atlas textures), put together by the first Draw
+    vector<string>         samplerNames;
+
+    void nameSamplers()
+    {
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
+        unsigned int materialNr = 1;
+        samplerNames.assign(textures.size(), string());
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
+            if(textures[i].atlas && textures[i].layer >= 0)
+                continue;
             // retrieve texture number (the N in diffuse_textureN)
             string number;
-            string name = textures[i].type;
+            const string &name = textures[i].type;
             if(name == "texture_diffuse")
                 number = std::to_string(diffuseNr++);
             else if(name == "texture_specular")
                 number = std::to_string(specularNr++); // transfer unsigned int to stream
             else if(name == "texture_normal")
                 number = std::to_string(normalNr++); // transfer unsigned int to stream
-             else if(name == "texture_height")
+            else if(name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to stream
+            else if(name == "texture_material")
+                number = std::to_string(materialNr++); // diffuse and specular map in one texture, so one bind for both
+            samplerNames[i] = name + number;
+        }
+    }
 
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+    // the vertices and indices the mesh was built from, in the vectors or mapped
+    const Vertex *vertexSource() const { return mapping ? mappedVertices : vertices.data(); }
+    unsigned int vertexCount() const { return mapping ? mappedVertexCount : static_cast<unsigned int>(vertices.size()); }
+    const unsigned int *indexSource() const { return mapping ? mappedIndices : indices.data(); }
+    unsigned int indexCount() const { return mapping ? mappedIndexCount : static_cast<unsigned int>(indices.size()); }
+
+    void prepare(bool compact, unsigned int attributes)
+    {
+        chooseLayout(compact, attributes);
+        computeBounds();
+        // hash the data up front, so uploading only has to look it up in the geometry registry
+        uint32_t layoutKey = layout.key();
+        geometryKey = GeometryKey(vertexData(), vertexBytes(), indexData(), indexBytes());
+        geometryKey = hashBytes(&layoutKey, sizeof(layoutKey), geometryKey);
+    }
+
+    void chooseLayout(bool compact, unsigned int attributes)
+    {
+        const Vertex *source = vertexSource();
+        GLenum texCoordType = GL_FLOAT;
+        if(compact)
+        {
+            texCoordType = GL_UNSIGNED_SHORT;
+            for(unsigned int i = 0; i < vertexCount() && texCoordType == GL_UNSIGNED_SHORT; i++)
+                if(!TexCoordsFitUnorm16(source[i].TexCoords))
+                    texCoordType = GL_HALF_FLOAT;
         }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        layout = VertexLayout(attributes | VERTEX_POSITION, compact, texCoordType);
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        if(packed())
+        {
+            packedVertices.resize(size_t(vertexCount()) * layout.stride);
+            for(unsigned int i = 0; i < vertexCount(); i++)
+            {
+                const Vertex &v = source[i];
+                layout.pack(v.Position, v.Normal, v.TexCoords, v.Tangent, v.Bitangent, &packedVertices[i * layout.stride]);
+            }
+        }
+
+        indexType = GL_UNSIGNED_INT;
+        if(compact && vertexCount() < 65536)
+        {
+            indexType = GL_UNSIGNED_SHORT;
+            shortIndices.assign(indexSource(), indexSource() + indexCount());
+        }
     }
 
-private:
-    // render data 
-    unsigned int VBO, EBO;
+    void computeBounds()
+    {
+        const Vertex *source = vertexSource();
+        boundsCenter = glm::vec3(0.0f);
+        boundsRadius = 0.0f;
+        if(vertexCount() == 0)
+            return;
+        glm::vec3 lower = source[0].Position, upper = source[0].Position;
+        for(unsigned int i = 1; i < vertexCount(); i++)
+        {
+            lower = glm::min(lower, source[i].Position);
+            upper = glm::max(upper, source[i].Position);
+        }
+        boundsCenter = (lower + upper) * 0.5f;
+        for(unsigned int i = 0; i < vertexCount(); i++)
+            boundsRadius = std::max(boundsRadius, glm::length(source[i].Position - boundsCenter));
+    }
+
+    // the full layout with every attribute is the Vertex struct itself, anything else needs a packed copy
+    bool packed() const { return layout.compact || layout.attributes != VERTEX_ALL; }
 
-    // initializes all the buffer objects/arrays
+    // the bytes that go to the GPU
+    const void *vertexData() const { return !packed() ? (const void*)vertexSource() : (const void*)packedVertices.data(); }
+    size_t vertexBytes() const { return size_t(vertexCount()) * layout.stride; }
+    const void *indexData() const { return indexType == GL_UNSIGNED_SHORT ? (const void*)shortIndices.data() : (const void*)indexSource(); }
+    size_t indexBytes() const { return indexType == GL_UNSIGNED_SHORT ? shortIndices.size() * sizeof(unsigned short) : size_t(indexCount()) * sizeof(unsigned int); }
+
+    // initializes all the buffer objects/arrays, or picks up the ones of an identical mesh
     void setupMesh()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        geometry = GeometryRegistry::instance().acquire(geometryKey, vertexData(), vertexBytes(), indexData(), indexBytes(),
+            indexCount(), indexType, [this]() { setupAttributes(); });
+        VAO = geometry->VAO;
+        // the packed copies only exist for the upload
+        vector<unsigned char>().swap(packedVertices);
+        vector<unsigned short>().swap(shortIndices);
+    }
 
+    // sets the vertex attribute pointers of a freshly uploaded VAO
+    void setupAttributes() const
+    {
+        if(packed())
+        {
+            // same locations as below, minus the attributes the mesh doesn't upload (see vertex_format.h)
+            layout.setupAttributes();
+            return;
+        }
         // set the vertex attribute pointers
         // vertex Positions
         glEnableVertexAttribArray(0);	
@@ -127,8 +330,6 @@ private:
         // vertex bitangent
         glEnableVertexAttribArray(4);
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-        glBindVertexArray(0);
     }
 };
 #endif
@@ -0,0 +1,399 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/hash.h>
+#include <learnopengl/mapped_file.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Binary cache of an imported model, written next to the source file the first time it is imported
+// and memory mapped on every run after that. Layout (all offsets are from the start of the file):
+//
+//   MeshCacheHeader
+//   MeshCacheEntry[meshCount]
+//   per mesh: texture references (type/path pairs as length-prefixed strings),
+//             interleaved Vertex data (16 byte aligned), 32-bit indices
+//   MeshCacheDependency[dependencyCount], then their paths as length-prefixed strings
+//
+// A cache is only used if its version, import flags, model options and Vertex size match, and if the
+// source file and the files it depends on (the MTL files of an OBJ) are unchanged: same size and mtime, or
+// failing that the same content hash. After a match by hash the new stamps are written back, so the next
+// run doesn't hash again.
+const uint32_t MESH_CACHE_MAGIC   = 0x48534D4C; // "LMSH"
+const uint32_t MESH_CACHE_VERSION = 4;
+// the size of a dependency that didn't exist when the cache was written
+const uint64_t MESH_CACHE_MISSING = ~uint64_t(0);
+
+struct MeshCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t importFlags;
+    uint32_t meshCount;
+    uint32_t vertexSize;
+    uint32_t optionsKey;    // ModelOptions::cacheKey() of the processing done after the import
+    uint64_t sourceSize;
+    int64_t  sourceMtime;
+    uint64_t sourceHash;
+    uint64_t dependencyOffset;
+    uint32_t dependencyCount;
+    uint32_t reserved;
+};
+
+// a file the cached meshes were made from besides the source file
+struct MeshCacheDependency
+{
+    uint64_t size;          // MESH_CACHE_MISSING if there was no such file
+    int64_t  mtime;
+    uint64_t hash;
+};
+
+struct MeshCacheEntry
+{
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t textureOffset;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t textureCount;
+    uint32_t reserved;
+};
+
+class MeshCache
+{
+public:
+    MeshCache() : header(nullptr), entries(nullptr) {}
+
+    // the cache file that belongs to a given model file.
+    static string pathFor(const string &sourcePath)
+    {
+        return sourcePath + ".meshcache";
+    }
+
+    // maps the cache of sourcePath and checks it is still valid for the source file, import flags and options.
+    bool open(const string &sourcePath, unsigned int importFlags, unsigned int optionsKey)
+    {
+        bool stale = false;
+        if (!check(sourcePath, importFlags, optionsKey, stale))
+            return false;
+        if (!stale)
+            return true;
+        // matched by content only: record the new stamps (if the cache can be written to), then map it again
+        file.close();
+        updateStamps(sourcePath);
+        return check(sourcePath, importFlags, optionsKey, stale);
+    }
+
+    unsigned int meshCount() const { return header ? header->meshCount : 0; }
+
+    const Vertex *vertices(unsigned int mesh) const
+    {
+        return reinterpret_cast<const Vertex*>(file.data() + entries[mesh].vertexOffset);
+    }
+    unsigned int vertexCount(unsigned int mesh) const { return entries[mesh].vertexCount; }
+
+    const unsigned int *indices(unsigned int mesh) const
+    {
+        return reinterpret_cast<const unsigned int*>(file.data() + entries[mesh].indexOffset);
+    }
+    unsigned int indexCount(unsigned int mesh) const { return entries[mesh].indexCount; }
+
+    // the texture references of a mesh; the ids are left at 0 since they belong to the GL context, not the cache.
+    vector<Texture> textures(unsigned int mesh) const
+    {
+        vector<Texture> result;
+        const char *cursor = file.data() + entries[mesh].textureOffset;
+        const char *end = file.data() + file.size();
+        for (unsigned int i = 0; i < entries[mesh].textureCount; i++)
+        {
+            Texture texture;
+            texture.id = 0;
+            if (!readString(cursor, end, texture.type) || !readString(cursor, end, texture.path))
+                break;
+            result.push_back(texture);
+        }
+        return result;
+    }
+
+    // serializes the processed meshes of sourcePath. The file is written under a temporary name and
+    // renamed into place, so a crash halfway through never leaves a truncated cache behind.
+    static bool write(const string &sourcePath, unsigned int importFlags, unsigned int optionsKey, const vector<Mesh> &meshes)
+    {
+        FileStamp stamp;
+        MeshCacheHeader h;
+        memset(&h, 0, sizeof(h));
+        if (!FileStamp::query(sourcePath, stamp) || !hashFile(sourcePath, h.sourceHash))
+            return false;
+        h.magic = MESH_CACHE_MAGIC;
+        h.version = MESH_CACHE_VERSION;
+        h.importFlags = importFlags;
+        h.optionsKey = optionsKey;
+        h.meshCount = static_cast<uint32_t>(meshes.size());
+        h.vertexSize = sizeof(Vertex);
+        h.sourceSize = stamp.size;
+        h.sourceMtime = stamp.mtime;
+        vector<string> dependencies = dependenciesOf(sourcePath);
+        vector<MeshCacheDependency> d(dependencies.size());
+        for (unsigned int i = 0; i < dependencies.size(); i++)
+            describe(dependencies[i], d[i]);
+
+        vector<char> buffer(sizeof(MeshCacheHeader) + meshes.size() * sizeof(MeshCacheEntry), 0);
+        vector<MeshCacheEntry> e(meshes.size());
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            const Mesh &mesh = meshes[i];
+            memset(&e[i], 0, sizeof(MeshCacheEntry));
+            e[i].textureOffset = buffer.size();
+            e[i].textureCount = static_cast<uint32_t>(mesh.textures.size());
+            for (unsigned int j = 0; j < mesh.textures.size(); j++)
+            {
+                writeString(buffer, mesh.textures[j].type);
+                writeString(buffer, mesh.textures[j].path);
+            }
+            buffer.resize((buffer.size() + 15) & ~size_t(15), 0);
+            e[i].vertexOffset = buffer.size();
+            e[i].vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+            append(buffer, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+            e[i].indexOffset = buffer.size();
+            e[i].indexCount = static_cast<uint32_t>(mesh.indices.size());
+            append(buffer, mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+        }
+        buffer.resize((buffer.size() + 7) & ~size_t(7), 0);
+        h.dependencyOffset = buffer.size();
+        h.dependencyCount = static_cast<uint32_t>(d.size());
+        append(buffer, d.data(), d.size() * sizeof(MeshCacheDependency));
+        for (unsigned int i = 0; i < dependencies.size(); i++)
+            writeString(buffer, dependencies[i]);
+        memcpy(&buffer[0], &h, sizeof(h));
+        if (!e.empty())
+            memcpy(&buffer[sizeof(h)], e.data(), e.size() * sizeof(MeshCacheEntry));
+
+        string target = pathFor(sourcePath);
+        string temporary = target + ".tmp";
+        {
+            ofstream out(temporary.c_str(), ios::binary | ios::trunc);
+            if (!out)
+                return false;
+            out.write(buffer.data(), buffer.size());
+            if (!out)
+                return false;
+        }
+        remove(target.c_str()); // rename() won't replace an existing file on Windows
+        return rename(temporary.c_str(), target.c_str()) == 0;
+    }
+
+private:
+    MappedFile file;
+    const MeshCacheHeader *header;
+    const MeshCacheEntry *entries;
+
+    // maps the cache and validates it; stale is set if the source or a dependency only matched by content
+    bool check(const string &sourcePath, unsigned int importFlags, unsigned int optionsKey, bool &stale)
+    {
+        header = nullptr;
+        entries = nullptr;
+        if (!file.open(pathFor(sourcePath)) || file.size() < sizeof(MeshCacheHeader))
+            return false;
+
+        const MeshCacheHeader *h = reinterpret_cast<const MeshCacheHeader*>(file.data());
+        if (h->magic != MESH_CACHE_MAGIC || h->version != MESH_CACHE_VERSION || h->importFlags != importFlags || h->optionsKey != optionsKey || h->vertexSize != sizeof(Vertex))
+            return false;
+        if (file.size() < sizeof(MeshCacheHeader) + uint64_t(h->meshCount) * sizeof(MeshCacheEntry))
+            return false;
+        if (h->dependencyOffset > file.size() || (file.size() - h->dependencyOffset) / sizeof(MeshCacheDependency) < h->dependencyCount)
+            return false;
+
+        // a touched but otherwise identical source (e.g. after a fresh checkout) still matches by content
+        MeshCacheDependency source = { h->sourceSize, h->sourceMtime, h->sourceHash };
+        if (!unchanged(sourcePath, source, stale))
+            return false;
+        // and so do its MTL files, which name the textures
+        vector<string> paths;
+        if (!dependencyPaths(h, paths))
+            return false;
+        const MeshCacheDependency *d = reinterpret_cast<const MeshCacheDependency*>(file.data() + h->dependencyOffset);
+        for (unsigned int i = 0; i < paths.size(); i++)
+            if (!unchanged(paths[i], d[i], stale))
+                return false;
+
+        const MeshCacheEntry *e = reinterpret_cast<const MeshCacheEntry*>(file.data() + sizeof(MeshCacheHeader));
+        for (unsigned int i = 0; i < h->meshCount; i++)
+        {
+            if (e[i].vertexOffset + uint64_t(e[i].vertexCount) * sizeof(Vertex) > file.size() ||
+                e[i].indexOffset + uint64_t(e[i].indexCount) * sizeof(unsigned int) > file.size() ||
+                e[i].textureOffset > file.size())
+                return false;
+        }
+        header = h;
+        entries = e;
+        return true;
+    }
+
+    // whether the file at path is still the one recorded, by stamp or else by content (setting stale)
+    static bool unchanged(const string &path, const MeshCacheDependency &recorded, bool &stale)
+    {
+        MeshCacheDependency current;
+        describe(path, current, false);
+        if (current.size == MESH_CACHE_MISSING || recorded.size == MESH_CACHE_MISSING)
+            return current.size == recorded.size;
+        if (current.size == recorded.size && current.mtime == recorded.mtime)
+            return true;
+        uint64_t hash;
+        if (!hashFile(path, hash) || hash != recorded.hash)
+            return false;
+        stale = true;
+        return true;
+    }
+
+    // the stamp of the file at path, and its hash if withHash is set
+    static void describe(const string &path, MeshCacheDependency &dependency, bool withHash = true)
+    {
+        FileStamp stamp;
+        dependency.size = MESH_CACHE_MISSING;
+        dependency.mtime = 0;
+        dependency.hash = 0;
+        if (!FileStamp::query(path, stamp) || (withHash && !hashFile(path, dependency.hash)))
+            return;
+        dependency.size = stamp.size;
+        dependency.mtime = stamp.mtime;
+    }
+
+    bool dependencyPaths(const MeshCacheHeader *h, vector<string> &paths) const
+    {
+        const char *cursor = file.data() + h->dependencyOffset + h->dependencyCount * sizeof(MeshCacheDependency);
+        const char *end = file.data() + file.size();
+        paths.resize(h->dependencyCount);
+        for (unsigned int i = 0; i < h->dependencyCount; i++)
+            if (!readString(cursor, end, paths[i]))
+                return false;
+        return true;
+    }
+
+    // rewrites the stamps of the (closed) cache of sourcePath with those of the files as they are now. The
+    // contents already matched, so only the header and the dependency records change.
+    static bool updateStamps(const string &sourcePath)
+    {
+        fstream out(pathFor(sourcePath).c_str(), ios::in | ios::out | ios::binary);
+        MeshCacheHeader h;
+        if (!out.read(reinterpret_cast<char*>(&h), sizeof(h)))
+            return false;
+        FileStamp stamp;
+        if (!FileStamp::query(sourcePath, stamp))
+            return false;
+        h.sourceSize = stamp.size;
+        h.sourceMtime = stamp.mtime;
+        vector<MeshCacheDependency> d(h.dependencyCount);
+        out.seekg(h.dependencyOffset);
+        if (!d.empty() && !out.read(reinterpret_cast<char*>(&d[0]), d.size() * sizeof(MeshCacheDependency)))
+            return false;
+        // the paths follow the records: read them back one at a time
+        for (unsigned int i = 0; i < d.size(); i++)
+        {
+            uint32_t length;
+            if (!out.read(reinterpret_cast<char*>(&length), sizeof(length)))
+                return false;
+            string path(length, '\0');
+            if (length > 0 && !out.read(&path[0], length))
+                return false;
+            if (FileStamp::query(path, stamp))
+            {
+                d[i].size = stamp.size;
+                d[i].mtime = stamp.mtime;
+            }
+        }
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.seekp(h.dependencyOffset);
+        if (!d.empty())
+            out.write(reinterpret_cast<const char*>(&d[0]), d.size() * sizeof(MeshCacheDependency));
+        return bool(out);
+    }
+
+    // the files besides sourcePath its meshes are made from: the MTL files an OBJ names in mtllib lines,
+    // relative to its directory, as the importers read them
+    static vector<string> dependenciesOf(const string &sourcePath)
+    {
+        vector<string> result;
+        size_t dot = sourcePath.find_last_of('.');
+        string extension = dot == string::npos ? "" : sourcePath.substr(dot + 1);
+        for (unsigned int i = 0; i < extension.size(); i++)
+            extension[i] = static_cast<char>(tolower(extension[i]));
+        MappedFile source;
+        if (extension != "obj" || !source.open(sourcePath))
+            return result;
+        string directory = sourcePath.substr(0, sourcePath.find_last_of('/') + 1);
+        const char *c = source.data(), *end = source.data() + source.size();
+        while (c < end)
+        {
+            const char *lineEnd = static_cast<const char*>(memchr(c, '\n', end - c));
+            if (!lineEnd)
+                lineEnd = end;
+            const char *p = c;
+            c = lineEnd + (lineEnd < end ? 1 : 0);
+            while (p < lineEnd && (*p == ' ' || *p == '\t'))
+                p++;
+            if (lineEnd - p < 7 || memcmp(p, "mtllib", 6) != 0 || (p[6] != ' ' && p[6] != '\t'))
+                continue;
+            p += 7;
+            const char *last = lineEnd;
+            while (p < last && (*p == ' ' || *p == '\t'))
+                p++;
+            while (last > p && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r'))
+                last--;
+            string path = directory + string(p, last);
+            if (p < last && find(result.begin(), result.end(), path) == result.end())
+                result.push_back(path);
+        }
+        return result;
+    }
+
+    static bool hashFile(const string &path, uint64_t &hash)
+    {
+        MappedFile source;
+        if (!source.open(path))
+            return false;
+        hash = hashBytes(source.data(), source.size());
+        return true;
+    }
+
+    static void append(vector<char> &buffer, const void *data, size_t size)
+    {
+        if (size == 0)
+            return;
+        size_t offset = buffer.size();
+        buffer.resize(offset + size);
+        memcpy(&buffer[offset], data, size);
+    }
+
+    static void writeString(vector<char> &buffer, const string &str)
+    {
+        uint32_t length = static_cast<uint32_t>(str.size());
+        append(buffer, &length, sizeof(length));
+        append(buffer, str.data(), str.size());
+    }
+
+    static bool readString(const char *&cursor, const char *end, string &str)
+    {
+        uint32_t length;
+        if (end - cursor < (ptrdiff_t)sizeof(length))
+            return false;
+        memcpy(&length, cursor, sizeof(length));
+        cursor += sizeof(length);
+        if (end - cursor < (ptrdiff_t)length)
+            return false;
+        str.assign(cursor, length);
+        cursor += length;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,262 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+using namespace std;
+
+// Import-time index/vertex reordering for triangle lists, after Sander, Nehab and Barczak,
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" (SIGGRAPH 2007):
+//   1. OptimizeVertexCache - Tipsify: reorders triangles for a FIFO post-transform cache
+//   2. OptimizeOverdraw    - sorts the clusters found by Tipsify front-to-back in a view independent way
+//   3. OptimizeVertexFetch - renumbers vertices in first-use order for linear vertex fetches
+// Everything is deterministic (no hashing, no threads), so the output can be cached on disk.
+
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+// post-transform cache efficiency of an index buffer, simulated with a FIFO cache.
+struct VertexCacheStats
+{
+    float acmr; // average cache miss ratio: transformed vertices per triangle (0.5 is ideal for large grids, 3 is worst)
+    float atvr; // average transform to vertex ratio: transformed vertices per unique vertex (1 is ideal)
+};
+
+inline VertexCacheStats AnalyzeVertexCache(const vector<unsigned int> &indices, size_t vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+    VertexCacheStats stats = { 0.0f, 0.0f };
+    if (indices.empty() || vertexCount == 0)
+        return stats;
+    // a vertex is in the cache if it was pushed within the last cacheSize misses
+    vector<size_t> pushedAt(vertexCount, 0);
+    size_t misses = 0;
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        unsigned int v = indices[i];
+        if (pushedAt[v] == 0 || misses - pushedAt[v] + 1 > cacheSize)
+        {
+            misses++;
+            pushedAt[v] = misses;
+        }
+    }
+    stats.acmr = float(misses) / float(indices.size() / 3);
+    stats.atvr = float(misses) / float(vertexCount);
+    return stats;
+}
+
+// Tipsify. Returns the reordered indices; clusters receives the triangle offsets at which the
+// fanning order had to jump to a vertex far away, which are the natural cluster boundaries for
+// OptimizeOverdraw.
+inline vector<unsigned int> OptimizeVertexCache(const vector<unsigned int> &indices, size_t vertexCount,
+                                                vector<size_t> *clusters = nullptr, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+    size_t triangleCount = indices.size() / 3;
+    vector<unsigned int> result;
+    result.reserve(triangleCount * 3);
+    if (clusters)
+        clusters->assign(1, 0);
+    if (triangleCount == 0)
+        return result;
+
+    // vertex -> triangle adjacency, as offsets into one flat array
+    vector<unsigned int> liveTriangles(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        liveTriangles[indices[i]]++;
+    vector<size_t> adjacencyOffset(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+    vector<unsigned int> adjacency(adjacencyOffset[vertexCount]);
+    {
+        vector<size_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+    }
+
+    vector<size_t> cacheTime(vertexCount, 0);
+    vector<bool> emitted(triangleCount, false);
+    vector<unsigned int> deadEnds;
+    vector<unsigned int> candidates;
+    size_t time = cacheSize + 1;
+    size_t cursor = 0;
+    long fanning = 0;
+
+    while (fanning >= 0)
+    {
+        // emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (size_t a = adjacencyOffset[fanning]; a < adjacencyOffset[fanning + 1]; a++)
+        {
+            unsigned int t = adjacency[a];
+            if (emitted[t])
+                continue;
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                unsigned int v = indices[t * 3 + k];
+                result.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+            emitted[t] = true;
+        }
+
+        // next fanning vertex: the candidate that stays in the cache longest while it still has triangles
+        long next = -1;
+        size_t bestPriority = 0;
+        bool found = false;
+        for (size_t c = 0; c < candidates.size(); c++)
+        {
+            unsigned int v = candidates[c];
+            if (liveTriangles[v] == 0)
+                continue;
+            size_t priority = 0;
+            if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                priority = time - cacheTime[v];
+            if (!found || priority > bestPriority)
+            {
+                found = true;
+                bestPriority = priority;
+                next = v;
+            }
+        }
+        if (next < 0)
+        {
+            // dead end: go back to a recently used vertex, or else the next one in input order
+            while (!deadEnds.empty() && next < 0)
+            {
+                unsigned int v = deadEnds.back();
+                deadEnds.pop_back();
+                if (liveTriangles[v] > 0)
+                    next = v;
+            }
+            while (next < 0 && cursor < triangleCount * 3)
+            {
+                unsigned int v = indices[cursor++];
+                if (liveTriangles[v] > 0)
+                    next = v;
+            }
+            if (next >= 0 && clusters && result.size() / 3 > clusters->back())
+                clusters->push_back(result.size() / 3);
+        }
+        fanning = next;
+    }
+    return result;
+}
+
+// Sorts the clusters of a cache optimized index buffer so that triangles facing outward, away from the
+// mesh centroid, come first; on convex-ish meshes like our planets that approximates front-to-back order
+// from every direction. Triangle order inside a cluster (and with it cache efficiency) is kept.
+inline vector<unsigned int> OptimizeOverdraw(const vector<unsigned int> &indices, const vector<size_t> &clusters,
+                                             const glm::vec3 *positions, size_t positionStride)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (clusters.size() < 2)
+        return indices;
+
+    const char *base = reinterpret_cast<const char*>(positions);
+    auto position = [base, positionStride](unsigned int i) -> const glm::vec3& {
+        return *reinterpret_cast<const glm::vec3*>(base + size_t(i) * positionStride);
+    };
+
+    // area weighted mesh centroid
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        glm::vec3 a = position(indices[t * 3]), b = position(indices[t * 3 + 1]), c = position(indices[t * 3 + 2]);
+        float area = glm::length(glm::cross(b - a, c - a));
+        meshCentroid += (a + b + c) * (area / 3.0f);
+        meshArea += area;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    struct Cluster
+    {
+        size_t begin, end;
+        float sortKey;
+        bool operator<(const Cluster &other) const
+        {
+            // descending, ties in original order to stay deterministic
+            return sortKey != other.sortKey ? sortKey > other.sortKey : begin < other.begin;
+        }
+    };
+    vector<Cluster> sorted;
+    for (size_t c = 0; c < clusters.size(); c++)
+    {
+        Cluster cluster;
+        cluster.begin = clusters[c];
+        cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = cluster.begin; t < cluster.end; t++)
+        {
+            glm::vec3 a = position(indices[t * 3]), b = position(indices[t * 3 + 1]), c = position(indices[t * 3 + 2]);
+            glm::vec3 n = glm::cross(b - a, c - a); // length is twice the area
+            float triangleArea = glm::length(n);
+            centroid += (a + b + c) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+        if (area > 0.0f)
+            centroid /= area;
+        float normalLength = glm::length(normal);
+        cluster.sortKey = normalLength > 0.0f ? glm::dot(centroid - meshCentroid, normal / normalLength) : 0.0f;
+        sorted.push_back(cluster);
+    }
+    stable_sort(sorted.begin(), sorted.end());
+
+    vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (size_t c = 0; c < sorted.size(); c++)
+        result.insert(result.end(), indices.begin() + sorted[c].begin * 3, indices.begin() + sorted[c].end * 3);
+    return result;
+}
+
+// renumbers vertices in the order the index buffer first references them (unreferenced vertices are
+// dropped) and rewrites indices and vertices accordingly.
+template <typename V>
+void OptimizeVertexFetch(vector<V> &vertices, vector<unsigned int> &indices)
+{
+    const unsigned int unused = ~0u;
+    vector<unsigned int> remap(vertices.size(), unused);
+    vector<V> reordered;
+    reordered.reserve(vertices.size());
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        unsigned int &target = remap[indices[i]];
+        if (target == unused)
+        {
+            target = static_cast<unsigned int>(reordered.size());
+            reordered.push_back(vertices[indices[i]]);
+        }
+        indices[i] = target;
+    }
+    vertices.swap(reordered);
+}
+
+// runs all three passes on a mesh whose vertices have a glm::vec3 Position member; returns the vertex
+// cache statistics before (first) and after (second) optimizing.
+template <typename V>
+pair<VertexCacheStats, VertexCacheStats> OptimizeMesh(vector<V> &vertices, vector<unsigned int> &indices)
+{
+    pair<VertexCacheStats, VertexCacheStats> stats;
+    stats.first = AnalyzeVertexCache(indices, vertices.size());
+    if (vertices.empty() || indices.size() < 3)
+    {
+        stats.second = stats.first;
+        return stats;
+    }
+    vector<size_t> clusters;
+    indices = OptimizeVertexCache(indices, vertices.size(), &clusters);
+    indices = OptimizeOverdraw(indices, clusters, &vertices[0].Position, sizeof(V));
+    OptimizeVertexFetch(vertices, indices);
+    stats.second = AnalyzeVertexCache(indices, vertices.size());
+    return stats;
+}
+
+#endif
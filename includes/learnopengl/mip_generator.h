@@ -0,0 +1,491 @@
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include <image_helper.h>
+
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <vector>
+using namespace std;
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_GENERATOR_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Builds the whole mip chain of a texture on the CPU, so it can be cached along with the texture and the
+// GPU never has to run glGenerateMipmap (whose filter is up to the driver). Each level is filtered from the
+// one above it:
+//   - MIP_FILTER_BOX averages 2x2 pixels; on linear data that is mipmap_image from image_helper.h, 16 bytes at
+//     a time with SSE2 (see MipHalveRows())
+//   - MIP_FILTER_KAISER and MIP_FILTER_LANCZOS are windowed sinc filters with a radius of 3 output pixels,
+//     which keep distant detail sharper without the aliasing of point sampling
+// sRGB images are filtered in linear space (alpha always is linear), otherwise averaging darkens them.
+// The windowed filters work on 4 floats per pixel (SSE2 where available) and every level is split into
+// bands of rows that are filtered in parallel on ThreadPool::shared(). Edges are clamped.
+
+enum MipFilter {
+    MIP_FILTER_BOX,
+    MIP_FILTER_KAISER,
+    MIP_FILTER_LANCZOS
+};
+
+const int MIP_BAND_ROWS = 16;   // output rows per parallel task
+
+struct MipLevel {
+    int width, height;
+    size_t offset;  // into MipChain::pixels
+};
+
+// 8-bit pixels of every level, base level first, down to 1x1.
+struct MipChain {
+    int channels;
+    vector<MipLevel> levels;
+    vector<unsigned char> pixels;
+
+    MipChain() : channels(0) {}
+
+    const unsigned char *data(unsigned int level) const { return pixels.data() + levels[level].offset; }
+    size_t bytes() const { return pixels.size(); }
+
+    void clear()
+    {
+        channels = 0;
+        levels.clear();
+        vector<unsigned char>().swap(pixels);
+    }
+};
+
+// ---------------------------------------------------------------------------------------------------------
+// filter kernels and sRGB conversion
+// ---------------------------------------------------------------------------------------------------------
+
+inline float MipSinc(float x)
+{
+    if (fabs(x) < 1e-6f)
+        return 1.0f;
+    x *= 3.14159265358979f;
+    return sin(x) / x;
+}
+
+// zeroth order modified Bessel function of the first kind, for the Kaiser window
+inline float MipBesselI0(float x)
+{
+    float sum = 1.0f, term = 1.0f;
+    for (int k = 1; k < 32 && term > sum * 1e-8f; k++)
+    {
+        float t = x / (2.0f * k);
+        term *= t * t;
+        sum += term;
+    }
+    return sum;
+}
+
+inline float MipFilterRadius(MipFilter filter)
+{
+    return filter == MIP_FILTER_BOX ? 0.5f : 3.0f;
+}
+
+// the weight of a source sample x output pixels away from the output pixel's center
+inline float MipFilterWeight(MipFilter filter, float x)
+{
+    float radius = MipFilterRadius(filter);
+    x = fabs(x);
+    if (filter == MIP_FILTER_BOX)
+        return x <= radius ? 1.0f : 0.0f;
+    if (x >= radius)
+        return 0.0f;
+    if (filter == MIP_FILTER_LANCZOS)
+        return MipSinc(x) * MipSinc(x / radius);
+    // Kaiser window with alpha 4
+    const float alpha = 4.0f;
+    float t = x / radius;
+    return MipSinc(x) * MipBesselI0(alpha * sqrt(1.0f - t * t)) / MipBesselI0(alpha);
+}
+
+inline const float *SRGBToLinearTable()
+{
+    static const vector<float> table = []() {
+        vector<float> values(256);
+        for (int i = 0; i < 256; i++)
+        {
+            float c = i / 255.0f;
+            values[i] = c <= 0.04045f ? c / 12.92f : pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return values;
+    }();
+    return table.data();
+}
+
+const int MIP_LINEAR_TO_SRGB_STEPS = 16384;
+
+// 8-bit sRGB value of linear values in [0, 1], indexed by value * (MIP_LINEAR_TO_SRGB_STEPS - 1)
+inline const unsigned char *LinearToSRGBTable()
+{
+    static const vector<unsigned char> table = []() {
+        vector<unsigned char> values(MIP_LINEAR_TO_SRGB_STEPS);
+        for (int i = 0; i < MIP_LINEAR_TO_SRGB_STEPS; i++)
+        {
+            float c = i / float(MIP_LINEAR_TO_SRGB_STEPS - 1);
+            float s = c <= 0.0031308f ? c * 12.92f : 1.055f * pow(c, 1.0f / 2.4f) - 0.055f;
+            values[i] = static_cast<unsigned char>(s * 255.0f + 0.5f);
+        }
+        return values;
+    }();
+    return table.data();
+}
+
+// ---------------------------------------------------------------------------------------------------------
+// the windowed filters, on RGBA floats
+// ---------------------------------------------------------------------------------------------------------
+
+// which source samples make up an output pixel along one axis, and with what weight
+struct MipTaps {
+    vector<int> first;      // per output pixel: first entry in samples/weights
+    vector<int> samples;
+    vector<float> weights;
+};
+
+inline void MipComputeTaps(MipFilter filter, int source, int target, MipTaps &taps)
+{
+    // the filter is as wide as an output pixel when shrinking, and as a source pixel when enlarging
+    float step = float(source) / float(target), scale = std::max(step, 1.0f);
+    float support = MipFilterRadius(filter) * scale;
+    taps.first.assign(1, 0);
+    taps.samples.clear();
+    taps.weights.clear();
+    for (int i = 0; i < target; i++)
+    {
+        float center = (i + 0.5f) * step;
+        int begin = static_cast<int>(floor(center - support)), end = static_cast<int>(ceil(center + support));
+        size_t start = taps.weights.size();
+        float total = 0.0f;
+        for (int j = begin; j <= end; j++)
+        {
+            float weight = MipFilterWeight(filter, ((j + 0.5f) - center) / scale);
+            if (weight == 0.0f)
+                continue;
+            taps.samples.push_back(std::min(std::max(j, 0), source - 1));
+            taps.weights.push_back(weight);
+            total += weight;
+        }
+        for (size_t k = start; k < taps.weights.size(); k++)
+            taps.weights[k] /= total;
+        taps.first.push_back(static_cast<int>(taps.weights.size()));
+    }
+}
+
+// out[0..count) += in[0..count) * weight, count a multiple of 4
+inline void MipAccumulate(float *out, const float *in, float weight, size_t count)
+{
+#ifdef MIP_GENERATOR_SSE2
+    __m128 w = _mm_set1_ps(weight);
+    for (size_t i = 0; i < count; i += 4)
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_loadu_ps(in + i), w)));
+#else
+    for (size_t i = 0; i < count; i++)
+        out[i] += in[i] * weight;
+#endif
+}
+
+// filters rows [rowBegin, rowEnd) of the next level: vertically into scratch, then horizontally into target,
+// with every value clamped to [0, 1]. Both are RGBA floats.
+inline void MipFilterBand(const float *source, int sourceWidth, const MipTaps &rows, const MipTaps &columns,
+                          float *target, int targetWidth, int rowBegin, int rowEnd, vector<float> &scratch)
+{
+    size_t sourceRow = size_t(sourceWidth) * 4;
+    scratch.resize(sourceRow);
+    for (int y = rowBegin; y < rowEnd; y++)
+    {
+        std::fill(scratch.begin(), scratch.end(), 0.0f);
+        for (int k = rows.first[y]; k < rows.first[y + 1]; k++)
+            MipAccumulate(scratch.data(), source + rows.samples[k] * sourceRow, rows.weights[k], sourceRow);
+
+        float *out = target + size_t(y) * targetWidth * 4;
+        for (int x = 0; x < targetWidth; x++)
+        {
+#ifdef MIP_GENERATOR_SSE2
+            __m128 sum = _mm_setzero_ps();
+            for (int k = columns.first[x]; k < columns.first[x + 1]; k++)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(&scratch[columns.samples[k] * 4]), _mm_set1_ps(columns.weights[k])));
+            sum = _mm_min_ps(_mm_max_ps(sum, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+            _mm_storeu_ps(out + x * 4, sum);
+#else
+            float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            for (int k = columns.first[x]; k < columns.first[x + 1]; k++)
+                for (int c = 0; c < 4; c++)
+                    sum[c] += scratch[columns.samples[k] * 4 + c] * columns.weights[k];
+            for (int c = 0; c < 4; c++)
+                out[x * 4 + c] = std::min(std::max(sum[c], 0.0f), 1.0f);
+#endif
+        }
+    }
+}
+
+// 8-bit pixels with 1 to 4 channels to RGBA floats in [0, 1], with the color channels decoded to linear if srgb
+inline void MipToLinear(const unsigned char *pixels, size_t count, int channels, bool srgb, float *out)
+{
+    const float *toLinear = SRGBToLinearTable();
+    bool hasAlpha = (channels & 1) == 0;
+    int colorChannels = hasAlpha ? channels - 1 : channels;
+    for (size_t p = 0; p < count; p++)
+    {
+        const unsigned char *pixel = pixels + p * channels;
+        for (int c = 0; c < 4; c++)
+            out[p * 4 + c] = c < colorChannels ? (srgb ? toLinear[pixel[c]] : pixel[c] / 255.0f)
+                                               : c == 3 && hasAlpha ? pixel[channels - 1] / 255.0f : 0.0f;
+    }
+}
+
+// and back
+inline void MipFromLinear(const float *in, size_t count, int channels, bool srgb, unsigned char *pixels)
+{
+    const unsigned char *toSRGB = LinearToSRGBTable();
+    bool hasAlpha = (channels & 1) == 0;
+    int colorChannels = hasAlpha ? channels - 1 : channels;
+    for (size_t p = 0; p < count; p++)
+    {
+        const float *pixel = in + p * 4;
+        unsigned char *out = pixels + p * channels;
+        for (int c = 0; c < colorChannels; c++)
+            out[c] = srgb ? toSRGB[int(pixel[c] * (MIP_LINEAR_TO_SRGB_STEPS - 1) + 0.5f)]
+                          : static_cast<unsigned char>(pixel[c] * 255.0f + 0.5f);
+        if (hasAlpha)
+            out[channels - 1] = static_cast<unsigned char>(pixel[3] * 255.0f + 0.5f);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------
+// the 2x2 box filter, on 8-bit pixels
+// ---------------------------------------------------------------------------------------------------------
+
+// averages 2x2 blocks of 8-bit pixels into rows [rowBegin, rowEnd) of an image half the size, rounded down (an
+// odd last row or column is dropped), rounding like mipmap_image does. The source must be at least 2x2. With
+// srgb set the color channels are averaged in linear space. On linear data SSE2 adds up the row pairs 16 bytes
+// at a time, and the pixel pairs too for 1 and 4 channels; the rest is scalar.
+inline void MipHalveRows(const unsigned char *source, int width, int channels, bool srgb, unsigned char *target,
+                         int rowBegin, int rowEnd)
+{
+    int targetWidth = width / 2;
+    size_t sourceRow = size_t(width) * channels, targetRow = size_t(targetWidth) * channels;
+    size_t count = targetRow * 2;   // bytes of a source row that make it into the target
+    if (srgb)
+    {
+        const float *toLinear = SRGBToLinearTable();
+        const unsigned char *toSRGB = LinearToSRGBTable();
+        int colorChannels = (channels & 1) == 0 ? channels - 1 : channels;
+        for (int y = rowBegin; y < rowEnd; y++)
+        {
+            const unsigned char *top = source + size_t(2 * y) * sourceRow, *bottom = top + sourceRow;
+            unsigned char *out = target + size_t(y) * targetRow;
+            for (int x = 0; x < targetWidth; x++)
+                for (int c = 0; c < channels; c++)
+                {
+                    size_t i = size_t(2 * x) * channels + c, j = i + channels;
+                    if (c < colorChannels)
+                    {
+                        float sum = toLinear[top[i]] + toLinear[top[j]] + toLinear[bottom[i]] + toLinear[bottom[j]];
+                        out[x * channels + c] = toSRGB[int(sum * 0.25f * (MIP_LINEAR_TO_SRGB_STEPS - 1) + 0.5f)];
+                    }
+                    else
+                        out[x * channels + c] = static_cast<unsigned char>((top[i] + top[j] + bottom[i] + bottom[j] + 2) >> 2);
+                }
+        }
+        return;
+    }
+
+    vector<unsigned short> sums(count + 8);
+    for (int y = rowBegin; y < rowEnd; y++)
+    {
+        const unsigned char *top = source + size_t(2 * y) * sourceRow, *bottom = top + sourceRow;
+        unsigned char *out = target + size_t(y) * targetRow;
+        // the row pair, added up
+        size_t i = 0;
+#ifdef MIP_GENERATOR_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&sums[i]), _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&sums[i + 8]), _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+        }
+#endif
+        for (; i < count; i++)
+            sums[i] = static_cast<unsigned short>(top[i] + bottom[i]);
+
+        // and the pixel pairs of that
+        size_t j = 0;
+#ifdef MIP_GENERATOR_SSE2
+        if (channels == 4)
+        {
+            // 4 pixels in, 2 out
+            const __m128i two = _mm_set1_epi16(2);
+            for (; j + 8 <= targetRow; j += 8)
+            {
+                __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&sums[2 * j]));
+                __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&sums[2 * j + 8]));
+                first = _mm_add_epi16(first, _mm_srli_si128(first, 8));
+                second = _mm_add_epi16(second, _mm_srli_si128(second, 8));
+                __m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(first, second), two), 2);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(out + j), _mm_packus_epi16(sum, sum));
+            }
+        }
+        else if (channels == 1)
+        {
+            // 16 pixels in, 8 out
+            const __m128i ones = _mm_set1_epi16(1), two = _mm_set1_epi32(2);
+            for (; j + 8 <= targetRow; j += 8)
+            {
+                __m128i first = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&sums[2 * j])), ones);
+                __m128i second = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&sums[2 * j + 8])), ones);
+                __m128i sum = _mm_packs_epi32(_mm_srli_epi32(_mm_add_epi32(first, two), 2), _mm_srli_epi32(_mm_add_epi32(second, two), 2));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(out + j), _mm_packus_epi16(sum, sum));
+            }
+        }
+#endif
+        for (int x = static_cast<int>(j / channels); x < targetWidth; x++)
+            for (int c = 0; c < channels; c++)
+                out[x * channels + c] = static_cast<unsigned char>((sums[size_t(2 * x) * channels + c] + sums[size_t(2 * x + 1) * channels + c] + 2) >> 2);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------
+
+inline void MipParallelBands(int rows, ThreadPool *pool, const function<void(int, int)> &band)
+{
+    size_t bands = (rows + MIP_BAND_ROWS - 1) / MIP_BAND_ROWS;
+    auto run = [&](size_t b) { band(int(b) * MIP_BAND_ROWS, std::min(rows, int(b + 1) * MIP_BAND_ROWS)); };
+    if (pool)
+        pool->parallelFor(bands, run);
+    else
+        for (size_t b = 0; b < bands; b++)
+            run(b);
+}
+
+// builds the mip chain of 8-bit pixels with 1 to 4 channels. With srgb set the color channels are decoded
+// to linear before filtering and encoded again afterwards. Without a pool everything runs on the calling thread.
+inline bool GenerateMipChain(const unsigned char *pixels, int width, int height, int channels, bool srgb, MipFilter filter,
+                             MipChain &chain, ThreadPool *pool = &ThreadPool::shared())
+{
+    chain.clear();
+    if (!pixels || width < 1 || height < 1 || channels < 1 || channels > 4)
+        return false;
+    chain.channels = channels;
+    size_t total = 0;
+    for (int w = width, h = height; ; w = std::max(1, w / 2), h = std::max(1, h / 2))
+    {
+        MipLevel level = { w, h, total };
+        chain.levels.push_back(level);
+        total += size_t(w) * h * channels;
+        if (w == 1 && h == 1)
+            break;
+    }
+    chain.pixels.resize(total);
+    std::copy(pixels, pixels + size_t(width) * height * channels, chain.pixels.begin());
+
+    if (filter == MIP_FILTER_BOX && !srgb)
+    {
+        // plain averages of the 8-bit values
+        for (unsigned int i = 1; i < chain.levels.size(); i++)
+        {
+            const MipLevel &above = chain.levels[i - 1], &level = chain.levels[i];
+            int blockX = above.width > 1 ? 2 : 1, blockY = above.height > 1 ? 2 : 1;
+            const unsigned char *source = chain.data(i - 1);
+            unsigned char *target = &chain.pixels[level.offset];
+            MipParallelBands(level.height, pool, [&](int begin, int end) {
+                if (blockX == 2 && blockY == 2)
+                    MipHalveRows(source, above.width, channels, false, target, begin, end);
+                else
+                    mipmap_image(source + size_t(begin) * blockY * above.width * channels, above.width, (end - begin) * blockY, channels,
+                                 target + size_t(begin) * level.width * channels, blockX, blockY);
+            });
+        }
+        return true;
+    }
+
+    // everything else goes through linear RGBA floats, level to level, and is only quantized for the output
+    vector<float> current(size_t(width) * height * 4), next;
+    MipToLinear(pixels, size_t(width) * height, channels, srgb, current.data());
+
+    MipTaps rows, columns;
+    for (unsigned int i = 1; i < chain.levels.size(); i++)
+    {
+        const MipLevel &above = chain.levels[i - 1], &level = chain.levels[i];
+        MipComputeTaps(filter, above.height, level.height, rows);
+        MipComputeTaps(filter, above.width, level.width, columns);
+        next.resize(size_t(level.width) * level.height * 4);
+        unsigned char *target = &chain.pixels[level.offset];
+        MipParallelBands(level.height, pool, [&](int begin, int end) {
+            vector<float> scratch;
+            MipFilterBand(current.data(), above.width, rows, columns, next.data(), level.width, begin, end, scratch);
+            size_t offset = size_t(begin) * level.width;
+            MipFromLinear(&next[offset * 4], size_t(end - begin) * level.width, channels, srgb, target + offset * channels);
+        });
+        current.swap(next);
+    }
+    return true;
+}
+
+// resamples 8-bit pixels with 1 to 4 channels to another size, larger or smaller, with the windowed filters
+// above (the box filter is nearest neighbour when enlarging). Like the mips, sRGB images are filtered in
+// linear space.
+inline bool ResampleImage(const unsigned char *pixels, int width, int height, int channels, bool srgb, MipFilter filter,
+                          int targetWidth, int targetHeight, vector<unsigned char> &result, ThreadPool *pool = &ThreadPool::shared())
+{
+    if (!pixels || width < 1 || height < 1 || channels < 1 || channels > 4 || targetWidth < 1 || targetHeight < 1)
+        return false;
+    vector<float> source(size_t(width) * height * 4), target(size_t(targetWidth) * targetHeight * 4);
+    MipToLinear(pixels, size_t(width) * height, channels, srgb, source.data());
+    MipTaps rows, columns;
+    MipComputeTaps(filter, height, targetHeight, rows);
+    MipComputeTaps(filter, width, targetWidth, columns);
+    result.resize(size_t(targetWidth) * targetHeight * channels);
+    MipParallelBands(targetHeight, pool, [&](int begin, int end) {
+        vector<float> scratch;
+        MipFilterBand(source.data(), width, rows, columns, target.data(), targetWidth, begin, end, scratch);
+        size_t offset = size_t(begin) * targetWidth;
+        MipFromLinear(&target[offset * 4], size_t(end - begin) * targetWidth, channels, srgb, &result[offset * channels]);
+    });
+    return true;
+}
+
+// scales 8-bit pixels with 1 to 4 channels to targetWidth x targetHeight. Going down, the 2x2 box of
+// MipHalveRows() halves them while that stays at least twice the target size (for MIP_FILTER_BOX, all the way
+// to it), so the windowed filter of ResampleImage() only makes the last step, on an image a fraction of the
+// size and with no more than a 4:1 ratio to filter over. Going up in either direction it is ResampleImage() alone.
+inline bool ScaleImage(const unsigned char *pixels, int width, int height, int channels, bool srgb, MipFilter filter,
+                       int targetWidth, int targetHeight, vector<unsigned char> &result, ThreadPool *pool = &ThreadPool::shared())
+{
+    if (!pixels || width < 1 || height < 1 || channels < 1 || channels > 4 || targetWidth < 1 || targetHeight < 1)
+        return false;
+    vector<unsigned char> halved, next;
+    const unsigned char *current = pixels;
+    while ((width / 2 >= 2 * targetWidth && height / 2 >= 2 * targetHeight) ||
+           (filter == MIP_FILTER_BOX && width / 2 >= targetWidth && height / 2 >= targetHeight))
+    {
+        next.resize(size_t(width / 2) * (height / 2) * channels);
+        MipParallelBands(height / 2, pool, [&](int begin, int end) {
+            MipHalveRows(current, width, channels, srgb, next.data(), begin, end);
+        });
+        width /= 2;
+        height /= 2;
+        halved.swap(next);
+        current = halved.data();
+    }
+    if (width == targetWidth && height == targetHeight)
+    {
+        if (current == pixels)
+            result.assign(pixels, pixels + size_t(width) * height * channels);
+        else
+            result.swap(halved);
+        return true;
+    }
+    return ResampleImage(current, width, height, channels, srgb, filter, targetWidth, targetHeight, result, pool);
+}
+
+#endif
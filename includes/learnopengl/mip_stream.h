@@ -0,0 +1,174 @@
+#ifndef MIP_STREAM_H
+#define MIP_STREAM_H
+
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/texture_budget.h>
+#include <learnopengl/texture_upload.h>
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// streamed textures drop their finer mips after this many updates without anyone asking for them
+const unsigned int TEXTURE_STREAM_EVICT_UPDATES = 120;
+
+// The streaming state of a texture whose finer mips come and go (a texture of the TextureCache, or a page of
+// the MaterialAtlas, which streams all of its layers at once): mips [residentLevel, levels) are on the GPU,
+// and the ones from coarseLevel on always are. Its owner asks for finer mips with request() and moves it along
+// with update(), once per frame on the GL thread, through a target that does the GL side:
+//   size_t levelBytes(int first, int last)    GPU size of levels [first, last)
+//   void levelRanges(int first, int last, vector<pair<const unsigned char*, size_t> > &ranges)
+//                                             the client memory of those levels, in the order they are staged
+//   void uploadLevels(int first, int last)    uploads them into the texture, from staging if it has a size
+//                                             (back to back in the TextureUploadRing), and makes first its base level
+//   void dropLevels(int level)                frees the levels finer than level, making it the base level
+//   void residentChanged()                    after residentLevel changed
+struct MipStream
+{
+    int levels, coarseLevel, residentLevel;
+    int wantedLevel;        // finest mip asked for through request() since the last update()
+    int loadingLevel;       // finest mip of the background load in flight, -1 if there is none
+    atomic<bool> loading;   // set while a worker pages that load in
+    TextureStaging staging; // where the worker copies that load to, if the TextureUploadRing is on
+    unsigned int idleUpdates;   // updates in a row that wanted coarser mips than were resident
+    unsigned int lastUsed;      // TextureBudget frame of the last draw that used it
+
+    MipStream() : levels(0), coarseLevel(0), residentLevel(0), wantedLevel(-1), loadingLevel(-1), loading(false), idleUpdates(0), lastUsed(0) {}
+
+    // starts out with mips [coarse, levelCount) resident
+    void reset(int levelCount, int coarse)
+    {
+        levels = levelCount;
+        coarseLevel = residentLevel = wantedLevel = coarse;
+        loadingLevel = -1;
+        idleUpdates = 0;
+    }
+
+    // asks for the mips needed when width texels are spread over texelsAcross pixels on screen; the finest
+    // request since the last update() wins
+    void request(int width, float texelsAcross)
+    {
+        int level = 0;
+        if (texelsAcross <= 0.0f)
+            level = coarseLevel;
+        // the finest mip that still has a texel for every pixel
+        while (level < coarseLevel && (width >> (level + 1)) >= texelsAcross)
+            level++;
+        wantedLevel = std::min(wantedLevel, level);
+    }
+
+    // uploads the load in flight once its worker is done (unless an update already uploaded maxUploadBytes and
+    // at least one load), starts a load of finer mips if they were asked for, as fine as the TextureBudget has
+    // room for, or drops the fine mips no one asked for in TEXTURE_STREAM_EVICT_UPDATES updates. uploaded and
+    // streamed (loads uploaded) add up over the textures of one update.
+    template <typename Target>
+    void update(Target &target, size_t maxUploadBytes, size_t &uploaded, unsigned int &streamed)
+    {
+        int wanted = wantedLevel;
+        wantedLevel = coarseLevel;
+        if (loadingLevel >= 0)
+        {
+            if (loading || (uploaded >= maxUploadBytes && streamed > 0))
+                return;
+            size_t bytes = target.levelBytes(loadingLevel, residentLevel);
+            target.uploadLevels(loadingLevel, residentLevel);
+            TextureUploadRing::instance().release(staging);
+            residentLevel = loadingLevel;
+            loadingLevel = -1;
+            target.residentChanged();
+            TextureBudget::instance().release(bytes);
+            uploaded += bytes;
+            streamed++;
+        }
+        else if (wanted < residentLevel)
+        {
+            idleUpdates = 0;
+            while (wanted < residentLevel && !TextureBudget::instance().reserve(target.levelBytes(wanted, residentLevel), lastUsed))
+                wanted++;
+            if (wanted == residentLevel)
+                return;
+            vector<pair<const unsigned char*, size_t> > ranges;
+            target.levelRanges(wanted, residentLevel, ranges);
+            size_t size = 0;
+            for (unsigned int i = 0; i < ranges.size(); i++)
+                size += ranges[i].second;
+            TextureUploadRing &ring = TextureUploadRing::instance();
+            if (ring.enabled() && size <= ring.capacity() && !ring.allocate(size, staging))
+            {
+                // the uploads before it still use the ring: next frame
+                TextureBudget::instance().release(target.levelBytes(wanted, residentLevel));
+                return;
+            }
+            loadingLevel = wanted;
+            loading = true;
+            atomic<bool> *done = &loading;
+            unsigned char *staged = staging.data;
+            ThreadPool::shared().submit([ranges, staged, done]()
+            {
+                // copied into the ring back to back, or only paged in
+                unsigned char *out = staged;
+                for (unsigned int i = 0; i < ranges.size(); i++)
+                {
+                    if (out)
+                    {
+                        memcpy(out, ranges[i].first, ranges[i].second);
+                        out += ranges[i].second;
+                    }
+                    else
+                        PrefetchMemory(ranges[i].first, ranges[i].second);
+                }
+                *done = false;
+            });
+        }
+        else if (wanted > residentLevel && ++idleUpdates >= TEXTURE_STREAM_EVICT_UPDATES)
+        {
+            target.dropLevels(wanted);
+            residentLevel = wanted;
+            target.residentChanged();
+            idleUpdates = 0;
+        }
+        else if (wanted <= residentLevel)
+            idleUpdates = 0;
+    }
+
+    // fills in lastUsed and levels of a TextureBudget candidate if there are mips to drop; its demote calls demote()
+    bool budgetCandidate(TextureBudget::Candidate &candidate) const
+    {
+        if (loadingLevel >= 0 || residentLevel >= levels - 1)
+            return false;
+        candidate.lastUsed = lastUsed;
+        candidate.levels = levels - 1 - residentLevel;
+        return true;
+    }
+
+    // drops the finest resident mip, returning the bytes freed
+    template <typename Target>
+    size_t demote(Target &target)
+    {
+        size_t bytes = target.levelBytes(residentLevel, residentLevel + 1);
+        target.dropLevels(residentLevel + 1);
+        residentLevel++;
+        target.residentChanged();
+        return bytes;
+    }
+
+    // waits for the load in flight, if any, and gives back its piece of the ring and its budget reservation
+    template <typename Target>
+    void release(Target &target)
+    {
+        // a worker may still be paging in its mips
+        while (loading)
+            this_thread::yield();
+        TextureUploadRing::instance().release(staging);
+        if (loadingLevel >= 0)
+            TextureBudget::instance().release(target.levelBytes(loadingLevel, residentLevel));
+        loadingLevel = -1;
+    }
+};
+
+#endif
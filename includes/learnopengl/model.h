@@ -4,6 +4,7 @@
 #include <glad/glad.h> 
 
 #include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <stb_image.h>
 #include <assimp/Importer.hpp>
@@ -11,58 +12,312 @@
 #include <assimp/postprocess.h>
 
 #include <learnopengl/mesh.h>
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/mesh_optimizer.h>
+#include <learnopengl/obj_loader.h>
+#include <learnopengl/placeholder.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/texture_cache.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
+// how the meshes of a model are imported and processed.
+struct ModelOptions
+{
+    bool nativeObj;		// read .obj files with obj_loader.h instead of ASSIMP (other formats always go through ASSIMP)
+    bool optimizeMeshes;	// reorder triangles and vertices for the post-transform cache, overdraw and vertex fetch (see mesh_optimizer.h)
+    bool compactVertices;	// upload the quantized vertex layout of vertex_format.h and 16-bit indices where possible
+    unsigned int attributes;	// VertexAttribute mask of what the shaders read; the rest is neither imported nor uploaded
+    MeshResidency residency;	// what the meshes keep in client memory after upload()
+    bool materialAtlas;	// put diffuse and specular maps into the MaterialAtlas instead of textures of their own (see material_atlas.h)
+    string packSpecular;	// channel layout to pack the specular map of a mesh into its diffuse map with, as one texture_material
+				// (see TEXTURE_PACK_SPECULAR_IN_ALPHA); empty to keep them apart
+
+    ModelOptions() : nativeObj(true), optimizeMeshes(false), compactVertices(false), attributes(VERTEX_ALL), residency(MESH_KEEP_CPU),
+        materialAtlas(false) {}
+
+    // only import what this shader reads (found through reflection of its linked program)
+    void useAttributesOf(const Shader &shader)
+    {
+        attributes = (shader.activeAttributeMask() & VERTEX_ALL) | VERTEX_POSITION;
+    }
+
+    // the options that change the vertex and index data stored in the mesh cache (compaction happens after it)
+    unsigned int cacheKey() const { return (optimizeMeshes ? 1 : 0) | (attributes & VERTEX_ALL) << 1 | (nativeObj ? 1 : 0) << 6; }
+};
+
 class Model 
 {
 public:
     // model data 
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<Texture> textures_loaded;	// stores all the textures loaded so far; they are shared with other models through the TextureCache.
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    unsigned int importFlags;	// ASSIMP post-processing steps; also part of the mesh cache key.
+    ModelOptions options;
+    bool resident;	// set by upload(); until then Draw() shows the placeholder
+    bool failed;	// import() threw (set on the GL thread by AssetManager::update()); Draw() then draws nothing
+    glm::vec3 boundsCenter;	// bounding sphere of all meshes, in model space; set by import(), so only read it once resident
+    float boundsRadius;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const &path, bool gamma = false, ModelOptions const &options = ModelOptions()) : Model()
     {
+        import(path, gamma, options);
+        upload();
+    }
+
+    // creates an empty model to be filled in two phases: import() followed by upload().
+    Model() : gammaCorrection(false),
+        importFlags(aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace),
+        resident(false), failed(false), boundsCenter(0.0f), boundsRadius(0.0f)
+    {
+    }
+
+    // CPU phase: reads the model (from the mesh cache or through ASSIMP), builds the meshes and decodes their
+    // textures (unless another model already did) without making a single GL call, so it may run on any thread.
+    void import(string const &path, bool gamma = false, ModelOptions const &options = ModelOptions())
+    {
+        gammaCorrection = gamma;
+        this->options = options;
+        // the optimizer can only reorder vertices that are shared between faces, which ASSIMP doesn't do by default
+        if(options.optimizeMeshes)
+            importFlags |= aiProcess_JoinIdenticalVertices;
+        // skip the post-processing steps whose results the shaders never read
+        if(!(options.attributes & (VERTEX_TANGENT | VERTEX_BITANGENT)))
+            importFlags &= ~aiProcess_CalcTangentSpace;
+        if(!(importFlags & aiProcess_CalcTangentSpace) && !(options.attributes & VERTEX_NORMAL))
+            importFlags &= ~aiProcess_GenSmoothNormals;
+        if(!(importFlags & aiProcess_CalcTangentSpace) && !(options.attributes & VERTEX_TEXCOORDS))
+            importFlags &= ~aiProcess_FlipUVs;
         loadModel(path);
+        computeBounds();
+    }
+
+    // GL phase: uploads the vertex buffers and decoded textures. Must run on the thread that owns the GL context.
+    void upload()
+    {
+        for(unsigned int i = 0; i < textures_loaded.size(); i++)
+        {
+            Texture &texture = textures_loaded[i];
+            if(texture.atlas)
+            {
+                MaterialLayer layer = MaterialAtlas::instance().add(texture.cached);
+                texture.page = layer.page;
+                texture.layer = layer.layer;
+                texture.id = layer.layer >= 0 ? MaterialAtlas::instance().pageTexture(layer.page) : 0;
+            }
+            else
+                texture.id = TextureCache::instance().upload(*texture.cached);
+        }
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            // meshes hold copies of the Texture structs, so hand them the ids (and layers) that were just created
+            for(unsigned int j = 0; j < meshes[i].textures.size(); j++)
+            {
+                Texture &texture = meshes[i].textures[j];
+                unordered_map<string, unsigned int>::iterator it = textures_index.find(texture.path);
+                if(it == textures_index.end())
+                    continue;
+                const Texture &loaded = textures_loaded[it->second];
+                texture.id = loaded.id;
+                texture.page = loaded.page;
+                texture.layer = loaded.layer;
+            }
+            meshes[i].upload();
+            meshes[i].releaseCPUData(options.residency);
+        }
+        resident = true;
+    }
+
+    // radius in pixels of the model's bounding sphere on screen, with the matrices it is drawn with; 0 if it is
+    // behind the camera. Until the model is resident that is the placeholder's sphere: import() may still be
+    // writing the bounds on a worker.
+    float screenRadius(const glm::mat4 &model, const glm::mat4 &view, const glm::mat4 &projection, float viewportHeight) const
+    {
+        glm::vec3 bounds = resident ? boundsCenter : glm::vec3(0.0f);
+        glm::vec3 center = glm::vec3(view * model * glm::vec4(bounds, 1.0f));
+        float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        float radius = (resident ? boundsRadius : PLACEHOLDER_RADIUS) * scale;
+        float distance = glm::length(center);
+        if(center.z > radius)
+            return 0.0f;
+        if(distance <= radius)
+            return viewportHeight;
+        // the tangent of the angle the sphere covers, scaled like the projection does it
+        float tangent = radius / sqrt(distance * distance - radius * radius);
+        return tangent * projection[1][1] * viewportHeight * 0.5f;
     }
 
-    // draws the model, and thus all its meshes
+    // asks the texture cache (or the material atlas) for the mips the textures need at a size on screen (see
+    // screenRadius()). Only matters for streamed textures (see TextureCache::enableStreaming); the textures are assumed to wrap
+    // around the model once, as they do around the planets, which puts their width on 2 pi radius pixels
+    // in the middle of the model. GL thread only.
+    void requestTextureDetail(float screenRadius)
+    {
+        if(!resident)
+            return;
+        float texelsAcross = screenRadius * 2.0f * glm::pi<float>();
+        for(unsigned int i = 0; i < textures_loaded.size(); i++)
+        {
+            if(textures_loaded[i].atlas)
+            {
+                if(textures_loaded[i].layer >= 0)
+                    MaterialAtlas::instance().request(textures_loaded[i].page, texelsAcross);
+            }
+            else
+                TextureCache::instance().request(*textures_loaded[i].cached, texelsAcross);
+        }
+    }
+
+    // draws the model, and thus all its meshes; or a placeholder sphere while it is still loading
     void Draw(Shader &shader)
     {
+        if(failed)
+            return;
+        if(!resident)
+        {
+            PlaceholderMesh().Draw(shader);
+            return;
+        }
         for(unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shader);
     }
     
 private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const &path)
+    unordered_map<string, unsigned int> textures_index;	// path -> index into textures_loaded
+
+    // the bounding sphere of all meshes, from theirs
+    void computeBounds()
     {
-        // read file via ASSIMP
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-        // check for errors
-        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
-        {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+        if(meshes.empty())
             return;
+        glm::vec3 lower = meshes[0].boundsCenter - meshes[0].boundsRadius, upper = meshes[0].boundsCenter + meshes[0].boundsRadius;
+        for(unsigned int i = 1; i < meshes.size(); i++)
+        {
+            lower = glm::min(lower, meshes[i].boundsCenter - meshes[i].boundsRadius);
+            upper = glm::max(upper, meshes[i].boundsCenter + meshes[i].boundsRadius);
         }
+        boundsCenter = (lower + upper) * 0.5f;
+        boundsRadius = 0.0f;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            boundsRadius = std::max(boundsRadius, glm::length(meshes[i].boundsCenter - boundsCenter) + meshes[i].boundsRadius);
+    }
+
+    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    void loadModel(string const &path)
+    {
         // retrieve the directory path of the filepath
         directory = path.substr(0, path.find_last_of('/'));
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        // a still valid binary cache from an earlier run lets us skip ASSIMP altogether
+        if(loadFromCache(path))
+            return;
+
+        // OBJ files have a faster path of their own; ASSIMP is the fallback for everything else
+        if(!(options.nativeObj && IsObjFile(path) && loadObj(path)))
+        {
+            // read file via ASSIMP
+            Assimp::Importer importer;
+            const aiScene* scene = importer.ReadFile(path, importFlags);
+            // check for errors
+            if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+            {
+                cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+                return;
+            }
+
+            // process ASSIMP's root node recursively
+            meshes.reserve(scene->mNumMeshes);
+            processNode(scene->mRootNode, scene);
+        }
+
+        // store the processed meshes so the next run can map them instead of importing again
+        if(!MeshCache::write(path, importFlags, options.cacheKey(), meshes))
+            cout << "WARNING::MESH_CACHE:: failed to write " << MeshCache::pathFor(path) << endl;
+    }
+
+    // builds the meshes straight from the memory mapped cache file; returns false if there is no valid cache.
+    // The meshes read their data from the mapping, which stays open until they release it after upload(),
+    // unless they keep it (MESH_KEEP_CPU) and so need copies of their own.
+    bool loadFromCache(string const &path)
+    {
+        shared_ptr<MeshCache> cache = make_shared<MeshCache>();
+        if(!cache->open(path, importFlags, options.cacheKey()))
+            return false;
+
+        meshes.reserve(cache->meshCount());
+        for(unsigned int i = 0; i < cache->meshCount(); i++)
+        {
+            vector<Texture> textures = loadTextures(cache->textures(i));
+            if(options.residency != MESH_KEEP_CPU)
+            {
+                meshes.push_back(Mesh(cache, cache->vertices(i), cache->vertexCount(i), cache->indices(i), cache->indexCount(i),
+                                      std::move(textures), options.compactVertices, options.attributes));
+                continue;
+            }
+            vector<Vertex> vertices(cache->vertices(i), cache->vertices(i) + cache->vertexCount(i));
+            vector<unsigned int> indices(cache->indices(i), cache->indices(i) + cache->indexCount(i));
+            meshes.push_back(Mesh(std::move(vertices), std::move(indices), std::move(textures), false, options.compactVertices, options.attributes));
+        }
+        return true;
+    }
+
+    // reads an OBJ file with the native loader, which gives the same meshes as ASSIMP with our import flags
+    bool loadObj(string const &path)
+    {
+        vector<ObjMesh> objMeshes;
+        string error;
+        if(!LoadObj(path, importFlags, objMeshes, &error))
+        {
+            cout << "WARNING::OBJ_LOADER:: " << error << ", falling back to ASSIMP" << endl;
+            return false;
+        }
+        meshes.reserve(objMeshes.size());
+        for(unsigned int i = 0; i < objMeshes.size(); i++)
+        {
+            ObjMesh &mesh = objMeshes[i];
+            // drop what the shaders don't read, like processMesh does
+            for(unsigned int j = 0; j < mesh.vertices.size(); j++)
+            {
+                Vertex &vertex = mesh.vertices[j];
+                if(!(options.attributes & VERTEX_NORMAL))
+                    vertex.Normal = glm::vec3(0.0f);
+                if(!(options.attributes & VERTEX_TEXCOORDS))
+                    vertex.TexCoords = glm::vec2(0.0f);
+                if(!(options.attributes & (VERTEX_TANGENT | VERTEX_BITANGENT)))
+                    vertex.Tangent = vertex.Bitangent = glm::vec3(0.0f);
+            }
+            optimizeMesh(mesh.vertices, mesh.indices, mesh.name.c_str());
+            vector<Texture> textures;
+            for(unsigned int j = 0; j < mesh.textures.size(); j++)
+                textures.push_back(textureReference(mesh.textures[j].second, mesh.textures[j].first));
+            textures = loadTextures(textures);
+            meshes.push_back(Mesh(std::move(mesh.vertices), std::move(mesh.indices), std::move(textures), false, options.compactVertices, options.attributes));
+        }
+        return true;
+    }
+
+    // reorders a mesh for the GPU's vertex cache, overdraw and vertex fetch if the options ask for it
+    void optimizeMesh(vector<Vertex> &vertices, vector<unsigned int> &indices, const char *name)
+    {
+        if(!options.optimizeMeshes)
+            return;
+        pair<VertexCacheStats, VertexCacheStats> stats = OptimizeMesh(vertices, indices);
+        ostringstream message;
+        message << "MESH_OPTIMIZER:: " << directory << " '" << name << "': ACMR " << stats.first.acmr << " -> " << stats.second.acmr
+                << ", ATVR " << stats.first.atvr << " -> " << stats.second.atvr << endl;
+        cout << message.str(); // one write, so lines of models importing in parallel don't interleave
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -90,6 +345,8 @@ private:
         vector<Vertex> vertices;
         vector<unsigned int> indices;
         vector<Texture> textures;
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(mesh->mNumFaces * 3); // triangulated
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -102,15 +359,17 @@ private:
             vector.z = mesh->mVertices[i].z;
             vertex.Position = vector;
             // normals
-            if (mesh->HasNormals())
+            if (mesh->HasNormals() && (options.attributes & VERTEX_NORMAL))
             {
                 vector.x = mesh->mNormals[i].x;
                 vector.y = mesh->mNormals[i].y;
                 vector.z = mesh->mNormals[i].z;
                 vertex.Normal = vector;
             }
+            else
+                vertex.Normal = glm::vec3(0.0f);
             // texture coordinates
-            if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+            if(mesh->mTextureCoords[0] && (options.attributes & VERTEX_TEXCOORDS)) // does the mesh contain texture coordinates?
             {
                 glm::vec2 vec;
                 // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
@@ -118,6 +377,12 @@ private:
                 vec.x = mesh->mTextureCoords[0][i].x; 
                 vec.y = mesh->mTextureCoords[0][i].y;
                 vertex.TexCoords = vec;
+            }
+            else
+                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+            // tangent space (unused components are zero: the vertex bytes are hashed and cached)
+            if(mesh->HasTangentsAndBitangents() && (options.attributes & (VERTEX_TANGENT | VERTEX_BITANGENT)))
+            {
                 // tangent
                 vector.x = mesh->mTangents[i].x;
                 vector.y = mesh->mTangents[i].y;
@@ -130,7 +395,10 @@ private:
                 vertex.Bitangent = vector;
             }
             else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+            {
+                vertex.Tangent = glm::vec3(0.0f);
+                vertex.Bitangent = glm::vec3(0.0f);
+            }
 
             vertices.push_back(vertex);
         }
@@ -142,6 +410,8 @@ private:
             for(unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);        
         }
+        // reorder for the GPU's vertex cache, overdraw and vertex fetch; the result is cached along with the mesh
+        optimizeMesh(vertices, indices, mesh->mName.C_Str());
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];    
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
@@ -151,55 +421,117 @@ private:
         // specular: texture_specularN
         // normal: texture_normalN
 
+        // (and with ModelOptions::packSpecular a diffuse map with the specular map packed into it: texture_materialN)
+
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+        vector<Texture> diffuseMaps = materialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
         textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+        vector<Texture> specularMaps = materialTextures(material, aiTextureType_SPECULAR, "texture_specular");
         textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+        std::vector<Texture> normalMaps = materialTextures(material, aiTextureType_HEIGHT, "texture_normal");
         textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+        std::vector<Texture> heightMaps = materialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+        textures = loadTextures(textures);
         
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        return Mesh(std::move(vertices), std::move(indices), std::move(textures), false, options.compactVertices, options.attributes);
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    // lists all material textures of a given type, for loadTextures() to load.
+    vector<Texture> materialTextures(aiMaterial *mat, aiTextureType type, string typeName)
     {
         vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            textures.push_back(textureReference(str.C_Str(), typeName));
+        }
+        return textures;
+    }
+
+    // a texture of a mesh that isn't loaded yet
+    static Texture textureReference(const string &path, const string &typeName)
+    {
+        Texture texture;
+        texture.type = typeName;
+        texture.path = path;
+        return texture;
+    }
+
+    // loads the textures a mesh references. With ModelOptions::packSpecular its first diffuse and specular
+    // maps become a single texture_material, whose path names both ("diffuse|specular"); that is also how the
+    // mesh cache stores it, so cached packed textures are split up again when the options don't pack.
+    vector<Texture> loadTextures(const vector<Texture> &references)
+    {
+        vector<Texture> unpacked;
+        for(unsigned int i = 0; i < references.size(); i++)
+        {
+            size_t split = references[i].path.find('|');
+            if(references[i].type == "texture_material" && split != string::npos)
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+                unpacked.push_back(textureReference(references[i].path.substr(0, split), "texture_diffuse"));
+                unpacked.push_back(textureReference(references[i].path.substr(split + 1), "texture_specular"));
             }
+            else
+                unpacked.push_back(references[i]);
+        }
+        int diffuse = -1, specular = -1;
+        for(unsigned int i = 0; i < unpacked.size() && !options.packSpecular.empty(); i++)
+        {
+            if(unpacked[i].type == "texture_diffuse" && diffuse < 0)
+                diffuse = i;
+            else if(unpacked[i].type == "texture_specular" && specular < 0)
+                specular = i;
+        }
+
+        vector<Texture> textures;
+        for(int i = 0; i < int(unpacked.size()); i++)
+        {
+            if(i == diffuse && specular >= 0)
+                textures.push_back(loadTexture((unpacked[diffuse].path + '|' + unpacked[specular].path).c_str(), "texture_material"));
+            else if(i != specular || diffuse < 0)
+                textures.push_back(loadTexture(unpacked[i].path.c_str(), unpacked[i].type));
         }
         return textures;
     }
+
+    // returns the texture at path (relative to the model's directory). Textures are shared process wide
+    // through the TextureCache; the GL texture is created in upload().
+    Texture loadTexture(const char *path, const string &typeName)
+    {
+        // check if this model referenced the texture before and if so, return it
+        unordered_map<string, unsigned int>::iterator it = textures_index.find(path);
+        if(it != textures_index.end())
+            return textures_loaded[it->second];
+
+        Texture texture;
+        texture.id = 0;
+        texture.type = typeName;
+        texture.path = path;
+        texture.atlas = options.materialAtlas && (typeName == "texture_diffuse" || typeName == "texture_specular" || typeName == "texture_material");
+        if(typeName == "texture_material")
+        {
+            // the diffuse map with the specular map packed into it, decoded (or cooked) as one texture
+            string diffusePath = this->directory + '/' + texture.path.substr(0, texture.path.find('|'));
+            string specularPath = this->directory + '/' + texture.path.substr(texture.path.find('|') + 1);
+            if(texture.atlas)
+                texture.cached = MaterialAtlas::instance().acquirePacked(diffusePath, specularPath, options.packSpecular, gammaCorrection);
+            else
+                texture.cached = TextureCache::instance().acquirePacked(diffusePath, specularPath, options.packSpecular, gammaCorrection);
+        }
+        else if(texture.atlas)
+            texture.cached = MaterialAtlas::instance().acquire(this->directory + '/' + path, gammaCorrection);
+        else
+            texture.cached = TextureCache::instance().acquire(this->directory + '/' + path, gammaCorrection);
+        textures_index[texture.path] = textures_loaded.size();
+        textures_loaded.push_back(texture);
+        return texture;
+    }
 };
 
 
@@ -208,38 +540,10 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
+    TextureImage image;
+    image.data = stbi_load(filename.c_str(), &image.width, &image.height, &image.nrComponents, 0);
+    if (!image.data)
         std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureFromImage(image, gamma);
 }
 #endif
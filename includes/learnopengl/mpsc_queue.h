@@ -0,0 +1,79 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Lock-free multi-producer, single-consumer queue. Producers push onto an atomic list head with a CAS;
+// the consumer takes the whole list with one exchange and hands the values out oldest first. Since the
+// consumer never pops single nodes there is no ABA problem. Used to hand results of worker threads to
+// the render thread without it ever waiting on a lock.
+template <typename T>
+class MPSCQueue
+{
+public:
+    MPSCQueue() : head(nullptr) {}
+
+    ~MPSCQueue()
+    {
+        Node *node = head.exchange(nullptr);
+        while (node)
+        {
+            Node *next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue &operator=(const MPSCQueue&) = delete;
+
+    // any thread
+    void push(T value)
+    {
+        Node *node = new Node(std::move(value));
+        node->next = head.load(std::memory_order_relaxed);
+        while (!head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+            ;
+    }
+
+    // consumer thread only: calls consume(value) for everything pushed so far, in push order per producer,
+    // and returns how many values there were.
+    template <typename F>
+    size_t drain(F consume)
+    {
+        Node *node = head.exchange(nullptr, std::memory_order_acquire);
+        // the list is newest first
+        Node *oldest = nullptr;
+        while (node)
+        {
+            Node *next = node->next;
+            node->next = oldest;
+            oldest = node;
+            node = next;
+        }
+        size_t count = 0;
+        while (oldest)
+        {
+            Node *next = oldest->next;
+            consume(oldest->value);
+            delete oldest;
+            oldest = next;
+            count++;
+        }
+        return count;
+    }
+
+private:
+    struct Node
+    {
+        explicit Node(T value) : value(std::move(value)), next(nullptr) {}
+        T value;
+        Node *next;
+    };
+
+    std::atomic<Node*> head;
+};
+
+#endif
@@ -0,0 +1,814 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <glm/glm.hpp>
+#include <assimp/postprocess.h>
+
+#include <learnopengl/hash.h>
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/mesh.h>
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// Native Wavefront OBJ/MTL reader for Model, producing the same meshes as ASSIMP's OBJ importer followed
+// by the post-processing steps Model asks for (aiProcess_Triangulate, GenSmoothNormals, CalcTangentSpace,
+// FlipUVs and JoinIdenticalVertices):
+//   - one mesh per object ('o') and material run ('usemtl'), in file order, one vertex per face corner
+//   - numbers are parsed like ASSIMP's fast_atof, quads are split along the same diagonal, and normals and
+//     tangents are generated and smoothed with the same rules
+// The file is memory mapped and large files are parsed in chunks, in parallel, on ThreadPool::shared().
+// Differences: polygons with more than four corners are fanned instead of ear clipped, and vertices are
+// joined only if they are bitwise identical (ASSIMP allows a small epsilon).
+
+const size_t OBJ_CHUNK_SIZE = 256 * 1024;  // files are split into chunks of at least this size
+
+// one mesh of an OBJ file, before it becomes a Mesh.
+struct ObjMesh {
+    string name;                                // object name
+    vector<Vertex> vertices;                    // fields that aren't in the file (or generated) are zero
+    vector<unsigned int> indices;
+    vector<pair<string, string> > textures;     // (type, path relative to the OBJ), in Model's type order
+    bool hasNormals;
+    bool hasTexCoords;
+    bool hasTangents;
+};
+
+inline bool IsObjFile(const string &path)
+{
+    if (path.size() < 4)
+        return false;
+    string extension = path.substr(path.size() - 4);
+    for (unsigned int i = 0; i < extension.size(); i++)
+        extension[i] = static_cast<char>(tolower(extension[i]));
+    return extension == ".obj";
+}
+
+// ---------------------------------------------------------------------------------------------------------
+// number parsing; like ASSIMP's fast_atof, so that the floats come out bit for bit the same
+// ---------------------------------------------------------------------------------------------------------
+
+const double OBJ_DECIMALS[16] = {
+    0.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001, 0.00000001, 0.000000001,
+    0.0000000001, 0.00000000001, 0.000000000001, 0.0000000000001, 0.00000000000001, 0.000000000000001
+};
+
+inline bool ObjIsDigit(char c) { return c >= '0' && c <= '9'; }
+inline bool ObjIsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// reads up to maxDigits digits (0: no limit) and skips the rest; digits receives the number read.
+inline uint64_t ObjParseDigits(const char *&c, const char *end, unsigned int maxDigits, unsigned int &digits)
+{
+    uint64_t value = 0;
+    digits = 0;
+    while (c < end && ObjIsDigit(*c))
+    {
+        value = value * 10 + static_cast<uint64_t>(*c - '0');
+        c++;
+        digits++;
+        if (maxDigits && digits == maxDigits)
+        {
+            while (c < end && ObjIsDigit(*c))
+                c++;
+            break;
+        }
+    }
+    return value;
+}
+
+inline bool ObjParseFloat(const char *&c, const char *end, float &out)
+{
+    while (c < end && ObjIsSpace(*c))
+        c++;
+    bool negative = c < end && *c == '-';
+    if (c < end && (*c == '-' || *c == '+'))
+        c++;
+    bool fraction = c + 1 < end && *c == '.' && ObjIsDigit(c[1]);
+    if (c >= end || (!ObjIsDigit(*c) && !fraction))
+        return false;
+
+    unsigned int digits;
+    float f = 0.0f;
+    if (*c != '.')
+        f = static_cast<float>(ObjParseDigits(c, end, 0, digits));
+    if (c + 1 < end && *c == '.' && ObjIsDigit(c[1]))
+    {
+        c++;
+        double decimals = static_cast<double>(ObjParseDigits(c, end, 15, digits));
+        decimals *= OBJ_DECIMALS[digits];
+        f += static_cast<float>(decimals);
+    }
+    else if (c < end && *c == '.')
+        c++;
+    if (c < end && (*c == 'e' || *c == 'E'))
+    {
+        c++;
+        bool negativeExponent = c < end && *c == '-';
+        if (c < end && (*c == '-' || *c == '+'))
+            c++;
+        float exponent = static_cast<float>(ObjParseDigits(c, end, 0, digits));
+        if (negativeExponent)
+            exponent = -exponent;
+        f *= pow(10.0f, exponent);
+    }
+    out = negative ? -f : f;
+    return true;
+}
+
+inline bool ObjParseInt(const char *&c, const char *end, int &out)
+{
+    bool negative = c < end && *c == '-';
+    if (c < end && (*c == '-' || *c == '+'))
+        c++;
+    if (c >= end || !ObjIsDigit(*c))
+        return false;
+    unsigned int digits;
+    int value = static_cast<int>(ObjParseDigits(c, end, 0, digits));
+    out = negative ? -value : value;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------
+// parsing
+// ---------------------------------------------------------------------------------------------------------
+
+// what one chunk of the file contains. Face corners are stored as (position, uv, normal) index triples as
+// the file has them: > 0 is a 1-based index, 0 is absent and < 0 is relative to the elements of its kind read
+// so far. Those may go back past the start of the chunk, so they are resolved by ObjMerge, which knows how
+// many came before it; relativeCounts has, for each relative corner in order, the count read by this chunk.
+struct ObjChunk {
+    vector<glm::vec3> positions;
+    vector<glm::vec2> texCoords;
+    vector<glm::vec3> normals;
+    vector<int> corners;
+    vector<unsigned int> relativeCounts;
+    vector<unsigned int> faceSizes;
+    struct Statement {
+        enum Type { OBJECT, MATERIAL, MATERIAL_LIBRARY } type;
+        string name;
+        size_t face;    // the statement comes before this face (chunk local)
+    };
+    vector<Statement> statements;
+    bool failed;
+
+    ObjChunk() : failed(false) {}
+};
+
+// the rest of the line, without surrounding white space
+inline string ObjRestOfLine(const char *c, const char *end)
+{
+    while (c < end && ObjIsSpace(*c))
+        c++;
+    while (end > c && ObjIsSpace(end[-1]))
+        end--;
+    return string(c, end);
+}
+
+inline bool ObjKeyword(const char *&c, const char *end, const char *keyword)
+{
+    size_t length = strlen(keyword);
+    if (size_t(end - c) < length || memcmp(c, keyword, length) != 0)
+        return false;
+    if (c + length < end && !ObjIsSpace(c[length]))
+        return false;
+    c += length;
+    return true;
+}
+
+inline void ObjAddCorner(ObjChunk &chunk, int index, size_t count)
+{
+    chunk.corners.push_back(index);
+    if (index < 0)
+        chunk.relativeCounts.push_back(static_cast<unsigned int>(count));
+}
+
+inline void ObjParseChunk(const char *c, const char *end, ObjChunk &chunk)
+{
+    while (c < end)
+    {
+        const char *lineEnd = static_cast<const char*>(memchr(c, '\n', end - c));
+        if (!lineEnd)
+            lineEnd = end;
+        const char *p = c;
+        c = lineEnd + (lineEnd < end ? 1 : 0);
+        while (p < lineEnd && ObjIsSpace(*p))
+            p++;
+        if (p == lineEnd || *p == '#')
+            continue;
+
+        if (ObjKeyword(p, lineEnd, "v"))
+        {
+            glm::vec3 v(0.0f);
+            if (!ObjParseFloat(p, lineEnd, v.x) || !ObjParseFloat(p, lineEnd, v.y) || !ObjParseFloat(p, lineEnd, v.z))
+                chunk.failed = true;
+            chunk.positions.push_back(v);
+        }
+        else if (ObjKeyword(p, lineEnd, "vt"))
+        {
+            glm::vec2 v(0.0f);
+            if (!ObjParseFloat(p, lineEnd, v.x))
+                chunk.failed = true;
+            ObjParseFloat(p, lineEnd, v.y);  // optional, like the third
+            chunk.texCoords.push_back(v);
+        }
+        else if (ObjKeyword(p, lineEnd, "vn"))
+        {
+            glm::vec3 v(0.0f);
+            if (!ObjParseFloat(p, lineEnd, v.x) || !ObjParseFloat(p, lineEnd, v.y) || !ObjParseFloat(p, lineEnd, v.z))
+                chunk.failed = true;
+            chunk.normals.push_back(v);
+        }
+        else if (ObjKeyword(p, lineEnd, "f"))
+        {
+            unsigned int size = 0;
+            size_t relativeBefore = chunk.relativeCounts.size();
+            for (;;)
+            {
+                while (p < lineEnd && ObjIsSpace(*p))
+                    p++;
+                if (p == lineEnd)
+                    break;
+                int position = 0, texCoord = 0, normal = 0;
+                if (!ObjParseInt(p, lineEnd, position))
+                {
+                    chunk.failed = true;
+                    break;
+                }
+                if (p < lineEnd && *p == '/')
+                {
+                    p++;
+                    if (p < lineEnd && *p != '/')
+                        ObjParseInt(p, lineEnd, texCoord);
+                    if (p < lineEnd && *p == '/')
+                    {
+                        p++;
+                        ObjParseInt(p, lineEnd, normal);
+                    }
+                }
+                ObjAddCorner(chunk, position, chunk.positions.size());
+                ObjAddCorner(chunk, texCoord, chunk.texCoords.size());
+                ObjAddCorner(chunk, normal, chunk.normals.size());
+                size++;
+            }
+            if (size >= 3)
+                chunk.faceSizes.push_back(size);
+            else
+            {
+                chunk.corners.resize(chunk.corners.size() - size * 3); // points and lines aren't meshes
+                chunk.relativeCounts.resize(relativeBefore);
+            }
+        }
+        else
+        {
+            ObjChunk::Statement statement;
+            if (ObjKeyword(p, lineEnd, "o"))
+                statement.type = ObjChunk::Statement::OBJECT;
+            else if (ObjKeyword(p, lineEnd, "usemtl"))
+                statement.type = ObjChunk::Statement::MATERIAL;
+            else if (ObjKeyword(p, lineEnd, "mtllib"))
+                statement.type = ObjChunk::Statement::MATERIAL_LIBRARY;
+            else
+                continue; // s, g, l, p, ...: nothing that changes the meshes
+            statement.name = ObjRestOfLine(p, lineEnd);
+            statement.face = chunk.faceSizes.size();
+            chunk.statements.push_back(statement);
+        }
+    }
+}
+
+// the chunks joined into one: every corner index global and 0-based (-1 if absent), statement faces global.
+inline bool ObjMerge(vector<ObjChunk> &chunks, ObjChunk &merged)
+{
+    size_t positions = 0, texCoords = 0, normals = 0, faces = 0;
+    for (unsigned int i = 0; i < chunks.size(); i++)
+    {
+        ObjChunk &chunk = chunks[i];
+        if (chunk.failed)
+            return false;
+        merged.positions.insert(merged.positions.end(), chunk.positions.begin(), chunk.positions.end());
+        merged.texCoords.insert(merged.texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+        merged.normals.insert(merged.normals.end(), chunk.normals.begin(), chunk.normals.end());
+        size_t bases[3] = { positions, texCoords, normals };
+        size_t first = merged.corners.size();
+        merged.corners.insert(merged.corners.end(), chunk.corners.begin(), chunk.corners.end());
+        for (size_t c = first, relative = 0; c < merged.corners.size(); c++)
+        {
+            int &index = merged.corners[c];
+            if (index > 0)
+                index--;
+            else if (index == 0)
+                index = -1;
+            else
+            {
+                // counted back from the elements read up to this point of the file
+                int64_t resolved = int64_t(bases[(c - first) % 3]) + chunk.relativeCounts[relative++] + index;
+                if (resolved < 0)
+                    return false;
+                index = static_cast<int>(resolved);
+            }
+        }
+        merged.faceSizes.insert(merged.faceSizes.end(), chunk.faceSizes.begin(), chunk.faceSizes.end());
+        for (unsigned int s = 0; s < chunk.statements.size(); s++)
+        {
+            merged.statements.push_back(chunk.statements[s]);
+            merged.statements.back().face += faces;
+        }
+        positions += chunk.positions.size();
+        texCoords += chunk.texCoords.size();
+        normals += chunk.normals.size();
+        faces += chunk.faceSizes.size();
+        vector<glm::vec3>().swap(chunk.positions); // free as we go, keeping the peak near one copy
+        vector<glm::vec2>().swap(chunk.texCoords);
+        vector<glm::vec3>().swap(chunk.normals);
+        vector<int>().swap(chunk.corners);
+        vector<unsigned int>().swap(chunk.relativeCounts);
+    }
+    const size_t counts[3] = { merged.positions.size(), merged.texCoords.size(), merged.normals.size() };
+    for (size_t c = 0; c < merged.corners.size(); c++)
+        if (merged.corners[c] >= static_cast<int>(counts[c % 3]) || merged.corners[c] < -1)
+            return false;
+    return true;
+}
+
+// texture maps of the materials in an MTL file, by material name. Only the map types Model loads.
+inline void ObjParseMaterials(const string &path, unordered_map<string, vector<pair<string, string> > > &materials)
+{
+    MappedFile file(path);
+    const char *c = file.data(), *end = file.data() + file.size();
+    vector<pair<string, string> > *current = nullptr;
+    while (c < end)
+    {
+        const char *lineEnd = static_cast<const char*>(memchr(c, '\n', end - c));
+        if (!lineEnd)
+            lineEnd = end;
+        const char *p = c;
+        c = lineEnd + (lineEnd < end ? 1 : 0);
+        while (p < lineEnd && ObjIsSpace(*p))
+            p++;
+        if (ObjKeyword(p, lineEnd, "newmtl"))
+        {
+            current = &materials[ObjRestOfLine(p, lineEnd)];
+            continue;
+        }
+        // the types ASSIMP maps these to: DIFFUSE, SPECULAR, HEIGHT, AMBIENT, and the names Model gives those
+        const char *type = nullptr;
+        if (ObjKeyword(p, lineEnd, "map_Kd"))
+            type = "texture_diffuse";
+        else if (ObjKeyword(p, lineEnd, "map_Ks"))
+            type = "texture_specular";
+        else if (ObjKeyword(p, lineEnd, "map_bump") || ObjKeyword(p, lineEnd, "map_Bump") || ObjKeyword(p, lineEnd, "bump"))
+            type = "texture_normal";
+        else if (ObjKeyword(p, lineEnd, "map_Ka"))
+            type = "texture_height";
+        if (!type || !current)
+            continue;
+        // skip options like -bm 0.5 or -s 1 1 1: the option and the numbers (or on/off) after it
+        for (;;)
+        {
+            while (p < lineEnd && ObjIsSpace(*p))
+                p++;
+            if (p == lineEnd || *p != '-')
+                break;
+            while (p < lineEnd && !ObjIsSpace(*p))
+                p++;
+            for (;;)
+            {
+                const char *q = p;
+                float number;
+                while (q < lineEnd && ObjIsSpace(*q))
+                    q++;
+                if (ObjParseFloat(q, lineEnd, number) && (q == lineEnd || ObjIsSpace(*q)))
+                    p = q;
+                else if (ObjKeyword(q, lineEnd, "on") || ObjKeyword(q, lineEnd, "off"))
+                    p = q;
+                else
+                    break;
+            }
+        }
+        current->push_back(make_pair(string(type), ObjRestOfLine(p, lineEnd)));
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------
+// post-processing, following ASSIMP's steps
+// ---------------------------------------------------------------------------------------------------------
+
+// finds vertices at (nearly) the same position, like ASSIMP's SpatialSort: sorted by distance to a plane,
+// results in that order.
+class ObjSpatialSort
+{
+public:
+    explicit ObjSpatialSort(const vector<Vertex> &vertices) : planeNormal(0.8523f, 0.0005f, 0.5220f)
+    {
+        planeNormal = planeNormal / glm::length(planeNormal);
+        entries.reserve(vertices.size());
+        for (unsigned int i = 0; i < vertices.size(); i++)
+        {
+            Entry entry = { i, vertices[i].Position, glm::dot(vertices[i].Position, planeNormal) };
+            entries.push_back(entry);
+        }
+        stable_sort(entries.begin(), entries.end());
+    }
+
+    void find(const glm::vec3 &position, float radius, vector<unsigned int> &results) const
+    {
+        float distance = glm::dot(position, planeNormal);
+        float minDistance = distance - radius, maxDistance = distance + radius;
+        float squareRadius = radius * radius;
+        results.clear();
+        Entry key = { 0, position, minDistance };
+        vector<Entry>::const_iterator it = lower_bound(entries.begin(), entries.end(), key);
+        for (; it != entries.end() && it->distance < maxDistance; ++it)
+        {
+            glm::vec3 d = it->position - position;
+            if (glm::dot(d, d) < squareRadius)
+                results.push_back(it->index);
+        }
+    }
+
+private:
+    struct Entry
+    {
+        unsigned int index;
+        glm::vec3 position;
+        float distance;
+        bool operator<(const Entry &other) const { return distance < other.distance; }
+    };
+    glm::vec3 planeNormal;
+    vector<Entry> entries;
+};
+
+// ASSIMP's ComputePositionEpsilon
+inline float ObjPositionEpsilon(const vector<Vertex> &vertices)
+{
+    glm::vec3 lo(1e10f), hi(-1e10f);
+    for (unsigned int i = 0; i < vertices.size(); i++)
+    {
+        lo = glm::min(lo, vertices[i].Position);
+        hi = glm::max(hi, vertices[i].Position);
+    }
+    return glm::length(hi - lo) * 1e-4f;
+}
+
+inline bool ObjIsSpecial(const glm::vec3 &v)
+{
+    return !std::isfinite(v.x) || !std::isfinite(v.y) || !std::isfinite(v.z);
+}
+
+// aiProcess_GenSmoothNormals for a mesh without normals: face normals averaged over all vertices at the same position
+inline void ObjGenerateNormals(vector<Vertex> &vertices, const vector<unsigned int> &indices, const ObjSpatialSort &sort, float epsilon)
+{
+    for (size_t t = 0; t < indices.size(); t += 3)
+    {
+        const glm::vec3 &a = vertices[indices[t]].Position, &b = vertices[indices[t + 1]].Position, &c = vertices[indices[t + 2]].Position;
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        normal = normal / glm::length(normal);
+        for (unsigned int k = 0; k < 3; k++)
+            vertices[indices[t + k]].Normal = normal;
+    }
+    vector<glm::vec3> smooth(vertices.size());
+    vector<bool> done(vertices.size(), false);
+    vector<unsigned int> found;
+    for (unsigned int i = 0; i < vertices.size(); i++)
+    {
+        if (done[i])
+            continue;
+        sort.find(vertices[i].Position, epsilon, found);
+        glm::vec3 normal(0.0f);
+        for (unsigned int f = 0; f < found.size(); f++)
+            if (!std::isnan(vertices[found[f]].Normal.x))
+                normal += vertices[found[f]].Normal;
+        float length = glm::length(normal);
+        normal = length > 0.0f ? normal / length : glm::vec3(0.0f);
+        for (unsigned int f = 0; f < found.size(); f++)
+        {
+            smooth[found[f]] = normal;
+            done[found[f]] = true;
+        }
+    }
+    for (unsigned int i = 0; i < vertices.size(); i++)
+        vertices[i].Normal = smooth[i];
+}
+
+// aiProcess_CalcTangentSpace: per triangle tangents projected per vertex, then smoothed over vertices at the
+// same position with the same normal and tangents less than 45 degrees apart.
+inline void ObjCalculateTangents(vector<Vertex> &vertices, const vector<unsigned int> &indices, const ObjSpatialSort &sort, float epsilon)
+{
+    for (size_t t = 0; t < indices.size(); t += 3)
+    {
+        const Vertex &v0 = vertices[indices[t]], &v1 = vertices[indices[t + 1]], &v2 = vertices[indices[t + 2]];
+        glm::vec3 v = v1.Position - v0.Position, w = v2.Position - v0.Position;
+        float sx = v1.TexCoords.x - v0.TexCoords.x, sy = v1.TexCoords.y - v0.TexCoords.y;
+        float tx = v2.TexCoords.x - v0.TexCoords.x, ty = v2.TexCoords.y - v0.TexCoords.y;
+        float direction = (tx * sy - ty * sx) < 0.0f ? -1.0f : 1.0f;
+        if (sx == 0.0f && sy == 0.0f && tx == 0.0f && ty == 0.0f)
+        {
+            sx = 0.0f; sy = 1.0f;
+            tx = 1.0f; ty = 0.0f;
+        }
+        glm::vec3 tangent = (w * sy - v * ty) * direction;
+        glm::vec3 bitangent = (w * sx - v * tx) * direction;
+        for (unsigned int k = 0; k < 3; k++)
+        {
+            Vertex &vertex = vertices[indices[t + k]];
+            const glm::vec3 &n = vertex.Normal;
+            glm::vec3 localTangent = tangent - n * glm::dot(tangent, n);
+            glm::vec3 localBitangent = bitangent - n * glm::dot(bitangent, n);
+            localTangent = localTangent / glm::length(localTangent);
+            localBitangent = localBitangent / glm::length(localBitangent);
+            bool invalidTangent = ObjIsSpecial(localTangent), invalidBitangent = ObjIsSpecial(localBitangent);
+            if (invalidTangent != invalidBitangent)
+            {
+                if (invalidTangent)
+                {
+                    localTangent = glm::cross(n, localBitangent);
+                    localTangent = localTangent / glm::length(localTangent);
+                }
+                else
+                {
+                    localBitangent = glm::cross(localTangent, n);
+                    localBitangent = localBitangent / glm::length(localBitangent);
+                }
+            }
+            vertex.Tangent = localTangent;
+            vertex.Bitangent = localBitangent;
+        }
+    }
+
+    const float limit = cos(glm::radians(45.0f));
+    vector<bool> done(vertices.size(), false);
+    vector<unsigned int> found, close;
+    for (unsigned int i = 0; i < vertices.size(); i++)
+    {
+        if (done[i])
+            continue;
+        const Vertex &origin = vertices[i];
+        sort.find(origin.Position, epsilon, found);
+        close.assign(1, i);
+        // i is among the found vertices as well and (as in ASSIMP) counted twice
+        for (unsigned int f = 0; f < found.size(); f++)
+        {
+            unsigned int j = found[f];
+            if (done[j])
+                continue;
+            if (glm::dot(vertices[j].Normal, origin.Normal) < 0.9999f ||
+                glm::dot(vertices[j].Tangent, origin.Tangent) < limit ||
+                glm::dot(vertices[j].Bitangent, origin.Bitangent) < limit)
+                continue;
+            close.push_back(j);
+            done[j] = true;
+        }
+        glm::vec3 tangent(0.0f), bitangent(0.0f);
+        for (unsigned int c = 0; c < close.size(); c++)
+        {
+            tangent += vertices[close[c]].Tangent;
+            bitangent += vertices[close[c]].Bitangent;
+        }
+        tangent = tangent / glm::length(tangent);
+        bitangent = bitangent / glm::length(bitangent);
+        for (unsigned int c = 0; c < close.size(); c++)
+        {
+            vertices[close[c]].Tangent = tangent;
+            vertices[close[c]].Bitangent = bitangent;
+        }
+    }
+}
+
+// aiProcess_JoinIdenticalVertices, for bitwise identical vertices; keeps the order of first use.
+inline void ObjJoinVertices(vector<Vertex> &vertices, vector<unsigned int> &indices)
+{
+    struct VertexBytes
+    {
+        const Vertex *vertex;
+        bool operator==(const VertexBytes &other) const { return memcmp(vertex, other.vertex, sizeof(Vertex)) == 0; }
+    };
+    struct VertexHash
+    {
+        size_t operator()(const VertexBytes &v) const { return static_cast<size_t>(hashBytes(v.vertex, sizeof(Vertex))); }
+    };
+    unordered_map<VertexBytes, unsigned int, VertexHash> unique;
+    unique.reserve(vertices.size());
+    vector<unsigned int> remap(vertices.size());
+    vector<Vertex> joined;
+    joined.reserve(vertices.size());
+    for (unsigned int i = 0; i < vertices.size(); i++)
+    {
+        VertexBytes key = { &vertices[i] };
+        unordered_map<VertexBytes, unsigned int, VertexHash>::iterator it = unique.find(key);
+        if (it != unique.end())
+        {
+            remap[i] = it->second;
+            continue;
+        }
+        remap[i] = static_cast<unsigned int>(joined.size());
+        unique[key] = remap[i];
+        joined.push_back(vertices[i]);
+    }
+    for (size_t i = 0; i < indices.size(); i++)
+        indices[i] = remap[indices[i]];
+    vertices.swap(joined);
+}
+
+// one mesh from faces [firstFace, lastFace) of the merged file
+inline void ObjBuildMesh(const ObjChunk &file, const vector<size_t> &faceOffsets, size_t firstFace, size_t lastFace,
+                         unsigned int importFlags, ObjMesh &mesh)
+{
+    size_t cornerCount = 0, triangleCount = 0;
+    mesh.hasNormals = mesh.hasTexCoords = mesh.hasTangents = false;
+    for (size_t f = firstFace; f < lastFace; f++)
+    {
+        cornerCount += file.faceSizes[f];
+        triangleCount += file.faceSizes[f] - 2;
+        for (size_t c = faceOffsets[f]; c < faceOffsets[f] + file.faceSizes[f]; c++)
+        {
+            mesh.hasTexCoords = mesh.hasTexCoords || file.corners[c * 3 + 1] >= 0;
+            mesh.hasNormals = mesh.hasNormals || file.corners[c * 3 + 2] >= 0;
+        }
+    }
+
+    // one vertex per corner, like ASSIMP's importer
+    mesh.vertices.resize(cornerCount);
+    memset(mesh.vertices.data(), 0, cornerCount * sizeof(Vertex));
+    mesh.indices.reserve(triangleCount * 3);
+    size_t vertex = 0;
+    for (size_t f = firstFace; f < lastFace; f++)
+    {
+        unsigned int size = file.faceSizes[f];
+        unsigned int first = static_cast<unsigned int>(vertex);
+        for (unsigned int k = 0; k < size; k++, vertex++)
+        {
+            const int *corner = &file.corners[(faceOffsets[f] + k) * 3];
+            Vertex &v = mesh.vertices[vertex];
+            v.Position = file.positions[corner[0]];
+            if (corner[1] >= 0)
+                v.TexCoords = file.texCoords[corner[1]];
+            if (corner[2] >= 0)
+                v.Normal = file.normals[corner[2]];
+        }
+        // aiProcess_Triangulate: quads are split at their concave corner if they have one, the rest is fanned
+        unsigned int start = 0;
+        if (size == 4)
+        {
+            for (unsigned int i = 0; i < 4; i++)
+            {
+                const glm::vec3 &p = mesh.vertices[first + i].Position;
+                glm::vec3 left = mesh.vertices[first + (i + 3) % 4].Position - p;
+                glm::vec3 diagonal = mesh.vertices[first + (i + 2) % 4].Position - p;
+                glm::vec3 right = mesh.vertices[first + (i + 1) % 4].Position - p;
+                left = left / glm::length(left);
+                diagonal = diagonal / glm::length(diagonal);
+                right = right / glm::length(right);
+                if (acos(glm::dot(left, diagonal)) + acos(glm::dot(right, diagonal)) > 3.14159265358979f)
+                {
+                    start = i;
+                    break;
+                }
+            }
+        }
+        for (unsigned int k = 1; k + 1 < size; k++)
+        {
+            mesh.indices.push_back(first + start);
+            mesh.indices.push_back(first + (start + k) % size);
+            mesh.indices.push_back(first + (start + k + 1) % size);
+        }
+    }
+
+    bool generateNormals = !mesh.hasNormals && (importFlags & aiProcess_GenSmoothNormals);
+    bool calculateTangents = mesh.hasTexCoords && (mesh.hasNormals || generateNormals) && (importFlags & aiProcess_CalcTangentSpace);
+    if (generateNormals || calculateTangents)
+    {
+        ObjSpatialSort sort(mesh.vertices);
+        float epsilon = ObjPositionEpsilon(mesh.vertices);
+        if (generateNormals)
+        {
+            ObjGenerateNormals(mesh.vertices, mesh.indices, sort, epsilon);
+            mesh.hasNormals = true;
+        }
+        if (calculateTangents)
+        {
+            ObjCalculateTangents(mesh.vertices, mesh.indices, sort, epsilon);
+            mesh.hasTangents = true;
+        }
+    }
+    if (importFlags & aiProcess_JoinIdenticalVertices)
+        ObjJoinVertices(mesh.vertices, mesh.indices);
+    if (mesh.hasTexCoords && (importFlags & aiProcess_FlipUVs))
+        for (unsigned int i = 0; i < mesh.vertices.size(); i++)
+            mesh.vertices[i].TexCoords.y = 1.0f - mesh.vertices[i].TexCoords.y;
+}
+
+// ---------------------------------------------------------------------------------------------------------
+
+// reads an OBJ file and the MTL files it references. importFlags are ASSIMP's post-processing flags; the
+// ones listed at the top of this file are honoured. Returns false if the file can't be read or parsed.
+inline bool LoadObj(const string &path, unsigned int importFlags, vector<ObjMesh> &meshes, string *error = nullptr)
+{
+    MappedFile file;
+    if (!file.open(path))
+    {
+        if (error)
+            *error = "can't open " + path;
+        return false;
+    }
+
+    // split at line ends into chunks of at least OBJ_CHUNK_SIZE bytes, one per worker at most
+    ThreadPool &pool = ThreadPool::shared();
+    size_t chunkCount = std::max<size_t>(1, std::min<size_t>(file.size() / OBJ_CHUNK_SIZE, pool.size() + 1));
+    vector<const char*> bounds(1, file.data());
+    for (size_t i = 1; i < chunkCount; i++)
+    {
+        const char *split = file.data() + file.size() * i / chunkCount;
+        const char *end = file.data() + file.size();
+        const char *lineEnd = split > bounds.back() ? static_cast<const char*>(memchr(split, '\n', end - split)) : nullptr;
+        if (lineEnd)
+            bounds.push_back(lineEnd + 1);
+    }
+    bounds.push_back(file.data() + file.size());
+    vector<ObjChunk> chunks(bounds.size() - 1);
+    pool.parallelFor(chunks.size(), [&bounds, &chunks](size_t i) { ObjParseChunk(bounds[i], bounds[i + 1], chunks[i]); });
+    file.close();
+
+    ObjChunk merged;
+    if (!ObjMerge(chunks, merged))
+    {
+        if (error)
+            *error = "malformed OBJ file " + path;
+        return false;
+    }
+
+    // meshes: a new one per object, and per material change once the current one has a material
+    string directory = path.substr(0, path.find_last_of('/') + 1);
+    unordered_map<string, vector<pair<string, string> > > materials;
+    struct Group { string name; string material; bool hasMaterial; size_t firstFace, lastFace; };
+    vector<Group> groups;
+    Group group = { "defaultobject", "", false, 0, 0 };
+    groups.push_back(group);
+    for (unsigned int s = 0; s < merged.statements.size(); s++)
+    {
+        const ObjChunk::Statement &statement = merged.statements[s];
+        groups.back().lastFace = statement.face;
+        if (statement.type == ObjChunk::Statement::MATERIAL_LIBRARY)
+            ObjParseMaterials(directory + statement.name, materials);
+        else if (statement.type == ObjChunk::Statement::OBJECT)
+        {
+            Group object = { statement.name, "", false, statement.face, statement.face };
+            groups.push_back(object);
+        }
+        else if (!groups.back().hasMaterial)
+        {
+            groups.back().material = statement.name;
+            groups.back().hasMaterial = true;
+        }
+        else if (groups.back().material != statement.name)
+        {
+            Group run = { groups.back().name, statement.name, true, statement.face, statement.face };
+            groups.push_back(run);
+        }
+    }
+    groups.back().lastFace = merged.faceSizes.size();
+
+    vector<size_t> faceOffsets(merged.faceSizes.size());
+    for (size_t f = 0, offset = 0; f < merged.faceSizes.size(); offset += merged.faceSizes[f++])
+        faceOffsets[f] = offset;
+    vector<Group> used;
+    for (unsigned int g = 0; g < groups.size(); g++)
+        if (groups[g].lastFace > groups[g].firstFace)
+            used.push_back(groups[g]);
+
+    meshes.clear();
+    meshes.resize(used.size());
+    pool.parallelFor(used.size(), [&](size_t g)
+    {
+        ObjBuildMesh(merged, faceOffsets, used[g].firstFace, used[g].lastFace, importFlags, meshes[g]);
+        meshes[g].name = used[g].name;
+        if (used[g].hasMaterial)
+        {
+            unordered_map<string, vector<pair<string, string> > >::const_iterator it = materials.find(used[g].material);
+            if (it != materials.end())
+                meshes[g].textures = it->second;
+        }
+    });
+
+    // Model's order: diffuse, specular, normal, height
+    static const char *order[] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+    for (unsigned int m = 0; m < meshes.size(); m++)
+    {
+        vector<pair<string, string> > sorted;
+        for (unsigned int o = 0; o < 4; o++)
+            for (unsigned int t = 0; t < meshes[m].textures.size(); t++)
+                if (meshes[m].textures[t].first == order[o])
+                    sorted.push_back(meshes[m].textures[t]);
+        meshes[m].textures.swap(sorted);
+    }
+    return true;
+}
+
+#endif
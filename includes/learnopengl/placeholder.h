@@ -0,0 +1,74 @@
+#ifndef PLACEHOLDER_H
+#define PLACEHOLDER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+
+#include <cmath>
+#include <vector>
+using namespace std;
+
+const unsigned int PLACEHOLDER_SEGMENTS = 12;
+const unsigned int PLACEHOLDER_RINGS    = 8;
+const float PLACEHOLDER_RADIUS = 1.0f;  // around the model's origin
+const unsigned char PLACEHOLDER_COLOR[4] = { 128, 128, 128, 255 };
+
+// A low-poly sphere of PLACEHOLDER_RADIUS with a flat grey 1x1 diffuse texture, drawn in place of models that are still
+// loading. Built on first use and never freed (it is needed until the very last frame). GL thread only.
+inline Mesh &PlaceholderMesh()
+{
+    static Mesh *placeholder = nullptr;
+    if (placeholder)
+        return *placeholder;
+
+    const float PI = 3.14159265359f;
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vertices.reserve((PLACEHOLDER_RINGS + 1) * (PLACEHOLDER_SEGMENTS + 1));
+    indices.reserve(PLACEHOLDER_RINGS * PLACEHOLDER_SEGMENTS * 6);
+    for (unsigned int y = 0; y <= PLACEHOLDER_RINGS; y++)
+    {
+        for (unsigned int x = 0; x <= PLACEHOLDER_SEGMENTS; x++)
+        {
+            float u = float(x) / PLACEHOLDER_SEGMENTS;
+            float v = float(y) / PLACEHOLDER_RINGS;
+            Vertex vertex;
+            vertex.Normal = glm::vec3(cos(u * 2.0f * PI) * sin(v * PI), cos(v * PI), sin(u * 2.0f * PI) * sin(v * PI));
+            vertex.Position = vertex.Normal * PLACEHOLDER_RADIUS;
+            vertex.TexCoords = glm::vec2(u, v);
+            vertex.Tangent = glm::vec3(0.0f);
+            vertex.Bitangent = glm::vec3(0.0f);
+            vertices.push_back(vertex);
+        }
+    }
+    for (unsigned int y = 0; y < PLACEHOLDER_RINGS; y++)
+    {
+        for (unsigned int x = 0; x < PLACEHOLDER_SEGMENTS; x++)
+        {
+            unsigned int i0 = y * (PLACEHOLDER_SEGMENTS + 1) + x;
+            unsigned int i1 = i0 + PLACEHOLDER_SEGMENTS + 1;
+            indices.push_back(i0);
+            indices.push_back(i1);
+            indices.push_back(i0 + 1);
+            indices.push_back(i0 + 1);
+            indices.push_back(i1);
+            indices.push_back(i1 + 1);
+        }
+    }
+
+    Texture texture;
+    texture.type = "texture_diffuse";
+    glGenTextures(1, &texture.id);
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, PLACEHOLDER_COLOR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    vector<Texture> textures(1, texture);
+
+    placeholder = new Mesh(std::move(vertices), std::move(indices), std::move(textures));
+    return *placeholder;
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef PROGRAM_BUILD_H
+#define PROGRAM_BUILD_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+using namespace std;
+
+// GL_KHR_parallel_shader_compile: glGetProgramiv answers without waiting for the compile
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// whether the driver compiles and links in the background (GL_KHR_parallel_shader_compile)
+inline bool ParallelShaderCompileSupported()
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char *extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension && (strcmp(extension, "GL_KHR_parallel_shader_compile") == 0 || strcmp(extension, "GL_ARB_parallel_shader_compile") == 0))
+            return true;
+    }
+    return false;
+}
+
+// A program compiled and linked from the sources of its stages (vertex, fragment and geometry if it has one)
+// in two halves: start() hands the sources to the driver without asking how it went, finish() collects the
+// outcome, waiting for the driver if need be. Drivers compile the builds started in between at the same
+// time (all of them under GL_KHR_parallel_shader_compile, most of the others on threads of their own), so
+// starting a whole batch before finishing any of it is what makes it compile in parallel.
+struct ProgramBuild
+{
+    GLuint program;
+    GLuint stages[3];
+    bool linked;
+    string log;         // compile and link errors
+
+    ProgramBuild() : program(0), linked(false)
+    {
+        stages[0] = stages[1] = stages[2] = 0;
+    }
+
+    // with retrievable set the driver is asked to keep the binary for the ProgramBinaryCache
+    void start(const vector<string> &sources, bool retrievable)
+    {
+        const GLenum types[3] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER };
+        program = glCreateProgram();
+        for (unsigned int i = 0; i < sources.size() && i < 3; i++)
+        {
+            const char *code = sources[i].c_str();
+            stages[i] = glCreateShader(types[i]);
+            glShaderSource(stages[i], 1, &code, NULL);
+            glCompileShader(stages[i]);
+            glAttachShader(program, stages[i]);
+        }
+        if (retrievable)
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(program);
+    }
+
+    // whether finish() won't wait; only drivers with ParallelShaderCompileSupported() can tell
+    bool completed() const
+    {
+        GLint complete = GL_FALSE;
+        glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &complete);
+        return complete == GL_TRUE;
+    }
+
+    // collects the outcome (linked and log) and frees the stages
+    void finish()
+    {
+        const char *names[3] = { "VERTEX", "FRAGMENT", "GEOMETRY" };
+        char infoLog[1024] = "";
+        GLint success = GL_FALSE;
+        for (unsigned int i = 0; i < 3; i++)
+        {
+            if (stages[i] == 0)
+                continue;
+            glGetShaderiv(stages[i], GL_COMPILE_STATUS, &success);
+            if (!success)
+            {
+                glGetShaderInfoLog(stages[i], sizeof(infoLog), NULL, infoLog);
+                log += string("ERROR::SHADER_COMPILATION_ERROR of type: ") + names[i] + "\n" + infoLog + "\n";
+            }
+            glDetachShader(program, stages[i]);
+            glDeleteShader(stages[i]);
+            stages[i] = 0;
+        }
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        linked = success == GL_TRUE;
+        if (!linked)
+        {
+            glGetProgramInfoLog(program, sizeof(infoLog), NULL, infoLog);
+            log += string("ERROR::PROGRAM_LINKING_ERROR\n") + infoLog + "\n";
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/hash.h>
+#include <learnopengl/mapped_file.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// tags the files of the ProgramBinaryCache; bump the version whenever their layout changes
+const uint32_t PROGRAM_BINARY_TAG = 'L' | ('G' << 8) | ('P' << 16) | ('B' << 24);
+const uint32_t PROGRAM_BINARY_VERSION = 1;
+
+// what precedes the driver's binary in a cache file
+struct ProgramBinaryHeader
+{
+    uint32_t tag, version;
+    uint64_t key;
+    uint32_t format;                // the binary format the driver handed it out in
+    uint32_t size;                  // bytes of binary after the header
+    uint32_t compileMicroseconds;   // what compiling and linking from source took: what a hit saves
+    uint32_t reserved;
+};
+
+// Keeps linked programs on disk as driver binaries (glGetProgramBinary, GL 4.1), so later runs load them
+// instead of compiling and linking GLSL. A binary is filed under a key over the sources of all stages and the
+// GL vendor, renderer, version and binary formats, so another GPU or driver misses rather than loading a
+// binary made for something else. The driver may still turn one down; the program is then compiled from
+// source as if there was none, and the binary replaced.
+// GL thread only.
+class ProgramBinaryCache
+{
+public:
+    struct Stats
+    {
+        unsigned int hits;
+        unsigned int misses;        // rejected binaries included
+        unsigned int rejected;      // binaries the driver turned down
+        double savedMilliseconds;   // compile and link time of the hits, less their loading
+    };
+
+    static ProgramBinaryCache &instance()
+    {
+        static ProgramBinaryCache cache;
+        return cache;
+    }
+
+    // keeps program binaries in directory, which must exist; call it on the GL thread once the context is
+    // current, before creating shaders. Returns false, and leaves the cache off, if the context is older than
+    // GL 4.1 or the driver has no binary formats.
+    bool enable(const string &cacheDirectory = ".")
+    {
+        GLint count = 0;
+        if (GLAD_GL_VERSION_4_1)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+        if (count <= 0)
+        {
+            cout << "PROGRAM_CACHE:: the driver has no program binary formats, shaders compile from source" << endl;
+            return false;
+        }
+        formats.resize(count);
+        glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, &formats[0]);
+        driverKey = hashBytes(&formats[0], formats.size() * sizeof(GLint));
+        const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        for (unsigned int i = 0; i < 3; i++)
+        {
+            const char *value = reinterpret_cast<const char*>(glGetString(strings[i]));
+            driverKey = hashString(value ? value : "", driverKey);
+        }
+        directory = cacheDirectory;
+        on = true;
+        return true;
+    }
+
+    bool enabled() const { return on; }
+
+    // the key of a program made of these stage sources (empty for a stage it doesn't have), on this driver
+    uint64_t key(const vector<string> &sources) const
+    {
+        uint64_t result = driverKey;
+        for (unsigned int i = 0; i < sources.size(); i++)
+        {
+            uint64_t size = sources[i].size();
+            result = hashString(sources[i], hashBytes(&size, sizeof(size), result));
+        }
+        return result;
+    }
+
+    // links program from the binary filed under key. Returns false if the cache is off, has no such binary
+    // or the driver turned it down; program is then left unlinked, to be linked from source.
+    bool load(uint64_t key, GLuint program)
+    {
+        if (!on)
+            return false;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        MappedFile file(path(key));
+        const ProgramBinaryHeader *header = reinterpret_cast<const ProgramBinaryHeader*>(file.data());
+        if (file.size() < sizeof(ProgramBinaryHeader) || header->tag != PROGRAM_BINARY_TAG || header->version != PROGRAM_BINARY_VERSION ||
+            header->key != key || file.size() - sizeof(ProgramBinaryHeader) != header->size ||
+            find(formats.begin(), formats.end(), GLint(header->format)) == formats.end())
+        {
+            counters.misses++;
+            return false;
+        }
+        glProgramBinary(program, header->format, file.data() + sizeof(ProgramBinaryHeader), static_cast<GLsizei>(header->size));
+        GLint linked = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            counters.misses++;
+            counters.rejected++;
+            return false;
+        }
+        double loading = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        counters.hits++;
+        counters.savedMilliseconds += std::max(0.0, header->compileMicroseconds / 1000.0 - loading);
+        return true;
+    }
+
+    // files the binary of program, linked from source in compileMilliseconds, under key. Programs that failed
+    // to link are left out. Set GL_PROGRAM_BINARY_RETRIEVABLE_HINT on program before linking it.
+    void save(uint64_t key, GLuint program, double compileMilliseconds)
+    {
+        if (!on)
+            return;
+        GLint linked = 0, size = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+        if (!linked || size <= 0)
+            return;
+        vector<char> binary(size);
+        GLenum format = 0;
+        glGetProgramBinary(program, size, &size, &format, &binary[0]);
+
+        ProgramBinaryHeader header;
+        header.tag = PROGRAM_BINARY_TAG;
+        header.version = PROGRAM_BINARY_VERSION;
+        header.key = key;
+        header.format = format;
+        header.size = static_cast<uint32_t>(size);
+        header.compileMicroseconds = static_cast<uint32_t>(compileMilliseconds * 1000.0);
+        header.reserved = 0;
+        string target = path(key), temporary = target + ".tmp";
+        {
+            ofstream out(temporary.c_str(), ios::binary | ios::trunc);
+            if (!out)
+                return;
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(&binary[0], size);
+            if (!out)
+                return;
+        }
+        remove(target.c_str()); // rename() won't replace an existing file on Windows
+        if (rename(temporary.c_str(), target.c_str()) != 0)
+            cout << "PROGRAM_CACHE:: failed to write " << target << endl;
+    }
+
+    Stats stats() const { return counters; }
+
+    void printStats() const
+    {
+        if (!on)
+            return;
+        cout << "PROGRAM_CACHE:: " << counters.hits << " hits (" << static_cast<int>(counters.savedMilliseconds + 0.5) << " ms of compiling saved), "
+             << counters.misses << " misses, " << counters.rejected << " binaries rejected by the driver" << endl;
+    }
+
+private:
+    bool on;
+    string directory;
+    vector<GLint> formats;
+    uint64_t driverKey;
+    Stats counters;
+
+    ProgramBinaryCache() : on(false), driverKey(0)
+    {
+        counters.hits = counters.misses = counters.rejected = 0;
+        counters.savedMilliseconds = 0.0;
+    }
+
+    string path(uint64_t key) const
+    {
+        char name[48];
+        snprintf(name, sizeof(name), "program.%016llx.bin", (unsigned long long)key);
+        return directory + '/' + name;
+    }
+};
+
+#endif
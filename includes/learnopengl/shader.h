@@ -4,97 +4,67 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <learnopengl/program_cache.h>
+#include <learnopengl/shader_preprocessor.h>
+#include <learnopengl/shader_uniforms.h>
+
+#include <chrono>
+
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 class Shader
 {
 public:
     unsigned int ID;
+    // the locations of its uniforms, read once it is linked
+    UniformTable uniforms;
+    // the files of its stages: vertex, fragment and geometry if it has one
+    std::vector<std::string> sourcePaths;
+    // every file its sources are made of: sourcePaths and the files they #include
+    std::vector<std::string> sourceFiles;
+    // the features it was built with, of the ones asked for (see shader_preprocessor.h)
+    ShaderFeatures features;
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const ShaderFeatures &requested = ShaderFeatures())
     {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-            // if geometry shader path is present, also load a geometry shader
-            if(geometryPath != nullptr)
-            {
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
-        }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
-        }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
+        sourcePaths.push_back(vertexPath);
+        sourcePaths.push_back(fragmentPath);
         if(geometryPath != nullptr)
+            sourcePaths.push_back(geometryPath);
+        // 1. retrieve the source code from the files, with their #includes resolved and the features defined
+        ProgramSources sources = PreprocessProgram(sourcePaths, requested);
+        sourceFiles = sources.files;
+        features = sources.features;
+        std::vector<std::string> keySources = sources.stages;
+        keySources.resize(3);
+        // 2. load the program from the binary cache (see program_cache.h), or compile and link it from source
+        ID = glCreateProgram();
+        ProgramBinaryCache &binaries = ProgramBinaryCache::instance();
+        uint64_t binaryKey = 0;
+        if(binaries.enabled())
+            binaryKey = binaries.key(keySources);
+        if(!binaries.load(binaryKey, ID))
         {
-            const char * gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            link(sources.stages[0], sources.stages[1], geometryPath != nullptr ? &sources.stages[2] : nullptr, binaries.enabled());
+            binaries.save(binaryKey, ID, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
         }
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if(geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if(geometryPath != nullptr)
-            glDeleteShader(geometry);
-
+        uniforms.reflect(ID);
+        // the uniform blocks with buffers of their own (see uniform_buffer.h)
+        UniformBlockRegistry::instance().bind(ID);
+    }
+    // takes over a program already linked from sources, which were preprocessed from paths (see ShaderVariants)
+    // ------------------------------------------------------------------------
+    Shader(unsigned int program, const std::vector<std::string> &paths, const ProgramSources &sources)
+        : ID(program), sourcePaths(paths), sourceFiles(sources.files), features(sources.features)
+    {
+        uniforms.reflect(ID);
+        UniformBlockRegistry::instance().bind(ID);
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -102,66 +72,183 @@ public:
     { 
         glUseProgram(ID); 
     }
-    // utility uniform functions
+    // swaps in another linked program built from (new versions of) the same sources and deletes the old one.
+    // Uniform handles stay valid, and uniforms both programs have keep their values, so ones set only once
+    // (like sampler units) survive. If the old program was in use, the new one is.
+    // ------------------------------------------------------------------------
+    void replaceProgram(unsigned int program)
+    {
+        UniformBlockRegistry::instance().bind(program);
+        UniformTable previous = uniforms;
+        uniforms.reflect(program);
+        GLint current = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+        glUseProgram(program);
+        for(unsigned int i = 0; i < previous.size(); i++)
+            if(previous[i].location >= 0 && uniforms[i].location >= 0 && previous[i].type == uniforms[i].type)
+                CopyUniformValue(ID, previous[i].location, uniforms[i].location, previous[i].type);
+        glUseProgram((unsigned int)current == ID ? program : current);
+        glDeleteProgram(ID);
+        ID = program;
+    }
+    // bit mask of the vertex attribute locations the linked program actually reads: bit i set means
+    // location i is active. Matrix attributes set one bit per column.
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const
+    unsigned int activeAttributeMask() const
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_ATTRIBUTES, &count);
+        glGetProgramiv(ID, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> name(maxLength > 0 ? maxLength : 1);
+        unsigned int mask = 0;
+        for(GLint i = 0; i < count; i++)
+        {
+            GLint size;
+            GLenum type;
+            glGetActiveAttrib(ID, i, (GLsizei)name.size(), NULL, &size, &type, &name[0]);
+            GLint location = glGetAttribLocation(ID, &name[0]);
+            if(location < 0) // built-ins like gl_VertexID
+                continue;
+            GLint slots = size;
+            if(type == GL_FLOAT_MAT2)
+                slots *= 2;
+            else if(type == GL_FLOAT_MAT3)
+                slots *= 3;
+            else if(type == GL_FLOAT_MAT4)
+                slots *= 4;
+            for(GLint slot = 0; slot < slots && location + slot < 32; slot++)
+                mask |= 1u << (location + slot);
+        }
+        return mask;
+    }
+    // the handle of a uniform, looked up by name once so it can be set without one from then on (see set()).
+    // Reports a uniform whose GLSL type isn't T; one the program doesn't have is set as a no-op.
+    // ------------------------------------------------------------------------
+    template<typename T>
+    Uniform<T> uniform(const UniformName &name)
+    {
+        int slot = uniforms.resolve(name);
+        if(uniforms[slot].location >= 0 && !UniformTypeMatches(UniformType<T>::value, uniforms[slot].type))
+            std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH: " << uniforms[slot].name << std::endl;
+        return Uniform<T>(slot);
+    }
+    // sets a uniform by handle; the shader must be in use
+    // ------------------------------------------------------------------------
+    template<typename T>
+    void set(const Uniform<T> &uniform, const typename Uniform<T>::type &value) const
+    {
+        SetUniformValue(uniforms.location(uniform.slot), value);
+    }
+    // utility uniform functions, by name: literals are hashed at compile time (see UniformName) and the
+    // location comes from the table read at link time
+    // ------------------------------------------------------------------------
+    void setBool(const UniformName &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(uniforms.location(name), (int)value); 
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const
+    void setInt(const UniformName &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(uniforms.location(name), value); 
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const
+    void setFloat(const UniformName &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(uniforms.location(name), value); 
     }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string &name, const glm::vec2 &value) const
+    void setVec2(const UniformName &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform2fv(uniforms.location(name), 1, &value[0]); 
     }
-    void setVec2(const std::string &name, float x, float y) const
+    void setVec2(const UniformName &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        glUniform2f(uniforms.location(name), x, y); 
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string &name, const glm::vec3 &value) const
+    void setVec3(const UniformName &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform3fv(uniforms.location(name), 1, &value[0]); 
     }
-    void setVec3(const std::string &name, float x, float y, float z) const
+    void setVec3(const UniformName &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(uniforms.location(name), x, y, z); 
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string &name, const glm::vec4 &value) const
+    void setVec4(const UniformName &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform4fv(uniforms.location(name), 1, &value[0]); 
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w) 
+    void setVec4(const UniformName &name, float x, float y, float z, float w) 
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(uniforms.location(name), x, y, z, w); 
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string &name, const glm::mat2 &mat) const
+    void setMat2(const UniformName &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(uniforms.location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string &name, const glm::mat3 &mat) const
+    void setMat3(const UniformName &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(uniforms.location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string &name, const glm::mat4 &mat) const
+    void setMat4(const UniformName &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(uniforms.location(name), 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    // compiles the stages and links them into ID; with retrievable set the driver is asked to keep the
+    // binary for the ProgramBinaryCache
+    // ------------------------------------------------------------------------
+    void link(const std::string &vertexCode, const std::string &fragmentCode, const std::string *geometryCode, bool retrievable)
+    {
+        const char* vShaderCode = vertexCode.c_str();
+        const char * fShaderCode = fragmentCode.c_str();
+        // compile shaders
+        unsigned int vertex, fragment;
+        // vertex shader
+        vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glCompileShader(vertex);
+        checkCompileErrors(vertex, "VERTEX");
+        // fragment Shader
+        fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glCompileShader(fragment);
+        checkCompileErrors(fragment, "FRAGMENT");
+        // if geometry shader is given, compile geometry shader
+        unsigned int geometry;
+        if(geometryCode != nullptr)
+        {
+            const char * gShaderCode = geometryCode->c_str();
+            geometry = glCreateShader(GL_GEOMETRY_SHADER);
+            glShaderSource(geometry, 1, &gShaderCode, NULL);
+            glCompileShader(geometry);
+            checkCompileErrors(geometry, "GEOMETRY");
+        }
+        // shader Program
+        glAttachShader(ID, vertex);
+        glAttachShader(ID, fragment);
+        if(geometryCode != nullptr)
+            glAttachShader(ID, geometry);
+        if(retrievable)
+            glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+        // delete the shaders as they're linked into our program now and no longer necessery
+        glDetachShader(ID, vertex);
+        glDetachShader(ID, fragment);
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        if(geometryCode != nullptr)
+        {
+            glDetachShader(ID, geometry);
+            glDeleteShader(geometry);
+        }
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -0,0 +1,257 @@
+#ifndef SHADER_PREPROCESSOR_H
+#define SHADER_PREPROCESSOR_H
+
+#include <learnopengl/hash.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// the features a variant of a shader is built with: keywords its sources test with #ifdef, each defined as
+// "NAME" (#define NAME) or "NAME=VALUE" (#define NAME VALUE). Kept sorted, one value per name, so the same
+// features requested in any order make the same variant.
+class ShaderFeatures
+{
+public:
+    ShaderFeatures() {}
+    ShaderFeatures(std::initializer_list<std::string> list)
+    {
+        for(std::initializer_list<std::string>::const_iterator it = list.begin(); it != list.end(); ++it)
+            add(*it);
+    }
+
+    // adds "NAME" or "NAME=VALUE"; a name that is there already takes the new value
+    ShaderFeatures &add(const std::string &feature)
+    {
+        std::string name = nameOf(feature);
+        bool valid = !name.empty() && !isdigit((unsigned char)name[0]);
+        for(unsigned int i = 0; i < name.size() && valid; i++)
+            valid = isalnum((unsigned char)name[i]) || name[i] == '_';
+        if(!valid)
+        {
+            std::cout << "ERROR::SHADER::INVALID_FEATURE: " << feature << std::endl;
+            return *this;
+        }
+        remove(name);
+        features.insert(std::lower_bound(features.begin(), features.end(), feature), feature);
+        return *this;
+    }
+
+    ShaderFeatures &add(const std::string &name, int value)
+    {
+        return add(name + '=' + std::to_string(value));
+    }
+
+    void remove(const std::string &name)
+    {
+        for(unsigned int i = 0; i < features.size(); i++)
+            if(nameOf(features[i]) == name)
+            {
+                features.erase(features.begin() + i);
+                return;
+            }
+    }
+
+    bool has(const std::string &name) const
+    {
+        for(unsigned int i = 0; i < features.size(); i++)
+            if(nameOf(features[i]) == name)
+                return true;
+        return false;
+    }
+
+    const std::vector<std::string> &list() const { return features; }
+
+    // the permutation key: the features, sorted, separated by spaces ("" for none)
+    std::string key() const
+    {
+        std::string result;
+        for(unsigned int i = 0; i < features.size(); i++)
+            result += (i ? " " : "") + features[i];
+        return result;
+    }
+
+    // the features whose names are among keywords
+    ShaderFeatures only(const std::vector<std::string> &keywords) const
+    {
+        ShaderFeatures result;
+        for(unsigned int i = 0; i < features.size(); i++)
+            if(std::find(keywords.begin(), keywords.end(), nameOf(features[i])) != keywords.end())
+                result.features.push_back(features[i]);
+        return result;
+    }
+
+    // the #define lines of the features
+    std::string defines() const
+    {
+        std::string result;
+        for(unsigned int i = 0; i < features.size(); i++)
+        {
+            size_t equals = features[i].find('=');
+            if(equals == std::string::npos)
+                result += "#define " + features[i] + "\n";
+            else
+                result += "#define " + features[i].substr(0, equals) + " " + features[i].substr(equals + 1) + "\n";
+        }
+        return result;
+    }
+
+private:
+    std::vector<std::string> features;
+
+    static std::string nameOf(const std::string &feature)
+    {
+        return feature.substr(0, feature.find('='));
+    }
+};
+
+// the sources of a program's stages, preprocessed for one set of features (see PreprocessProgram())
+struct ProgramSources
+{
+    std::vector<std::string> stages;    // in the order of the paths
+    std::vector<std::string> files;     // every file read: the stages' and the ones they include
+    ShaderFeatures features;            // the features that were defined
+    bool found;                         // false if a file couldn't be read
+
+    // the same for identical sources, whatever the files and features they came from
+    uint64_t hash() const
+    {
+        uint64_t result = FNV1A_OFFSET_BASIS;
+        for(unsigned int i = 0; i < stages.size(); i++)
+        {
+            uint64_t size = stages[i].size();
+            result = hashString(stages[i], hashBytes(&size, sizeof(size), result));
+        }
+        return result;
+    }
+};
+
+// path with / for separators and without "." and "dir/.." steps, so a file has one name however it is included
+inline std::string NormalizeShaderPath(const std::string &path)
+{
+    std::vector<std::string> parts;
+    std::string part;
+    std::string slashed = path;
+    std::replace(slashed.begin(), slashed.end(), '\\', '/');
+    std::istringstream steps(slashed);
+    while(std::getline(steps, part, '/'))
+    {
+        if(part == "." || (part.empty() && !parts.empty()))
+            continue;
+        if(part == ".." && !parts.empty() && parts.back() != ".." && !parts.back().empty())
+            parts.pop_back();
+        else
+            parts.push_back(part);
+    }
+    std::string result;
+    for(unsigned int i = 0; i < parts.size(); i++)
+        result += (i ? "/" : "") + parts[i];
+    return result.empty() ? "." : result;
+}
+
+// appends the file at path to code, with the files it #includes ("name", relative to the file) in place of
+// their #include lines. Each file goes in once: a later #include of it is dropped, like with #pragma once.
+// #line directives keep the line numbers of compile errors those of the files, with the index of the file
+// among files as source string number. The keywords declared by "#pragma keywords NAME..." lines are added
+// to keywords.
+inline bool AppendShaderFile(const std::string &path, std::string &code, std::vector<std::string> &files, std::vector<std::string> &keywords)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if(!file)
+    {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+        return false;
+    }
+    unsigned int index = (unsigned int)files.size();
+    files.push_back(path);
+    size_t slash = path.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    bool found = true;
+    std::string line;
+    for(unsigned int number = 1; std::getline(file, line); number++)
+    {
+        size_t start = line.find_first_not_of(" \t");
+        std::string directive = start == std::string::npos ? "" : line.substr(start);
+        if(directive.compare(0, 8, "#include") == 0)
+        {
+            size_t open = directive.find('"'), close = directive.find('"', open + 1);
+            if(open == std::string::npos || close == std::string::npos)
+            {
+                std::cout << "ERROR::SHADER::BAD_INCLUDE: " << path << ":" << number << std::endl;
+                found = false;
+                code += "\n";
+                continue;
+            }
+            std::string included = NormalizeShaderPath(directory + directive.substr(open + 1, close - open - 1));
+            if(std::find(files.begin(), files.end(), included) == files.end())
+            {
+                code += "#line 1 " + std::to_string(files.size()) + "\n";
+                found = AppendShaderFile(included, code, files, keywords) && found;
+                code += "#line " + std::to_string(number + 1) + " " + std::to_string(index) + "\n";
+            }
+            else
+                code += "\n";
+        }
+        else if(directive.compare(0, 16, "#pragma keywords") == 0)
+        {
+            std::istringstream names(directive.substr(16));
+            std::string name;
+            while(names >> name)
+                if(std::find(keywords.begin(), keywords.end(), name) == keywords.end())
+                    keywords.push_back(name);
+            code += "\n";
+        }
+        else
+            code += line + "\n";
+    }
+    return found;
+}
+
+// puts the #defines of features right after the #version line of code (which has to come first), or at the
+// very start if there is none, and numbers the lines after them as if they weren't there
+inline std::string DefineShaderFeatures(const std::string &code, const ShaderFeatures &features)
+{
+    if(features.list().empty())
+        return code;
+    size_t start = code.find_first_not_of(" \t\r\n");
+    if(start == std::string::npos || code.compare(start, 8, "#version") != 0)
+        return features.defines() + "#line 1 0\n" + code;
+    size_t end = code.find('\n', start);
+    if(end == std::string::npos)
+        return code + "\n" + features.defines();
+    unsigned int versionLine = (unsigned int)std::count(code.begin(), code.begin() + end, '\n') + 1;
+    return code.substr(0, end + 1) + features.defines() + "#line " + std::to_string(versionLine + 1) + " 0\n" + code.substr(end + 1);
+}
+
+// reads the sources of a program's stages (vertex, fragment and geometry if it has one), resolves their
+// #includes and defines the features. If any of the files declares keywords (#pragma keywords NAME...), only
+// features among them are defined: the rest make no difference to the program, so leaving them out keeps
+// them from making variants that are only different by name. Reads files only, so it runs on any thread.
+inline ProgramSources PreprocessProgram(const std::vector<std::string> &paths, const ShaderFeatures &features)
+{
+    ProgramSources result;
+    result.found = true;
+    std::vector<std::string> keywords;
+    for(unsigned int i = 0; i < paths.size(); i++)
+    {
+        std::vector<std::string> files;
+        std::string code;
+        result.found = AppendShaderFile(NormalizeShaderPath(paths[i]), code, files, keywords) && result.found;
+        result.stages.push_back(code);
+        for(unsigned int j = 0; j < files.size(); j++)
+            if(std::find(result.files.begin(), result.files.end(), files[j]) == result.files.end())
+                result.files.push_back(files[j]);
+    }
+    result.features = keywords.empty() ? features : features.only(keywords);
+    for(unsigned int i = 0; i < result.stages.size(); i++)
+        result.stages[i] = DefineShaderFeatures(result.stages[i], result.features);
+    return result;
+}
+
+#endif
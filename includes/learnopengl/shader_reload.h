@@ -0,0 +1,384 @@
+#ifndef SHADER_RELOAD_H
+#define SHADER_RELOAD_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/mpsc_queue.h>
+#include <learnopengl/program_build.h>
+#include <learnopengl/program_cache.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/shader_preprocessor.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+// Reports the files it watches when they change, without ever blocking: through inotify on Linux (watching
+// their directories, as editors tend to save by replacing a file), elsewhere by comparing FileStamps.
+class FileWatcher
+{
+public:
+    FileWatcher() : inotifyFd(-1)
+    {
+#ifdef __linux__
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    }
+
+    ~FileWatcher()
+    {
+#ifdef __linux__
+        if (inotifyFd >= 0)
+            close(inotifyFd);
+#endif
+    }
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher &operator=(const FileWatcher&) = delete;
+
+    // a symlink is followed: inotify only reports changes in the directory the file itself is in
+    void watch(const string &path)
+    {
+        string resolved = path;
+#ifdef __linux__
+        if (char *real = realpath(path.c_str(), NULL))
+        {
+            resolved = real;
+            free(real);
+        }
+#endif
+        size_t slash = resolved.find_last_of("/\\");
+        string directory = slash == string::npos ? "." : resolved.substr(0, slash);
+        string key = directory + '/' + resolved.substr(slash == string::npos ? 0 : slash + 1);
+        if (files.count(key))
+            return;
+        WatchedFile &file = files[key];
+        file.path = path;
+        FileStamp::query(path, file.stamp);
+#ifdef __linux__
+        if (inotifyFd >= 0)
+        {
+            int descriptor = inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+            if (descriptor >= 0)
+                directories[descriptor] = directory;
+        }
+#endif
+    }
+
+    // the watched files (as they were passed to watch()) that changed since the last call
+    vector<string> changed()
+    {
+        vector<string> result;
+#ifdef __linux__
+        if (inotifyFd >= 0)
+        {
+            alignas(inotify_event) char buffer[4096];
+            ssize_t length;
+            while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+                for (ssize_t offset = 0; offset < length; )
+                {
+                    const inotify_event *event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                    offset += sizeof(inotify_event) + event->len;
+                    unordered_map<int, string>::iterator directory = directories.find(event->wd);
+                    if (directory == directories.end() || event->len == 0)
+                        continue;
+                    unordered_map<string, WatchedFile>::iterator file = files.find(directory->second + '/' + event->name);
+                    if (file != files.end() && find(result.begin(), result.end(), file->second.path) == result.end())
+                        result.push_back(file->second.path);
+                }
+            return result;
+        }
+#endif
+        for (unordered_map<string, WatchedFile>::iterator it = files.begin(); it != files.end(); ++it)
+        {
+            FileStamp stamp;
+            if (FileStamp::query(it->second.path, stamp) && stamp != it->second.stamp)
+            {
+                it->second.stamp = stamp;
+                result.push_back(it->second.path);
+            }
+        }
+        return result;
+    }
+
+private:
+    struct WatchedFile
+    {
+        string path;
+        FileStamp stamp;
+    };
+
+    int inotifyFd;      // -1 without inotify
+    unordered_map<int, string> directories;     // by watch descriptor
+    unordered_map<string, WatchedFile> files;   // by directory/name
+};
+
+// Rebuilds Shader programs whose source files change while the program runs, and swaps them in (see
+// Shader::replaceProgram()) only once they linked; until then, and for good if they don't, the old program
+// keeps drawing. The frame loop never waits for a compile: with GL_KHR_parallel_shader_compile the driver
+// compiles in the background and update() only polls, otherwise the compile runs on a thread of the
+// reloader's own, in a context sharing objects with the GL thread's (see setCompileContext()). Without
+// either it happens in update(), a hitch on every edit (and only then).
+// GL thread only.
+class ShaderReloader
+{
+public:
+    struct Stats
+    {
+        unsigned int reloads;   // programs swapped in
+        unsigned int failures;  // rebuilds that didn't compile or link
+    };
+
+    static ShaderReloader &instance()
+    {
+        static ShaderReloader reloader;
+        return reloader;
+    }
+
+    ~ShaderReloader() { stopWorker(); }
+
+    // whether the driver compiles and links in the background (GL_KHR_parallel_shader_compile)
+    static bool parallelCompileSupported()
+    {
+        return ParallelShaderCompileSupported();
+    }
+
+    // for drivers without parallelCompileSupported(): makeCurrent makes a context that shares objects with the
+    // GL thread's current on the thread it is called on, which is the reloader's compile thread (created here).
+    void setCompileContext(function<void()> makeCurrent)
+    {
+        if (worker.joinable())
+            return;
+        stopping = false;
+        worker = thread([this, makeCurrent]()
+        {
+            makeCurrent();
+            compileLoop();
+        });
+    }
+
+    // rebuilds shader whenever one of its sourceFiles (its sourcePaths and what they include) changes, until
+    // unwatch() (which must come before the shader goes away)
+    void watch(Shader &shader)
+    {
+        if (watched.empty())
+            parallel = parallelCompileSupported();
+        watched.push_back(&shader);
+        for (unsigned int i = 0; i < shader.sourceFiles.size(); i++)
+            watcher.watch(shader.sourceFiles[i]);
+    }
+
+    void unwatch(Shader &shader)
+    {
+        watched.erase(std::remove(watched.begin(), watched.end(), &shader), watched.end());
+        swappedGeneration.erase(&shader);
+        for (unsigned int i = 0; i < builds.size(); i++)
+            if (builds[i]->shader == &shader)
+                builds[i]->shader = nullptr;
+    }
+
+    // starts rebuilding the shaders whose files changed and swaps in the rebuilds that are done. Call once per
+    // frame; returns the number of programs swapped in.
+    unsigned int update()
+    {
+        vector<string> changed = watcher.changed();
+        for (unsigned int i = 0; i < watched.size(); i++)
+        {
+            Shader *shader = watched[i];
+            bool edited = false;
+            for (unsigned int j = 0; j < shader->sourceFiles.size() && !edited; j++)
+                edited = find(changed.begin(), changed.end(), shader->sourceFiles[j]) != changed.end();
+            if (edited)
+                start(shader);
+        }
+
+        // the background compiles
+        for (unsigned int i = 0; i < builds.size(); i++)
+            if (!builds[i]->done && parallel && builds[i]->program.completed())
+            {
+                builds[i]->program.finish();
+                builds[i]->done = true;
+            }
+        completed.drain([](Build *build) { build->done = true; });
+
+        unsigned int swapped = 0;
+        for (unsigned int i = 0; i < builds.size(); )
+        {
+            Build *build = builds[i];
+            if (!build->done)
+            {
+                i++;
+                continue;
+            }
+            // a newer build of the same shader replaces this one, whether it is still compiling or (as builds
+            // may finish out of order) was swapped in already
+            bool superseded = false;
+            for (unsigned int j = i + 1; j < builds.size(); j++)
+                superseded = superseded || builds[j]->shader == build->shader;
+            unordered_map<Shader*, unsigned int>::iterator swappedIn = swappedGeneration.find(build->shader);
+            superseded = superseded || (swappedIn != swappedGeneration.end() && swappedIn->second > build->generation);
+            if (build->program.linked && build->shader && !superseded)
+            {
+                build->shader->replaceProgram(build->program.program);
+                swappedGeneration[build->shader] = build->generation;
+                // an edit may have added an #include
+                build->shader->sourceFiles = build->sources.files;
+                for (unsigned int j = 0; j < build->sources.files.size(); j++)
+                    watcher.watch(build->sources.files[j]);
+                double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - build->started).count();
+                ProgramBinaryCache::instance().save(build->binaryKey, build->program.program, milliseconds);
+                cout << "SHADER_RELOAD:: reloaded " << build->shader->sourcePaths[0] << " in " << static_cast<int>(milliseconds + 0.5) << " ms" << endl;
+                counters.reloads++;
+                swapped++;
+            }
+            else
+            {
+                if (!build->program.linked)
+                {
+                    cout << "SHADER_RELOAD:: " << build->program.log << "keeping the program as it was" << endl;
+                    counters.failures++;
+                }
+                if (build->program.program)
+                    glDeleteProgram(build->program.program);
+            }
+            delete build;
+            builds.erase(builds.begin() + i);
+        }
+        return swapped;
+    }
+
+    Stats stats() const { return counters; }
+
+    // stops the compile thread and drops the rebuilds in flight. Call it before the GL context goes away.
+    void clear()
+    {
+        stopWorker();
+        completed.drain([](Build *build) { build->done = true; });
+        for (unsigned int i = 0; i < builds.size(); i++)
+        {
+            if (builds[i]->program.program)
+                glDeleteProgram(builds[i]->program.program);
+            delete builds[i];
+        }
+        builds.clear();
+        jobs.clear();
+        watched.clear();
+        swappedGeneration.clear();
+    }
+
+private:
+    struct Build
+    {
+        Shader *shader;             // null once unwatched
+        ProgramSources sources;
+        ProgramBuild program;
+        uint64_t binaryKey;
+        chrono::steady_clock::time_point started;
+        unsigned int generation;    // in the order the builds were started
+        bool done;
+    };
+
+    FileWatcher watcher;
+    vector<Shader*> watched;
+    vector<Build*> builds;          // in flight or done, oldest first
+    unsigned int nextGeneration;
+    unordered_map<Shader*, unsigned int> swappedGeneration;    // of the build each shader last swapped in
+    bool parallel;
+    Stats counters;
+    // the compile thread, if there is a compile context
+    thread worker;
+    mutex jobMutex;
+    condition_variable jobReady;
+    deque<Build*> jobs;
+    bool stopping;
+    MPSCQueue<Build*> completed;
+
+    ShaderReloader() : nextGeneration(1), parallel(false), stopping(false)
+    {
+        counters.reloads = counters.failures = 0;
+    }
+
+    void stopWorker()
+    {
+        if (!worker.joinable())
+            return;
+        {
+            lock_guard<mutex> lock(jobMutex);
+            stopping = true;
+        }
+        jobReady.notify_one();
+        worker.join();
+    }
+
+    void start(Shader *shader)
+    {
+        Build *build = new Build();
+        build->shader = shader;
+        build->started = chrono::steady_clock::now();
+        build->generation = nextGeneration++;
+        build->done = false;
+        // with the features the shader was built with (see shader_preprocessor.h)
+        build->sources = PreprocessProgram(shader->sourcePaths, shader->features);
+        vector<string> keySources = build->sources.stages;
+        keySources.resize(3);
+        ProgramBinaryCache &binaries = ProgramBinaryCache::instance();
+        build->binaryKey = binaries.enabled() ? binaries.key(keySources) : 0;
+        builds.push_back(build);
+
+        if (parallel)
+            build->program.start(build->sources.stages, binaries.enabled());
+        else if (worker.joinable())
+        {
+            {
+                lock_guard<mutex> lock(jobMutex);
+                jobs.push_back(build);
+            }
+            jobReady.notify_one();
+        }
+        else
+        {
+            build->program.start(build->sources.stages, binaries.enabled());
+            build->program.finish();
+            build->done = true;
+        }
+    }
+
+    // the compile thread: builds in its own context and hands them over once the GL thread may use them
+    void compileLoop()
+    {
+        for (;;)
+        {
+            Build *build;
+            {
+                unique_lock<mutex> lock(jobMutex);
+                jobReady.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping)
+                    return;
+                build = jobs.front();
+                jobs.pop_front();
+            }
+            build->program.start(build->sources.stages, ProgramBinaryCache::instance().enabled());
+            build->program.finish();
+            // the program has to be complete before another context uses it
+            glFinish();
+            completed.push(build);
+        }
+    }
+};
+
+#endif
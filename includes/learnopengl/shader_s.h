@@ -3,6 +3,8 @@
 
 #include <glad/glad.h>
 
+#include <learnopengl/shader_uniforms.h>
+
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -12,6 +14,8 @@ class Shader
 {
 public:
     unsigned int ID;
+    // the locations of its uniforms, read once it is linked
+    UniformTable uniforms;
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath)
@@ -64,6 +68,7 @@ public:
         glAttachShader(ID, fragment);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
+        uniforms.reflect(ID);
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(vertex);
         glDeleteShader(fragment);
@@ -74,21 +79,40 @@ public:
     { 
         glUseProgram(ID); 
     }
-    // utility uniform functions
+    // the handle of a uniform, looked up by name once so it can be set without one from then on (see set()).
+    // Reports a uniform whose GLSL type isn't T; one the program doesn't have is set as a no-op.
+    // ------------------------------------------------------------------------
+    template<typename T>
+    Uniform<T> uniform(const UniformName &name)
+    {
+        int slot = uniforms.resolve(name);
+        if (uniforms[slot].location >= 0 && !UniformTypeMatches(UniformType<T>::value, uniforms[slot].type))
+            std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH: " << uniforms[slot].name << std::endl;
+        return Uniform<T>(slot);
+    }
+    // sets a uniform by handle; the shader must be in use
+    // ------------------------------------------------------------------------
+    template<typename T>
+    void set(const Uniform<T> &uniform, const typename Uniform<T>::type &value) const
+    {
+        SetUniformValue(uniforms.location(uniform.slot), value);
+    }
+    // utility uniform functions, by name: literals are hashed at compile time (see UniformName) and the
+    // location comes from the table read at link time
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const
+    void setBool(const UniformName &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(uniforms.location(name), (int)value); 
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const
+    void setInt(const UniformName &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(uniforms.location(name), value); 
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const
+    void setFloat(const UniformName &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(uniforms.location(name), value); 
     }
 
 private:
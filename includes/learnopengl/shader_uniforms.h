@@ -0,0 +1,346 @@
+#ifndef SHADER_UNIFORMS_H
+#define SHADER_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// FNV-1a of a uniform name, written so constexpr can evaluate it (C++11 wants a single return statement)
+constexpr uint32_t UniformNameHash(const char *name, uint32_t hash = 2166136261u)
+{
+    return *name ? UniformNameHash(name + 1, (hash ^ uint32_t((unsigned char)*name)) * 16777619u) : hash;
+}
+
+// the name of a uniform together with its hash, which the shaders look it up by. Names written as string
+// literals are hashed at compile time (constexpr UniformName model("model"); makes sure of it), names put
+// together at run time when they are converted; neither builds a std::string. The text is borrowed, so keep
+// a UniformName no longer than the string it came from.
+struct UniformName
+{
+    const char *text;
+    uint32_t hash;
+
+    template<size_t N>
+    constexpr UniformName(const char (&literal)[N]) : text(literal), hash(UniformNameHash(literal)) {}
+    UniformName(const std::string &name) : text(name.c_str()), hash(UniformNameHash(name.c_str())) {}
+};
+
+// the GLSL type of the uniforms a C++ type sets
+template<typename T> struct UniformType;
+template<> struct UniformType<bool>      { static const GLenum value = GL_BOOL; };
+template<> struct UniformType<int>       { static const GLenum value = GL_INT; };
+template<> struct UniformType<float>     { static const GLenum value = GL_FLOAT; };
+template<> struct UniformType<glm::vec2> { static const GLenum value = GL_FLOAT_VEC2; };
+template<> struct UniformType<glm::vec3> { static const GLenum value = GL_FLOAT_VEC3; };
+template<> struct UniformType<glm::vec4> { static const GLenum value = GL_FLOAT_VEC4; };
+template<> struct UniformType<glm::mat2> { static const GLenum value = GL_FLOAT_MAT2; };
+template<> struct UniformType<glm::mat3> { static const GLenum value = GL_FLOAT_MAT3; };
+template<> struct UniformType<glm::mat4> { static const GLenum value = GL_FLOAT_MAT4; };
+
+// whether a uniform of GLSL type actual can be set as expected; samplers and bools are set as ints
+inline bool UniformTypeMatches(GLenum expected, GLenum actual)
+{
+    if(expected == actual)
+        return true;
+    if(expected != GL_INT)
+        return false;
+    return actual == GL_BOOL ||
+           (actual >= GL_SAMPLER_1D && actual <= GL_SAMPLER_2D_RECT_SHADOW) ||
+           (actual >= GL_SAMPLER_1D_ARRAY && actual <= GL_SAMPLER_CUBE_SHADOW) ||
+           (actual >= GL_INT_SAMPLER_1D && actual <= GL_UNSIGNED_INT_SAMPLER_BUFFER) ||
+           (actual >= GL_SAMPLER_2D_MULTISAMPLE && actual <= GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE_ARRAY);
+}
+
+// sets the uniform at location of the program in use; -1 is ignored, as GL does
+inline void SetUniformValue(GLint location, bool value)             { glUniform1i(location, (int)value); }
+inline void SetUniformValue(GLint location, int value)              { glUniform1i(location, value); }
+inline void SetUniformValue(GLint location, float value)            { glUniform1f(location, value); }
+inline void SetUniformValue(GLint location, const glm::vec2 &value) { glUniform2fv(location, 1, &value[0]); }
+inline void SetUniformValue(GLint location, const glm::vec3 &value) { glUniform3fv(location, 1, &value[0]); }
+inline void SetUniformValue(GLint location, const glm::vec4 &value) { glUniform4fv(location, 1, &value[0]); }
+inline void SetUniformValue(GLint location, const glm::mat2 &value) { glUniformMatrix2fv(location, 1, GL_FALSE, &value[0][0]); }
+inline void SetUniformValue(GLint location, const glm::mat3 &value) { glUniformMatrix3fv(location, 1, GL_FALSE, &value[0][0]); }
+inline void SetUniformValue(GLint location, const glm::mat4 &value) { glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]); }
+
+// sets the uniform at location of the program in use to the value of the one at fromLocation of program from,
+// both of GLSL type type (float and int types and their vectors and matrices; others are left alone)
+inline void CopyUniformValue(GLuint from, GLint fromLocation, GLint location, GLenum type)
+{
+    GLfloat floats[16];
+    GLint ints[4];
+    switch(type)
+    {
+    case GL_FLOAT:        glGetUniformfv(from, fromLocation, floats); glUniform1fv(location, 1, floats); break;
+    case GL_FLOAT_VEC2:   glGetUniformfv(from, fromLocation, floats); glUniform2fv(location, 1, floats); break;
+    case GL_FLOAT_VEC3:   glGetUniformfv(from, fromLocation, floats); glUniform3fv(location, 1, floats); break;
+    case GL_FLOAT_VEC4:   glGetUniformfv(from, fromLocation, floats); glUniform4fv(location, 1, floats); break;
+    case GL_FLOAT_MAT2:   glGetUniformfv(from, fromLocation, floats); glUniformMatrix2fv(location, 1, GL_FALSE, floats); break;
+    case GL_FLOAT_MAT3:   glGetUniformfv(from, fromLocation, floats); glUniformMatrix3fv(location, 1, GL_FALSE, floats); break;
+    case GL_FLOAT_MAT4:   glGetUniformfv(from, fromLocation, floats); glUniformMatrix4fv(location, 1, GL_FALSE, floats); break;
+    case GL_INT_VEC2:
+    case GL_BOOL_VEC2:    glGetUniformiv(from, fromLocation, ints); glUniform2iv(location, 1, ints); break;
+    case GL_INT_VEC3:
+    case GL_BOOL_VEC3:    glGetUniformiv(from, fromLocation, ints); glUniform3iv(location, 1, ints); break;
+    case GL_INT_VEC4:
+    case GL_BOOL_VEC4:    glGetUniformiv(from, fromLocation, ints); glUniform4iv(location, 1, ints); break;
+    default:
+        if(UniformTypeMatches(GL_INT, type)) // ints, bools and samplers
+        {
+            glGetUniformiv(from, fromLocation, ints);
+            glUniform1i(location, ints[0]);
+        }
+        break;
+    }
+}
+
+// a uniform of one shader, resolved by name once (Shader::uniform()) and set by handle from then on. It
+// refers to a slot of the shader's UniformTable rather than to a location, so it stays valid if the program
+// is linked again.
+template<typename T>
+struct Uniform
+{
+    typedef T type;
+    int slot;
+
+    Uniform() : slot(-1) {}
+    explicit Uniform(int slot) : slot(slot) {}
+};
+
+// the locations of the uniforms of a linked program by name, read from the program once it is linked so
+// setting a uniform never asks the driver for its location. Arrays are there under their name, with and
+// without [0], and with the index of each element.
+class UniformTable
+{
+public:
+    struct Slot
+    {
+        std::string name;
+        uint32_t hash;
+        GLint location;     // -1 if the program has no such uniform (any more)
+        GLenum type;
+    };
+
+    // reads the active uniforms of a linked program. Slots handed out before keep their index, with their
+    // new location.
+    void reflect(GLuint program)
+    {
+        for(unsigned int i = 0; i < slots.size(); i++)
+        {
+            slots[i].location = -1;
+            slots[i].type = 0;
+        }
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> buffer(maxLength > 0 ? maxLength : 1);
+        for(GLint i = 0; i < count; i++)
+        {
+            GLint size;
+            GLenum type;
+            glGetActiveUniform(program, i, (GLsizei)buffer.size(), NULL, &size, &type, &buffer[0]);
+            std::string name(&buffer[0]);
+            GLint location = glGetUniformLocation(program, name.c_str());
+            if(location < 0) // members of uniform blocks
+                continue;
+            define(name, location, type);
+            if(name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            {
+                std::string base = name.substr(0, name.size() - 3);
+                define(base, location, type);
+                for(GLint element = 1; element < size; element++)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    define(elementName, glGetUniformLocation(program, elementName.c_str()), type);
+                }
+            }
+        }
+    }
+
+    // the slot of a name, or -1 if it has none
+    int find(const UniformName &name) const
+    {
+        if(buckets.empty())
+            return -1;
+        size_t mask = buckets.size() - 1;
+        for(size_t i = name.hash & mask; buckets[i] >= 0; i = (i + 1) & mask)
+        {
+            const Slot &slot = slots[buckets[i]];
+            if(slot.hash == name.hash && slot.name.compare(name.text) == 0)
+                return buckets[i];
+        }
+        return -1;
+    }
+
+    // the slot of a name, given one (with location -1) if the program has no such uniform
+    int resolve(const UniformName &name)
+    {
+        int slot = find(name);
+        return slot >= 0 ? slot : add(name.text, name.hash);
+    }
+
+    GLint location(const UniformName &name) const
+    {
+        int slot = find(name);
+        return slot >= 0 ? slots[slot].location : -1;
+    }
+
+    GLint location(int slot) const { return slot >= 0 ? slots[slot].location : -1; }
+
+    const Slot &operator[](int slot) const { return slots[slot]; }
+    unsigned int size() const { return (unsigned int)slots.size(); }
+
+private:
+    std::vector<Slot> slots;
+    std::vector<int> buckets;   // open addressing on the hash, a power of two in size: slot index or -1
+
+    void define(const std::string &name, GLint location, GLenum type)
+    {
+        UniformName key(name);
+        int slot = find(key);
+        if(slot < 0)
+            slot = add(name, key.hash);
+        slots[slot].location = location;
+        slots[slot].type = type;
+    }
+
+    int add(const std::string &name, uint32_t hash)
+    {
+        Slot slot;
+        slot.name = name;
+        slot.hash = hash;
+        slot.location = -1;
+        slot.type = 0;
+        slots.push_back(slot);
+        // at most half full
+        if(buckets.size() < slots.size() * 2)
+        {
+            buckets.assign(std::max<size_t>(16, buckets.size() * 2), -1);
+            for(unsigned int i = 0; i + 1 < slots.size(); i++)
+                insert((int)i);
+        }
+        insert((int)slots.size() - 1);
+        return (int)slots.size() - 1;
+    }
+
+    void insert(int slot)
+    {
+        size_t mask = buckets.size() - 1;
+        size_t i = slots[slot].hash & mask;
+        while(buckets[i] >= 0)
+            i = (i + 1) & mask;
+        buckets[i] = slot;
+    }
+};
+
+// a member of a uniform block as the C++ struct mirroring it has it (see UNIFORM_BLOCK_MEMBER)
+struct UniformBlockMember
+{
+    const char *name;
+    GLenum type;
+    size_t offset;
+};
+
+#define UNIFORM_BLOCK_MEMBER(Struct, member, type) { #member, type, offsetof(Struct, member) }
+
+// The uniform blocks whose buffers stay bound to a fixed binding point (see UniformBuffer), by block name.
+// Shaders hand every program they link to bind(), which points the blocks it declares at their binding and
+// checks, through reflection, that the offsets and types of their members are the ones of the C++ struct:
+// a layout that drifted apart is reported when the program is built rather than read as garbage.
+// GL thread only.
+class UniformBlockRegistry
+{
+public:
+    static UniformBlockRegistry &instance()
+    {
+        static UniformBlockRegistry registry;
+        return registry;
+    }
+
+    // registers a block before the programs that use it are linked
+    void add(const std::string &name, GLuint binding, size_t size, const std::vector<UniformBlockMember> &members)
+    {
+        Block block;
+        block.name = name;
+        block.binding = binding;
+        block.size = size;
+        block.members = members;
+        blocks.push_back(block);
+    }
+
+    // binds the registered blocks program declares and verifies their layout; returns false on a mismatch
+    bool bind(GLuint program) const
+    {
+        bool matches = true;
+        for(unsigned int i = 0; i < blocks.size(); i++)
+        {
+            GLuint index = glGetUniformBlockIndex(program, blocks[i].name.c_str());
+            if(index == GL_INVALID_INDEX)
+                continue;
+            glUniformBlockBinding(program, index, blocks[i].binding);
+            matches = verify(program, index, blocks[i]) && matches;
+        }
+        return matches;
+    }
+
+private:
+    struct Block
+    {
+        std::string name;
+        GLuint binding;
+        size_t size;
+        std::vector<UniformBlockMember> members;
+    };
+
+    std::vector<Block> blocks;
+
+    static bool verify(GLuint program, GLuint index, const Block &block)
+    {
+        bool matches = true;
+        GLint dataSize = 0, count = 0, maxLength = 0;
+        glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &dataSize);
+        glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        if((size_t)dataSize > block.size)
+        {
+            std::cout << "ERROR::UNIFORM_BLOCK::SIZE_MISMATCH: " << block.name << " takes " << dataSize << " bytes, its struct " << block.size << std::endl;
+            matches = false;
+        }
+        if(count <= 0)
+            return matches;
+        std::vector<GLint> indices(count), offsets(count), types(count);
+        glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, &indices[0]);
+        glGetActiveUniformsiv(program, count, reinterpret_cast<const GLuint*>(&indices[0]), GL_UNIFORM_OFFSET, &offsets[0]);
+        glGetActiveUniformsiv(program, count, reinterpret_cast<const GLuint*>(&indices[0]), GL_UNIFORM_TYPE, &types[0]);
+        std::vector<GLchar> buffer(maxLength > 0 ? maxLength : 1);
+        for(GLint i = 0; i < count; i++)
+        {
+            glGetActiveUniformName(program, (GLuint)indices[i], (GLsizei)buffer.size(), NULL, &buffer[0]);
+            // members of blocks with an instance name come as Block.member, arrays as member[0]
+            std::string name(&buffer[0]);
+            if(name.compare(0, block.name.size() + 1, block.name + ".") == 0)
+                name = name.substr(block.name.size() + 1);
+            if(name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+                name.resize(name.size() - 3);
+            const UniformBlockMember *member = NULL;
+            for(unsigned int j = 0; j < block.members.size() && !member; j++)
+                if(name == block.members[j].name)
+                    member = &block.members[j];
+            if(!member)
+                std::cout << "ERROR::UNIFORM_BLOCK::UNKNOWN_MEMBER: " << block.name << "." << name << std::endl;
+            else if((size_t)offsets[i] != member->offset || (GLenum)types[i] != member->type)
+                std::cout << "ERROR::UNIFORM_BLOCK::LAYOUT_MISMATCH: " << block.name << "." << name << " is at offset " << offsets[i]
+                          << " in GLSL, " << member->offset << " in its struct" << std::endl;
+            matches = matches && member && (size_t)offsets[i] == member->offset && (GLenum)types[i] == member->type;
+        }
+        return matches;
+    }
+};
+
+#endif
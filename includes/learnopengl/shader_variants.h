@@ -0,0 +1,329 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/program_build.h>
+#include <learnopengl/program_cache.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/shader_preprocessor.h>
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// The variants of shaders, one for every set of features (see ShaderFeatures) a material asks for, built
+// once and handed out by get() from then on. Variants whose sources come out the same after preprocessing
+// (features the sources don't declare as keywords are left out of them) share one program.
+// Declare the variants that will be asked for and warm them up at startup or behind a loading screen:
+// all of them are preprocessed on the thread pool, loaded from the ProgramBinaryCache or handed to the
+// driver in one go, so it compiles them at the same time. A variant that wasn't declared is built when get()
+// first asks for it, stalling that frame; stats() counts those, and they are reported, so the declarations
+// can be completed.
+// GL thread only.
+class ShaderVariants
+{
+public:
+    struct Stats
+    {
+        unsigned int variants;      // variants handed out or ready to be
+        unsigned int programs;      // programs they share
+        unsigned int cached;        // programs loaded from the ProgramBinaryCache
+        unsigned int firstUse;      // programs get() compiled because their variants weren't warmed up
+        double warmUpMilliseconds;  // from beginWarmUp() until the last of its programs was done
+    };
+
+    static ShaderVariants &instance()
+    {
+        static ShaderVariants variants;
+        return variants;
+    }
+
+    // adds the variant of the shader made of these files with features to the ones warmed up
+    void declare(const string &vertexPath, const string &fragmentPath, const ShaderFeatures &features = ShaderFeatures(), const string &geometryPath = "")
+    {
+        Variant variant;
+        variant.paths = pathsOf(vertexPath, fragmentPath, geometryPath);
+        variant.features = features;
+        string key = keyOf(variant.paths, features);
+        if (shaders.count(key) == 0 && declaredKeys.count(key) == 0)
+        {
+            declaredKeys[key] = true;
+            declared.push_back(variant);
+        }
+    }
+
+    // starts building the declared variants that aren't built yet and returns how many programs that takes
+    unsigned int beginWarmUp()
+    {
+        vector<Variant> variants;
+        variants.swap(declared);
+        declaredKeys.clear();
+        if (variants.empty())
+            return 0;
+        if (builds.empty())
+            warmUpStart = chrono::steady_clock::now();
+        parallel = ParallelShaderCompileSupported();
+        // reading the files and resolving their includes doesn't need GL
+        vector<ProgramSources> sources(variants.size());
+        ThreadPool::shared().parallelFor(variants.size(), [&](size_t i)
+        {
+            sources[i] = PreprocessProgram(variants[i].paths, variants[i].features);
+        });
+        unsigned int started = 0;
+        for (unsigned int i = 0; i < variants.size(); i++)
+            started += add(variants[i], sources[i]);
+        if (builds.empty())
+            finishWarmUp();
+        else
+            warmingUp = true;
+        return started;
+    }
+
+    // moves the warm-up along and returns the number of programs still building (0 once it is done). Call it
+    // once per frame of a loading screen: with GL_KHR_parallel_shader_compile it never waits, otherwise it
+    // waits for one program per call (the driver compiled the others in the meantime).
+    unsigned int updateWarmUp()
+    {
+        for (unsigned int i = 0; i < builds.size(); )
+        {
+            if (!parallel || builds[i]->program.completed())
+            {
+                finish(builds[i]);
+                builds.erase(builds.begin() + i);
+                if (!parallel)
+                    break;
+            }
+            else
+                i++;
+        }
+        if (builds.empty() && warmingUp)
+            finishWarmUp();
+        return static_cast<unsigned int>(builds.size());
+    }
+
+    // builds every declared variant, returning once all of them are done
+    void warmUp()
+    {
+        beginWarmUp();
+        for (unsigned int i = 0; i < builds.size(); i++)
+            finish(builds[i]);
+        builds.clear();
+        if (warmingUp)
+            finishWarmUp();
+    }
+
+    // the shader of a variant. One that is still warming up is waited for; one that was never declared is
+    // built right away, which the frame asking for it waits for.
+    Shader &get(const string &vertexPath, const string &fragmentPath, const ShaderFeatures &features = ShaderFeatures(), const string &geometryPath = "")
+    {
+        vector<string> paths = pathsOf(vertexPath, fragmentPath, geometryPath);
+        string key = keyOf(paths, features);
+        unordered_map<string, Shader*>::iterator found = shaders.find(key);
+        if (found != shaders.end())
+            return *found->second;
+        if (building(key) == builds.size())
+        {
+            // it may still come out the same as one that was warmed up
+            Variant variant;
+            variant.paths = paths;
+            variant.features = features;
+            if (add(variant, PreprocessProgram(paths, features)))
+            {
+                cout << "SHADER_VARIANTS:: compiled " << paths[0] << " [" << features.key() << "] on first use, declare it to warm it up" << endl;
+                counters.firstUse++;
+            }
+        }
+        // its program, or one with the same sources, may still be compiling
+        unsigned int i = building(key);
+        if (i < builds.size())
+        {
+            Build *build = builds[i];
+            builds.erase(builds.begin() + i);
+            finish(build);
+            if (builds.empty() && warmingUp)
+                finishWarmUp();
+        }
+        return *shaders[key];
+    }
+
+    Stats stats() const { return counters; }
+
+    void printStats() const
+    {
+        cout << "SHADER_VARIANTS:: " << counters.variants << " variants in " << counters.programs << " programs ("
+             << counters.cached << " from the binary cache), warmed up in " << static_cast<int>(counters.warmUpMilliseconds + 0.5)
+             << " ms, " << counters.firstUse << " compiled on first use" << endl;
+    }
+
+    // deletes the programs; call it before the GL context goes away, and only once no Shader it handed out is used
+    void clear()
+    {
+        for (unsigned int i = 0; i < builds.size(); i++)
+        {
+            builds[i]->program.finish();
+            glDeleteProgram(builds[i]->program.program);
+            delete builds[i];
+        }
+        builds.clear();
+        for (unsigned int i = 0; i < owned.size(); i++)
+        {
+            glDeleteProgram(owned[i]->ID);
+            delete owned[i];
+        }
+        owned.clear();
+        shaders.clear();
+        bySource.clear();
+        declared.clear();
+        declaredKeys.clear();
+        warmingUp = false;
+    }
+
+private:
+    struct Variant
+    {
+        vector<string> paths;
+        ShaderFeatures features;
+    };
+
+    struct Build
+    {
+        vector<string> paths;
+        ProgramSources sources;
+        uint64_t sourceHash;
+        uint64_t binaryKey;
+        ProgramBuild program;
+        chrono::steady_clock::time_point started;
+        vector<string> keys;        // the variants waiting for it
+    };
+
+    vector<Variant> declared;                       // not warmed up yet
+    unordered_map<string, bool> declaredKeys;
+    unordered_map<string, Shader*> shaders;         // by variant key
+    unordered_map<uint64_t, Shader*> bySource;      // by the hash of their preprocessed sources
+    vector<Shader*> owned;
+    vector<Build*> builds;                          // compiling, oldest first
+    bool parallel;
+    bool warmingUp;
+    chrono::steady_clock::time_point warmUpStart;
+    Stats counters;
+
+    ShaderVariants() : parallel(false), warmingUp(false)
+    {
+        counters.variants = counters.programs = counters.cached = counters.firstUse = 0;
+        counters.warmUpMilliseconds = 0.0;
+    }
+
+    static vector<string> pathsOf(const string &vertexPath, const string &fragmentPath, const string &geometryPath)
+    {
+        vector<string> paths;
+        paths.push_back(vertexPath);
+        paths.push_back(fragmentPath);
+        if (!geometryPath.empty())
+            paths.push_back(geometryPath);
+        return paths;
+    }
+
+    // the permutation key of a variant: its files and the features asked for
+    static string keyOf(const vector<string> &paths, const ShaderFeatures &features)
+    {
+        string key;
+        for (unsigned int i = 0; i < paths.size(); i++)
+            key += paths[i] + '\n';
+        return key + features.key();
+    }
+
+    // finds a variant a program with the same sources, or gets one: from the binary cache right away, or
+    // started compiling (appended to builds). Returns 1 for a program started, 0 otherwise.
+    unsigned int add(const Variant &variant, const ProgramSources &sources)
+    {
+        string key = keyOf(variant.paths, variant.features);
+        if (shaders.count(key))
+            return 0;
+        counters.variants++;
+        uint64_t sourceHash = sources.hash();
+        unordered_map<uint64_t, Shader*>::iterator same = bySource.find(sourceHash);
+        if (same != bySource.end())
+        {
+            shaders[key] = same->second;
+            return 0;
+        }
+        for (unsigned int i = 0; i < builds.size(); i++)
+            if (builds[i]->sourceHash == sourceHash)
+            {
+                builds[i]->keys.push_back(key);
+                return 0;
+            }
+
+        counters.programs++;
+        ProgramBinaryCache &binaries = ProgramBinaryCache::instance();
+        vector<string> keySources = sources.stages;
+        keySources.resize(3);
+        uint64_t binaryKey = binaries.enabled() ? binaries.key(keySources) : 0;
+        GLuint program = glCreateProgram();
+        if (binaries.load(binaryKey, program))
+        {
+            counters.cached++;
+            adopt(program, variant.paths, sources, sourceHash, vector<string>(1, key));
+            return 0;
+        }
+        glDeleteProgram(program);
+
+        Build *build = new Build();
+        build->paths = variant.paths;
+        build->sources = sources;
+        build->sourceHash = sourceHash;
+        build->binaryKey = binaryKey;
+        build->keys.push_back(key);
+        build->started = chrono::steady_clock::now();
+        build->program.start(sources.stages, binaries.enabled());
+        builds.push_back(build);
+        return 1;
+    }
+
+    // the index among builds of the one variant key is waiting for, builds.size() if none
+    unsigned int building(const string &key) const
+    {
+        for (unsigned int i = 0; i < builds.size(); i++)
+            if (find(builds[i]->keys.begin(), builds[i]->keys.end(), key) != builds[i]->keys.end())
+                return i;
+        return static_cast<unsigned int>(builds.size());
+    }
+
+    // collects a build, waiting for the driver if it isn't done, and hands its program to its variants
+    void finish(Build *build)
+    {
+        build->program.finish();
+        if (build->program.linked)
+        {
+            double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - build->started).count();
+            ProgramBinaryCache::instance().save(build->binaryKey, build->program.program, milliseconds);
+        }
+        else
+            cout << "SHADER_VARIANTS:: " << build->paths[0] << " [" << build->sources.features.key() << "]\n" << build->program.log << endl;
+        adopt(build->program.program, build->paths, build->sources, build->sourceHash, build->keys);
+        delete build;
+    }
+
+    void adopt(GLuint program, const vector<string> &paths, const ProgramSources &sources, uint64_t sourceHash, const vector<string> &keys)
+    {
+        Shader *shader = new Shader(program, paths, sources);
+        owned.push_back(shader);
+        bySource[sourceHash] = shader;
+        for (unsigned int i = 0; i < keys.size(); i++)
+            shaders[keys[i]] = shader;
+    }
+
+    void finishWarmUp()
+    {
+        counters.warmUpMilliseconds += chrono::duration<double, milli>(chrono::steady_clock::now() - warmUpStart).count();
+        warmingUp = false;
+    }
+};
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef TEXTURE_BUDGET_H
+#define TEXTURE_BUDGET_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+// Keeps the GPU memory of textures within a byte budget. The TextureCache and the MaterialAtlas register as
+// sources: they report how much their textures have resident and offer the ones that can give mips back,
+// which are the streamed textures and the atlas pages (they keep their mip chains in client memory; other
+// textures count, but stay as they are). Mesh::Draw marks the textures it binds as used in the current frame.
+// Whenever the total goes over budget the finest mips of the least recently used textures go first, down to
+// their last (1x1) mip, where a texture counts as evicted; it comes back once it is drawn and asks for more.
+// Loads of finer mips have to reserve() their size first. They only get room at the expense of textures used
+// longer ago, so the textures on screen don't take mips from each other.
+// GL thread only.
+class TextureBudget
+{
+public:
+    // a texture that can give mips back
+    struct Candidate
+    {
+        unsigned int lastUsed;      // frame it was last drawn in
+        int levels;                 // mips it can still drop
+        function<size_t()> demote;  // drops its finest resident mip, returning the bytes freed
+    };
+
+    struct Source
+    {
+        function<size_t()> residentBytes;
+        function<void(vector<Candidate>&)> candidates;
+    };
+
+    struct Stats
+    {
+        size_t budget;              // 0 for none
+        size_t residentBytes;       // of all sources
+        size_t peakResidentBytes;   // highest residentBytes seen by update()
+        size_t pendingBytes;        // reserved for loads in flight
+        unsigned int demotions;     // mips dropped to stay within budget
+        unsigned int evictions;     // textures dropped down to their last mip
+    };
+
+    static TextureBudget &instance()
+    {
+        static TextureBudget budget;
+        return budget;
+    }
+
+    // the most the resident mips of all textures may take; 0 (the default) for no limit
+    void setBudget(size_t bytes) { budgetBytes = bytes; }
+
+    void addSource(const Source &source) { sources.push_back(source); }
+
+    // the frame draws are marked with; advanced by update()
+    unsigned int frame() const { return currentFrame; }
+
+    size_t residentBytes() const
+    {
+        size_t total = 0;
+        for (unsigned int i = 0; i < sources.size(); i++)
+            total += sources[i].residentBytes();
+        return total;
+    }
+
+    // asks for room for a load of bytes more, for a texture last drawn in frame lastUsed, making it by demoting
+    // textures drawn before that if need be. Returns false, and reserves nothing, if there isn't enough.
+    bool reserve(size_t bytes, unsigned int lastUsed)
+    {
+        if (budgetBytes > 0)
+        {
+            size_t total = residentBytes() + pendingBytes;
+            if (total + bytes > budgetBytes)
+                total = shrink(total, bytes > budgetBytes ? 0 : budgetBytes - bytes, lastUsed);
+            if (total + bytes > budgetBytes)
+                return false;
+        }
+        pendingBytes += bytes;
+        return true;
+    }
+
+    // hands back a reservation once its load is resident (or was given up)
+    void release(size_t bytes) { pendingBytes -= std::min(bytes, pendingBytes); }
+
+    // call once per frame, after the sources streamed their mips: records the peak and demotes the least
+    // recently used textures while the total is over budget (if it got there through new textures, or a
+    // smaller budget). Then starts the next frame.
+    void update()
+    {
+        size_t total = residentBytes();
+        peakBytes = std::max(peakBytes, total);
+        if (budgetBytes > 0 && total + pendingBytes > budgetBytes)
+            shrink(total + pendingBytes, budgetBytes, currentFrame + 1);
+        currentFrame++;
+    }
+
+    Stats stats() const
+    {
+        Stats s;
+        s.budget = budgetBytes;
+        s.residentBytes = residentBytes();
+        s.peakResidentBytes = std::max(peakBytes, s.residentBytes);
+        s.pendingBytes = pendingBytes;
+        s.demotions = demotions;
+        s.evictions = evictions;
+        return s;
+    }
+
+    void printStats() const
+    {
+        Stats s = stats();
+        cout << "TEXTURE_BUDGET:: " << s.residentBytes / (1024 * 1024) << " MB resident (peak " << s.peakResidentBytes / (1024 * 1024) << " MB) of ";
+        if (s.budget > 0)
+            cout << s.budget / (1024 * 1024) << " MB";
+        else
+            cout << "no budget";
+        cout << ", " << s.demotions << " mips dropped, " << s.evictions << " textures evicted" << endl;
+    }
+
+private:
+    vector<Source> sources;
+    size_t budgetBytes, pendingBytes, peakBytes;
+    unsigned int currentFrame;  // starts at 1, so textures never drawn (frame 0) are the oldest
+    unsigned int demotions, evictions;
+
+    TextureBudget() : budgetBytes(0), pendingBytes(0), peakBytes(0), currentFrame(1), demotions(0), evictions(0) {}
+
+    // demotes textures last drawn before frame `before`, least recently used first and each as far as it
+    // takes, until total is down to target. Returns the new total.
+    size_t shrink(size_t total, size_t target, unsigned int before)
+    {
+        vector<Candidate> candidates;
+        for (unsigned int i = 0; i < sources.size(); i++)
+            sources[i].candidates(candidates);
+        stable_sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) { return a.lastUsed < b.lastUsed; });
+        for (unsigned int i = 0; i < candidates.size() && total > target && candidates[i].lastUsed < before; i++)
+        {
+            Candidate &candidate = candidates[i];
+            while (total > target && candidate.levels > 0)
+            {
+                total -= std::min(total, candidate.demote());
+                demotions++;
+                if (--candidate.levels == 0)
+                    evictions++;
+            }
+        }
+        return total;
+    }
+};
+
+#endif
@@ -0,0 +1,957 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <learnopengl/hash.h>
+#include <learnopengl/jpeg_decoder.h>
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/mip_generator.h>
+#include <learnopengl/mip_stream.h>
+#include <learnopengl/texture_budget.h>
+#include <learnopengl/texture_compression.h>
+#include <learnopengl/texture_upload.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// decoded pixels of a texture file, kept in client memory until they are uploaded.
+struct TextureImage {
+    unsigned char *data;
+    int width, height, nrComponents;
+};
+
+// decodes an encoded image (jpg, png, ...) held in memory, without touching GL. Baseline JPEGs go through the
+// parallel decoder of jpeg_decoder.h, everything else (and whatever it turns down) through stb_image; either
+// way the pixels are freed with stbi_image_free.
+inline bool LoadTextureImageFromMemory(const char *bytes, size_t size, TextureImage &image)
+{
+    image.width = image.height = image.nrComponents = 0;
+    image.data = DecodeJPEG(reinterpret_cast<const unsigned char*>(bytes), size, image.width, image.height, image.nrComponents);
+    if (!image.data)
+        image.data = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(bytes), static_cast<int>(size), &image.width, &image.height, &image.nrComponents, 0);
+    return image.data != nullptr;
+}
+
+// turns 8-bit pixels with 1 to 4 channels into RGB, or RGBA if they have alpha that isn't opaque everywhere, so
+// textures share the pages of a MaterialAtlas no matter how their files were saved. Returns the new channel count.
+inline int ColorChannels(vector<unsigned char> &pixels, int channels)
+{
+    size_t count = pixels.size() / channels;
+    bool alpha = false;
+    if ((channels & 1) == 0)
+        for (size_t p = 0; p < count && !alpha; p++)
+            alpha = pixels[p * channels + channels - 1] != 255;
+    int result = alpha ? 4 : 3;
+    if (channels == result)
+        return result;
+    vector<unsigned char> converted(count * result);
+    for (size_t p = 0; p < count; p++)
+    {
+        const unsigned char *in = &pixels[p * channels];
+        unsigned char *out = &converted[p * result];
+        for (int c = 0; c < 3; c++)
+            out[c] = in[channels < 3 ? 0 : c];
+        if (alpha)
+            out[3] = in[channels - 1];
+    }
+    pixels.swap(converted);
+    return result;
+}
+
+// quality presets for TextureLoadPolicy::preset(), by the largest width or height a texture keeps
+enum TextureQuality
+{
+    TEXTURE_QUALITY_LOW = 1024,
+    TEXTURE_QUALITY_MEDIUM = 2048,
+    TEXTURE_QUALITY_HIGH = 4096,
+    TEXTURE_QUALITY_FULL = 0    // as large as the files are
+};
+
+// JPEG compresses the color of gray images into chroma that decodes a step or two off gray
+const int TEXTURE_GRAYSCALE_TOLERANCE = 2;
+
+// how TextureCache turns decoded images into textures (see TextureCache::setLoadPolicy()). The default keeps
+// them as they are.
+struct TextureLoadPolicy
+{
+    int maxSize;            // largest width or height; larger images are scaled down to it, 0 for no limit
+    bool detectGrayscale;   // store RGB(A) images that are gray as R8 (RG8 with alpha), sampled as gray
+
+    TextureLoadPolicy() : maxSize(0), detectGrayscale(false) {}
+
+    static TextureLoadPolicy preset(TextureQuality quality)
+    {
+        TextureLoadPolicy policy;
+        policy.maxSize = quality;
+        policy.detectGrayscale = true;
+        return policy;
+    }
+};
+
+// fits width x height into maxSize, keeping the aspect ratio; leaves it alone if it does already
+inline void CapTextureSize(int &width, int &height, int maxSize)
+{
+    int largest = std::max(width, height);
+    if (maxSize <= 0 || largest <= maxSize)
+        return;
+    width = std::max(1, int((int64_t(width) * maxSize + largest / 2) / largest));
+    height = std::max(1, int((int64_t(height) * maxSize + largest / 2) / largest));
+}
+
+// turns 8-bit RGB(A) pixels whose color channels are all within tolerance of each other into gray (with
+// alpha), taking the green channel. Returns the new channel count, or channels as they were, with gray
+// untouched, if the pixels have color (which the first colored pixel decides, so that is quick).
+inline int GrayscaleChannels(const unsigned char *pixels, size_t count, int channels, int tolerance, vector<unsigned char> &gray)
+{
+    if (channels < 3)
+        return channels;
+    for (size_t p = 0; p < count; p++)
+    {
+        const unsigned char *in = pixels + p * channels;
+        if (std::abs(in[0] - in[1]) > tolerance || std::abs(in[2] - in[1]) > tolerance)
+            return channels;
+    }
+    int result = channels - 2;
+    gray.resize(count * result);
+    for (size_t p = 0; p < count; p++)
+    {
+        gray[p * result] = pixels[p * channels + 1];
+        if (result == 2)
+            gray[p * result + 1] = pixels[p * channels + 3];
+    }
+    return result;
+}
+
+// channel layouts for TextureCache::acquirePacked(), with a letter per channel of the packed texture: r, g, b or a
+// for that channel of the base image, R, G, B or A for one of the image packed into it, L for the luminance of
+// the packed image, and 0 or 1 for black or white. Gray images read the same from r, g and b, and images
+// without alpha as opaque. This one puts a specular map into the alpha of its diffuse map.
+const char *const TEXTURE_PACK_SPECULAR_IN_ALPHA = "rgbL";
+
+// packs two 8-bit images with the same number of pixels into one with a channel per letter of layout (see
+// TEXTURE_PACK_SPECULAR_IN_ALPHA). Returns false, leaving out alone, if the layout isn't one.
+inline bool PackImageChannels(const unsigned char *base, int baseChannels, const unsigned char *packed, int packedChannels,
+                              size_t count, const string &layout, vector<unsigned char> &out)
+{
+    enum { CONSTANT, BASE, PACKED, LUMINANCE };
+    int channels = static_cast<int>(layout.size());
+    if (channels < 1 || channels > 4)
+        return false;
+    int source[4], offset[4];
+    for (int c = 0; c < channels; c++)
+    {
+        const char *letters = "rgbaRGBA";
+        const char *letter = strchr(letters, layout[c]);
+        if (layout[c] == 'L')
+        {
+            source[c] = packedChannels < 3 ? PACKED : LUMINANCE;
+            offset[c] = 0;
+        }
+        else if (layout[c] == '0' || layout[c] == '1')
+        {
+            source[c] = CONSTANT;
+            offset[c] = layout[c] == '1' ? 255 : 0;
+        }
+        else if (letter && layout[c] != '\0')
+        {
+            int index = static_cast<int>(letter - letters);
+            int imageChannels = index < 4 ? baseChannels : packedChannels;
+            source[c] = index < 4 ? BASE : PACKED;
+            index &= 3;
+            if (index < 3)
+                offset[c] = imageChannels < 3 ? 0 : index;
+            else if ((imageChannels & 1) == 0)
+                offset[c] = imageChannels - 1;
+            else
+            {
+                source[c] = CONSTANT;
+                offset[c] = 255;
+            }
+        }
+        else
+            return false;
+    }
+
+    out.resize(count * channels);
+    for (size_t p = 0; p < count; p++)
+    {
+        const unsigned char *in[2] = { base + p * baseChannels, packed + p * packedChannels };
+        for (int c = 0; c < channels; c++)
+        {
+            unsigned char value;
+            if (source[c] == LUMINANCE)
+                value = static_cast<unsigned char>((77 * in[1][0] + 150 * in[1][1] + 29 * in[1][2] + 128) >> 8);
+            else if (source[c] == CONSTANT)
+                value = static_cast<unsigned char>(offset[c]);
+            else
+                value = in[source[c] == PACKED][offset[c]];
+            out[p * channels + c] = value;
+        }
+    }
+    return true;
+}
+
+// the GL formats of 8-bit pixels with 1 to 4 channels; with gamma set RGB(A) is sampled as sRGB
+inline void MipChainFormat(int channels, bool gamma, GLenum &internalFormat, GLenum &format)
+{
+    if (channels == 1)
+        format = GL_RED;
+    else if (channels == 2)
+        format = GL_RG;
+    else if (channels == 3)
+        format = GL_RGB;
+    else
+        format = GL_RGBA;
+    // sized, as glTexStorage2D needs them
+    const GLenum sized[4] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+    internalFormat = sized[channels - 1];
+    if (gamma && channels >= 3)
+        internalFormat = channels == 3 ? GL_SRGB8 : GL_SRGB8_ALPHA8;
+}
+
+// makes a bound texture with one or two channels sample as gray (with alpha), as GL_LUMINANCE(_ALPHA) used to
+inline void SetGraySwizzle(GLenum target, int channels)
+{
+    if (channels > 2)
+        return;
+    GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, channels == 2 ? GL_GREEN : GL_ONE };
+    glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+}
+
+// uploads levels [first, last) of a mip chain built on the CPU into the bound texture, as the same levels.
+// With gamma set RGB(A) textures are sampled as sRGB. With staging the levels are read from there, where they
+// were copied to back to back (see TextureUploadRing); with allocated set the texture has immutable storage
+// for them already.
+inline void UploadMipLevels(const MipChain &chain, bool gamma, int first, int last, const TextureStaging *staging = nullptr, bool allocated = false)
+{
+    GLenum internalFormat, format;
+    MipChainFormat(chain.channels, gamma, internalFormat, format);
+
+    // the rows of small RGB levels aren't 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int i = first; i < last; i++)
+    {
+        const void *data = StagedPointer(chain.data(i), chain.data(first), staging);
+        if (allocated)
+            glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, chain.levels[i].width, chain.levels[i].height, format, GL_UNSIGNED_BYTE, data);
+        else
+            glTexImage2D(GL_TEXTURE_2D, i, internalFormat, chain.levels[i].width, chain.levels[i].height, 0, format, GL_UNSIGNED_BYTE, data);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+// creates a GL texture from a mip chain built on the CPU and frees it. With gamma set RGB(A) textures are
+// sampled as sRGB.
+inline unsigned int TextureFromMipChain(MipChain &chain, bool gamma = false)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+
+    if (!chain.levels.empty())
+    {
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        // immutable storage where there is: allocated once and complete, so GL has nothing to check at draws
+        bool immutable = ImmutableTextureStorageSupported();
+        if (immutable)
+        {
+            GLenum internalFormat, format;
+            MipChainFormat(chain.channels, gamma, internalFormat, format);
+            glTexStorage2D(GL_TEXTURE_2D, static_cast<GLsizei>(chain.levels.size()), internalFormat, chain.levels[0].width, chain.levels[0].height);
+        }
+        UploadMipLevels(chain, gamma, 0, static_cast<int>(chain.levels.size()), nullptr, immutable);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(chain.levels.size()) - 1);
+        SetGraySwizzle(GL_TEXTURE_2D, chain.channels);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        chain.clear();
+    }
+
+    return textureID;
+}
+
+// creates a GL texture from decoded pixels and frees them. The mips are box filtered on the CPU, in linear
+// space for sRGB (gamma) images.
+inline unsigned int TextureFromImage(TextureImage &image, bool gamma = false)
+{
+    MipChain chain;
+    if (image.data)
+    {
+        GenerateMipChain(image.data, image.width, image.height, image.nrComponents, gamma, MIP_FILTER_BOX, chain);
+        stbi_image_free(image.data);
+        image.data = nullptr;
+    }
+    return TextureFromMipChain(chain, gamma);
+}
+
+// one GL texture shared by every mesh (of every model) that references the same image contents.
+// Owned through shared_ptr: when the last reference goes away the GL texture is deleted, so the last
+// reference must be dropped on the thread that owns the GL context.
+struct CachedTexture
+{
+    unsigned int id;        // 0 until TextureCache::upload()
+    string path;            // canonical path of the file it was first loaded from
+    bool gamma;
+    int width, height, nrComponents;
+    size_t bytes;           // size of its mip chain, compressed or not
+    MipChain mips;          // decoded pixels waiting for upload, with their mips
+    CompressedImage compressed; // or the compressed mip chain, if the cache compresses textures
+    // streaming (see TextureCache::enableStreaming): which of its mips are on the GPU. Without streaming
+    // all levels are resident.
+    bool streamed;
+    MipStream stream;
+    size_t residentBytes;   // GPU size of the resident mips
+
+private:
+    friend class TextureCache;
+    uint64_t contentKey;
+    vector<string> pathKeys;
+    once_flag decoded;
+    string resampleSize;    // ".<width>x<height>" if the image is resampled to that size, empty if not
+    int resampleWidth, resampleHeight;
+    string packedPath;      // canonical path of the image packed into this one with packLayout, empty if none
+    string packLayout;
+};
+
+// Process-wide texture cache. Lookups are O(1): by canonical path first (valid while the file's size
+// and mtime are unchanged), then by content hash, so the same image under another name or in another
+// directory is shared as well.
+// Mips are generated on the CPU with the filter of setMipFilter() (see mip_generator.h), in linear space for
+// textures acquired with gamma set. The TextureLoadPolicy of setLoadPolicy() caps their size and stores gray
+// images with one channel.
+// With enableCompression() textures are compressed to DXT1/DXT5 with a full mip chain the first time they
+// are decoded (see texture_compression.h), and the result is kept as a DDS file that later runs load instead.
+// With enableStreaming() only the coarse mips go to the GPU at first. Each frame the render loop asks for
+// the mips the textures need at their size on screen with request(), and update() pages the finer ones in
+// on the thread pool (into the TextureUploadRing, if it is on), uploads them and drops them again once they
+// aren't asked for any more. Streamed textures
+// also give mips back to the TextureBudget when it runs out, least recently drawn (see use()) first.
+class TextureCache
+{
+public:
+    struct Stats
+    {
+        unsigned int hits;
+        unsigned int misses;
+        size_t bytesSaved;      // decoded bytes that hits did not have to decode and upload again
+        unsigned int textures;  // currently alive
+        size_t bytes;           // size of the textures currently alive
+        size_t residentBytes;   // GPU size of their resident mips; less than bytes when streaming
+    };
+
+    static TextureCache &instance()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    // returns the shared texture for the image at path, decoding it if no one holds it yet. Thread-safe and
+    // GL free: call upload() on the GL thread before using the id.
+    // With width and height set the image is resampled to that size (with the mip filter) and made RGB(A) (see
+    // ColorChannels()) before its mips are made, as the layers of a MaterialAtlas need it; that is a texture
+    // of its own.
+    shared_ptr<CachedTexture> acquire(const string &path, bool gamma = false, int width = 0, int height = 0)
+    {
+        return acquireEntry(path, "", "", gamma, width, height);
+    }
+
+    // like acquire(), for the image at path with the one at packedPath packed into it with a channel layout
+    // (see TEXTURE_PACK_SPECULAR_IN_ALPHA): one texture, decoded, uploaded and bound once, where there would
+    // be two. The packed image is resampled to the size of the first if it differs; with gamma set keep it in
+    // alpha, which sRGB textures filter and sample as linear. With compression the packed texture is cooked
+    // into a DDS file of its own, so later runs load one file instead of decoding two.
+    shared_ptr<CachedTexture> acquirePacked(const string &path, const string &packedPath, const string &layout = TEXTURE_PACK_SPECULAR_IN_ALPHA,
+                                            bool gamma = false, int width = 0, int height = 0)
+    {
+        return acquireEntry(path, canonicalPath(packedPath), layout, gamma, width, height);
+    }
+
+    // creates the GL texture of an acquired entry if no one did yet and returns its id. GL thread only.
+    unsigned int upload(CachedTexture &texture)
+    {
+        if (texture.id != 0)
+            return texture.id;
+        if (!texture.streamed)
+        {
+            texture.id = texture.compressed.format != 0 ? TextureFromCompressedImage(texture.compressed, texture.gamma)
+                                                        : TextureFromMipChain(texture.mips, texture.gamma);
+            texture.residentBytes = texture.bytes;
+        }
+        else
+        {
+            // only the coarse mips for now; the chain stays in client memory (or mapped) for update()
+            glGenTextures(1, &texture.id);
+            glBindTexture(GL_TEXTURE_2D, texture.id);
+            uploadLevels(texture, texture.stream.coarseLevel, texture.stream.levels);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.stream.coarseLevel);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.stream.levels - 1);
+            if (texture.compressed.format == 0)
+                SetGraySwizzle(GL_TEXTURE_2D, texture.mips.channels);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            texture.residentBytes = levelBytes(texture, texture.stream.coarseLevel, texture.stream.levels);
+        }
+        lock_guard<mutex> lock(cacheMutex);
+        counters.residentBytes += texture.residentBytes;
+        unordered_map<uint64_t, weak_ptr<CachedTexture> >::iterator it = byContent.find(texture.contentKey);
+        if (texture.streamed && it != byContent.end())
+            streaming.push_back(it->second);
+        return texture.id;
+    }
+
+    // marks a texture as drawn in the current frame, for the TextureBudget. GL thread only.
+    void use(CachedTexture &texture)
+    {
+        texture.stream.lastUsed = TextureBudget::instance().frame();
+    }
+
+    // asks for the mips a streamed texture needs when its width is spread over texelsAcross pixels on screen;
+    // the finest request since the last update() wins. GL thread only (like update()).
+    void request(CachedTexture &texture, float texelsAcross)
+    {
+        if (!texture.streamed || texture.id == 0)
+            return;
+        texture.stream.request(texture.width, texelsAcross);
+    }
+
+    // streams the mips asked for since the last call: starts background loads for finer mips, uploads the
+    // loads that finished (until maxUploadBytes are uploaded; the rest waits for the next call) and drops
+    // fine mips no one asked for in a while. Call once per frame on the GL thread; returns the number of
+    // textures that got finer mips.
+    unsigned int update(size_t maxUploadBytes = 16 * 1024 * 1024)
+    {
+        vector<shared_ptr<CachedTexture> > textures;
+        {
+            lock_guard<mutex> lock(cacheMutex);
+            for (unsigned int i = 0; i < streaming.size(); )
+            {
+                shared_ptr<CachedTexture> texture = streaming[i].lock();
+                if (texture)
+                {
+                    textures.push_back(texture);
+                    i++;
+                }
+                else
+                {
+                    streaming[i] = streaming.back();
+                    streaming.pop_back();
+                }
+            }
+        }
+
+        unsigned int streamed = 0;
+        size_t uploaded = 0;
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            StreamedTexture target(*this, *textures[i]);
+            textures[i]->stream.update(target, maxUploadBytes, uploaded, streamed);
+        }
+        return streamed;
+    }
+
+    // compresses every texture decoded from now on; call it on the GL thread before loading anything.
+    // The DDS files go next to the images, or into cacheDirectory (which must exist) if one is given.
+    // Returns false, and keeps textures uncompressed, if the GL context can't sample S3TC textures.
+    bool enableCompression(const string &cacheDirectory = "")
+    {
+        if (!TextureCompressionSupported())
+        {
+            cout << "TEXTURE_CACHE:: S3TC texture compression is not supported, textures stay uncompressed" << endl;
+            return false;
+        }
+        lock_guard<mutex> lock(cacheMutex);
+        compression = true;
+        compressionDirectory = cacheDirectory;
+        return true;
+    }
+
+    // streams every texture decoded from now on, starting with only the mips no larger than residentSize on
+    // the GPU (see update()). The mips stay in client memory, or mapped from their DDS files with compression.
+    void enableStreaming(int residentSize = 256)
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        streamResidentSize = residentSize;
+    }
+
+    // the filter for the mips of every texture decoded from now on; MIP_FILTER_BOX by default.
+    void setMipFilter(MipFilter filter)
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        mipFilter = filter;
+    }
+
+    // how every texture acquired from now on is loaded: images larger than policy.maxSize are scaled down with
+    // the mip filter (see ScaleImage()), atlas layers included, and with policy.detectGrayscale gray images
+    // become R8 textures. That leaves out textures acquired with gamma set (GL 3.3 has no sRGB R8) and ones
+    // the cache compresses (DXT1 takes half the memory of R8) or resamples for a MaterialAtlas (whose
+    // layers are RGB(A)).
+    void setLoadPolicy(const TextureLoadPolicy &policy)
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        loadPolicy = policy;
+    }
+
+    Stats stats()
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        return counters;
+    }
+
+    void printStats()
+    {
+        Stats s = stats();
+        cout << "TEXTURE_CACHE:: " << s.textures << " textures (" << s.bytes / (1024 * 1024) << " MB, "
+             << s.residentBytes / (1024 * 1024) << " MB resident), "
+             << s.hits << " hits, " << s.misses << " misses, " << s.bytesSaved / (1024 * 1024) << " MB saved" << endl;
+    }
+
+    // the size of the mips no larger than the one textures are streamed from, 0 without streaming
+    int streamingResidentSize()
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        return streamResidentSize;
+    }
+
+    // the client memory of mips [first, last) of a texture that wasn't uploaded with upload(), or is streamed.
+    // The mips are stored finest first and back to back.
+    static void levelRange(const CachedTexture &texture, int first, int last, const unsigned char *&data, size_t &size)
+    {
+        if (texture.compressed.format != 0)
+        {
+            data = texture.compressed.levels[first].data;
+            size = texture.compressed.levels[last - 1].data + texture.compressed.levels[last - 1].size - data;
+        }
+        else
+        {
+            data = texture.mips.data(first);
+            size = texture.mips.data(last - 1) + size_t(texture.mips.levels[last - 1].width) * texture.mips.levels[last - 1].height * texture.mips.channels - data;
+        }
+    }
+
+    static size_t levelBytes(const CachedTexture &texture, int first, int last)
+    {
+        if (first >= last)
+            return 0;
+        const unsigned char *data;
+        size_t size;
+        levelRange(texture, first, last, data, size);
+        return size;
+    }
+
+private:
+    struct PathEntry
+    {
+        FileStamp stamp;
+        FileStamp packedStamp;  // of the packed image, if any
+        weak_ptr<CachedTexture> texture;
+    };
+
+    mutex cacheMutex;
+    unordered_map<string, PathEntry> byPath;
+    unordered_map<uint64_t, weak_ptr<CachedTexture> > byContent;
+    Stats counters;
+    bool compression;
+    string compressionDirectory;
+    MipFilter mipFilter;
+    TextureLoadPolicy loadPolicy;
+    int streamResidentSize;     // 0 without streaming
+    vector<weak_ptr<CachedTexture> > streaming;    // uploaded streamed textures
+
+    TextureCache() : compression(false), mipFilter(MIP_FILTER_BOX), streamResidentSize(0)
+    {
+        counters.hits = counters.misses = 0;
+        counters.bytesSaved = counters.bytes = counters.residentBytes = 0;
+        counters.textures = 0;
+        TextureBudget::Source source;
+        source.residentBytes = [this]() { return stats().residentBytes; };
+        source.candidates = [this](vector<TextureBudget::Candidate> &candidates) { budgetCandidates(candidates); };
+        TextureBudget::instance().addSource(source);
+    }
+
+    // acquire() and acquirePacked(); packedPath is canonical already
+    shared_ptr<CachedTexture> acquireEntry(const string &path, const string &packedPath, const string &layout, bool gamma, int width, int height)
+    {
+        string canonical = canonicalPath(path);
+        {
+            // atlas layers all get the same cap, so they still share pages
+            lock_guard<mutex> lock(cacheMutex);
+            CapTextureSize(width, height, loadPolicy.maxSize);
+        }
+        string size = width > 0 && height > 0 ? "." + std::to_string(width) + "x" + std::to_string(height) : "";
+        string packing = packedPath.empty() ? "" : "+" + packedPath + "." + layout;
+        string pathKey = canonical + packing + size + (gamma ? "|srgb" : "|linear");
+        FileStamp stamp, packedStamp;
+        FileStamp::query(canonical, stamp);
+        if (!packedPath.empty())
+            FileStamp::query(packedPath, packedStamp);
+
+        shared_ptr<CachedTexture> texture;
+        bool created = false;
+        {
+            lock_guard<mutex> lock(cacheMutex);
+            unordered_map<string, PathEntry>::iterator it = byPath.find(pathKey);
+            if (it != byPath.end() && it->second.stamp == stamp && it->second.packedStamp == packedStamp)
+                texture = it->second.texture.lock();
+        }
+        if (!texture)
+        {
+            // unknown (or changed) path: look the contents up before deciding to decode
+            MappedFile file(canonical);
+            uint64_t contentKey = hashBytes(size.data(), size.size(), hashBytes(file.data(), file.size())) ^ (gamma ? 1 : 0);
+            if (!packedPath.empty())
+            {
+                MappedFile packedFile(packedPath);
+                contentKey = hashString(layout, hashBytes(packedFile.data(), packedFile.size(), contentKey));
+            }
+
+            lock_guard<mutex> lock(cacheMutex);
+            unordered_map<uint64_t, weak_ptr<CachedTexture> >::iterator it = byContent.find(contentKey);
+            if (it != byContent.end())
+                texture = it->second.lock();
+            if (!texture)
+            {
+                texture = shared_ptr<CachedTexture>(new CachedTexture(), [this](CachedTexture *t) { release(t); });
+                texture->id = 0;
+                texture->path = canonical;
+                texture->gamma = gamma;
+                texture->width = texture->height = texture->nrComponents = 0;
+                texture->bytes = 0;
+                texture->streamed = false;
+                texture->residentBytes = 0;
+                texture->resampleSize = size;
+                texture->resampleWidth = size.empty() ? 0 : width;
+                texture->resampleHeight = size.empty() ? 0 : height;
+                texture->packedPath = packedPath;
+                texture->packLayout = layout;
+                texture->contentKey = contentKey;
+                byContent[contentKey] = texture;
+                counters.misses++;
+                created = true;
+            }
+            PathEntry &entry = byPath[pathKey];
+            entry.stamp = stamp;
+            entry.packedStamp = packedStamp;
+            entry.texture = texture;
+            texture->pathKeys.push_back(pathKey);
+        }
+
+        // decode outside the lock; concurrent acquirers of the same image wait here for the first one
+        CachedTexture *decoding = texture.get();
+        call_once(texture->decoded, [this, decoding]() { decode(*decoding); });
+        lock_guard<mutex> lock(cacheMutex);
+        if (created)
+        {
+            counters.textures++;
+            counters.bytes += texture->bytes;
+        }
+        else
+        {
+            counters.hits++;
+            counters.bytesSaved += texture->bytes;
+        }
+        return texture;
+    }
+
+
+    // the streamed textures that can drop mips, for the TextureBudget
+    void budgetCandidates(vector<TextureBudget::Candidate> &candidates)
+    {
+        vector<shared_ptr<CachedTexture> > textures;
+        {
+            lock_guard<mutex> lock(cacheMutex);
+            for (unsigned int i = 0; i < streaming.size(); i++)
+                if (shared_ptr<CachedTexture> texture = streaming[i].lock())
+                    textures.push_back(texture);
+        }
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            shared_ptr<CachedTexture> texture = textures[i];
+            TextureBudget::Candidate candidate;
+            if (!texture->stream.budgetCandidate(candidate))
+                continue;
+            candidate.demote = [this, texture]()
+            {
+                StreamedTexture target(*this, *texture);
+                return texture->stream.demote(target);
+            };
+            candidates.push_back(candidate);
+        }
+    }
+
+    void decode(CachedTexture &texture)
+    {
+        bool compress;
+        string directory;
+        MipFilter filter;
+        TextureLoadPolicy policy;
+        int residentSize;
+        {
+            lock_guard<mutex> lock(cacheMutex);
+            compress = compression;
+            directory = compressionDirectory;
+            filter = mipFilter;
+            policy = loadPolicy;
+            residentSize = streamResidentSize;
+        }
+        uint32_t settingsKey = uint32_t(filter) | (texture.gamma ? 1u << 8 : 0u) | uint32_t(policy.maxSize) << 9;
+        MappedFile file(texture.path);
+        MappedFile packedFile;
+        string packing;
+        if (!texture.packedPath.empty())
+        {
+            packedFile.open(texture.packedPath);
+            packing = "+" + texture.packedPath.substr(texture.packedPath.find_last_of("/\\") + 1) + "." + texture.packLayout;
+        }
+        uint64_t sourceHash = 0;
+        string ddsPath;
+        if (compress)
+        {
+            // a DDS file made from exactly these contents skips decoding and compressing altogether
+            sourceHash = hashBytes(file.data(), file.size());
+            if (!texture.packedPath.empty())
+                sourceHash = hashString(texture.packLayout, hashBytes(packedFile.data(), packedFile.size(), sourceHash));
+            ddsPath = compressedPath(texture.path + packing + texture.resampleSize + (texture.gamma ? ".srgb" : ""), directory);
+            if (LoadCompressedImage(ddsPath, sourceHash, settingsKey, texture.compressed))
+            {
+                texture.width = texture.compressed.levels[0].width;
+                texture.height = texture.compressed.levels[0].height;
+                texture.nrComponents = texture.compressed.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? 4 : 3;
+                texture.bytes = texture.compressed.bytes();
+                setStreamed(texture, residentSize);
+                return;
+            }
+        }
+        TextureImage image;
+        if (!LoadTextureImageFromMemory(file.data(), file.size(), image))
+        {
+            std::cout << "Texture failed to load at path: " << texture.path << std::endl;
+            return;
+        }
+        const unsigned char *pixels = image.data;
+        vector<unsigned char> packed;
+        if (!texture.packedPath.empty())
+        {
+            // the packed image goes in at the size of the base image, as the data it is
+            TextureImage second;
+            if (!LoadTextureImageFromMemory(packedFile.data(), packedFile.size(), second))
+            {
+                std::cout << "Texture failed to load at path: " << texture.packedPath << std::endl;
+                stbi_image_free(image.data);
+                return;
+            }
+            vector<unsigned char> fitted;
+            const unsigned char *secondPixels = second.data;
+            if (second.width != image.width || second.height != image.height)
+            {
+                ScaleImage(second.data, second.width, second.height, second.nrComponents, false, filter, image.width, image.height, fitted);
+                secondPixels = fitted.data();
+            }
+            bool done = PackImageChannels(image.data, image.nrComponents, secondPixels, second.nrComponents,
+                                          size_t(image.width) * image.height, texture.packLayout, packed);
+            stbi_image_free(second.data);
+            stbi_image_free(image.data);
+            image.data = nullptr;
+            if (!done)
+            {
+                std::cout << "TEXTURE_CACHE:: unknown channel layout '" << texture.packLayout << "' for " << texture.path << std::endl;
+                return;
+            }
+            image.nrComponents = static_cast<int>(texture.packLayout.size());
+            pixels = packed.data();
+        }
+        vector<unsigned char> resampled;
+        int cappedWidth = image.width, cappedHeight = image.height;
+        CapTextureSize(cappedWidth, cappedHeight, policy.maxSize);
+        if (texture.resampleWidth == 0 && (cappedWidth != image.width || cappedHeight != image.height))
+        {
+            ScaleImage(pixels, image.width, image.height, image.nrComponents, texture.gamma, filter, cappedWidth, cappedHeight, resampled);
+            if (image.data)
+                stbi_image_free(image.data);
+            image.data = nullptr;
+            image.width = cappedWidth;
+            image.height = cappedHeight;
+            pixels = resampled.data();
+        }
+        if (texture.resampleWidth > 0)
+        {
+            if (image.width != texture.resampleWidth || image.height != texture.resampleHeight)
+                ScaleImage(pixels, image.width, image.height, image.nrComponents, texture.gamma, filter,
+                              texture.resampleWidth, texture.resampleHeight, resampled);
+            else
+                resampled.assign(pixels, pixels + size_t(image.width) * image.height * image.nrComponents);
+            if (image.data)
+                stbi_image_free(image.data);
+            image.data = nullptr;
+            image.width = texture.resampleWidth;
+            image.height = texture.resampleHeight;
+            image.nrComponents = ColorChannels(resampled, image.nrComponents);
+            pixels = resampled.data();
+        }
+        vector<unsigned char> gray;
+        if (policy.detectGrayscale && !compress && !texture.gamma && texture.resampleWidth == 0)
+        {
+            image.nrComponents = GrayscaleChannels(pixels, size_t(image.width) * image.height, image.nrComponents,
+                                                   TEXTURE_GRAYSCALE_TOLERANCE, gray);
+            if (!gray.empty())
+                pixels = gray.data();
+        }
+        texture.width = image.width;
+        texture.height = image.height;
+        texture.nrComponents = image.nrComponents;
+        GenerateMipChain(pixels, image.width, image.height, image.nrComponents, texture.gamma, filter, texture.mips);
+        if (image.data)
+            stbi_image_free(image.data);
+        texture.bytes = texture.mips.bytes();
+        if (compress && CompressImage(texture.mips, texture.compressed))
+        {
+            texture.mips.clear();
+            texture.bytes = texture.compressed.bytes();
+            // streamed and atlas textures keep their chain until they are gone, and others until upload():
+            // rather the mapped file than a copy in memory, if it could be written and read back
+            CompressedImage mapped;
+            if (!SaveCompressedImage(ddsPath, texture.compressed, sourceHash, settingsKey))
+                std::cout << "TEXTURE_CACHE:: failed to write " << ddsPath << std::endl;
+            else if (LoadCompressedImage(ddsPath, sourceHash, settingsKey, mapped))
+                texture.compressed.swap(mapped);
+        }
+        setStreamed(texture, residentSize);
+    }
+
+    // picks the coarse mips a texture is streamed from, if streaming is on and the texture has finer ones
+    static void setStreamed(CachedTexture &texture, int residentSize)
+    {
+        int levels = static_cast<int>(texture.compressed.format != 0 ? texture.compressed.levels.size() : texture.mips.levels.size());
+        int coarse = 0;
+        while (residentSize > 0 && coarse < levels - 1 && std::max(texture.width >> coarse, texture.height >> coarse) > residentSize)
+            coarse++;
+        texture.stream.reset(levels, coarse);
+        texture.streamed = coarse > 0;
+    }
+
+    // uploads mips [first, last) of a texture into the bound texture, from its staging copy if it has one
+    static void uploadLevels(CachedTexture &texture, int first, int last)
+    {
+        TextureUploadRing &ring = TextureUploadRing::instance();
+        const TextureStaging *staging = texture.stream.staging.size > 0 ? &texture.stream.staging : nullptr;
+        if (staging)
+            ring.bind();
+        if (texture.compressed.format != 0)
+            UploadCompressedLevels(texture.compressed, texture.gamma, first, last, staging);
+        else
+            UploadMipLevels(texture.mips, texture.gamma, first, last, staging);
+        if (staging)
+            ring.unbind();
+    }
+
+    // the GL side of the MipStream of a streamed texture
+    struct StreamedTexture
+    {
+        TextureCache &cache;
+        CachedTexture &texture;
+
+        StreamedTexture(TextureCache &cache, CachedTexture &texture) : cache(cache), texture(texture) {}
+
+        size_t levelBytes(int first, int last) const { return TextureCache::levelBytes(texture, first, last); }
+
+        void levelRanges(int first, int last, vector<pair<const unsigned char*, size_t> > &ranges) const
+        {
+            ranges.resize(1);
+            levelRange(texture, first, last, ranges[0].first, ranges[0].second);
+        }
+
+        void uploadLevels(int first, int last)
+        {
+            glBindTexture(GL_TEXTURE_2D, texture.id);
+            TextureCache::uploadLevels(texture, first, last);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, first);
+        }
+
+        // the base level goes up first, so the freed levels are outside the range GL samples from; they are
+        // redefined as empty images, which is how GL 3.3 frees the storage of single levels
+        void dropLevels(int level)
+        {
+            glBindTexture(GL_TEXTURE_2D, texture.id);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+            for (int i = texture.stream.residentLevel; i < level; i++)
+                glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        }
+
+        void residentChanged() { cache.setResidentBytes(texture); }
+    };
+
+    void setResidentBytes(CachedTexture &texture)
+    {
+        size_t bytes = levelBytes(texture, texture.stream.residentLevel, texture.stream.levels);
+        lock_guard<mutex> lock(cacheMutex);
+        counters.residentBytes = counters.residentBytes - texture.residentBytes + bytes;
+        texture.residentBytes = bytes;
+    }
+
+    // the DDS file of an image: next to it, or in the cache directory under a name unique to its path
+    static string compressedPath(const string &path, const string &directory)
+    {
+        if (directory.empty())
+            return path + ".dds";
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".%016llx.dds", (unsigned long long)hashBytes(path.data(), path.size()));
+        return directory + '/' + path.substr(path.find_last_of("/\\") + 1) + suffix;
+    }
+
+    // deleter of the shared entries: forgets the entry and frees its GL texture and pixels.
+    void release(CachedTexture *texture)
+    {
+        {
+            lock_guard<mutex> lock(cacheMutex);
+            for (unsigned int i = 0; i < texture->pathKeys.size(); i++)
+            {
+                unordered_map<string, PathEntry>::iterator it = byPath.find(texture->pathKeys[i]);
+                if (it != byPath.end() && it->second.texture.expired())
+                    byPath.erase(it);
+            }
+            unordered_map<uint64_t, weak_ptr<CachedTexture> >::iterator it = byContent.find(texture->contentKey);
+            if (it != byContent.end() && it->second.expired())
+                byContent.erase(it);
+            counters.textures--;
+            counters.bytes -= texture->bytes;
+            counters.residentBytes -= texture->residentBytes;
+        }
+        StreamedTexture target(*this, *texture);
+        texture->stream.release(target);
+        if (texture->id != 0)
+            glDeleteTextures(1, &texture->id);
+        delete texture;
+    }
+
+    static string canonicalPath(const string &path)
+    {
+#ifdef _WIN32
+        char *resolved = _fullpath(NULL, path.c_str(), 0);
+#else
+        char *resolved = realpath(path.c_str(), NULL);
+#endif
+        if (!resolved)
+            return path;
+        string result(resolved);
+        free(resolved);
+        return result;
+    }
+};
+
+#endif
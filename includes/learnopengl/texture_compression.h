@@ -0,0 +1,269 @@
+#ifndef TEXTURE_COMPRESSION_H
+#define TEXTURE_COMPRESSION_H
+
+#include <glad/glad.h>
+
+extern "C" {
+#include <image_DXT.h>
+}
+
+#include <learnopengl/dxt_encoder.h>
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/mip_generator.h>
+#include <learnopengl/texture_upload.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// S3TC block compression of decoded textures with the bundled image_DXT encoder (or rather its faster twin in
+// dxt_encoder.h, which produces the same bytes), and the DDS files they are
+// cached in. Images without alpha (1 or 3 channels) become DXT1 (8:1 against RGBA, 6:1 against RGB), images
+// with alpha (2 or 4 channels) DXT5 (4:1). Every level of a mip chain from mip_generator.h is compressed,
+// since GL can't generate mipmaps for compressed textures.
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+const uint32_t DDS_FOURCC_DXT1 = ('D' << 0) | ('X' << 8) | ('T' << 16) | ('1' << 24);
+const uint32_t DDS_FOURCC_DXT5 = ('D' << 0) | ('X' << 8) | ('T' << 16) | ('5' << 24);
+// our DDS files keep the hash of the image they were made from and how its mips were made in dwReserved1,
+// behind this tag
+const uint32_t DDS_CACHE_TAG     = 0x4C474F4C; // "LOGL"
+const uint32_t DDS_CACHE_VERSION = 2;
+
+struct CompressedLevel {
+    int width, height;
+    const unsigned char *data;
+    size_t size;
+};
+
+// the compressed mip chain of a texture, either built in memory or mapped from a DDS file.
+struct CompressedImage {
+    GLenum format;                      // GL_COMPRESSED_RGB_S3TC_DXT1_EXT or GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 0 if empty
+    vector<CompressedLevel> levels;     // base level first, down to 1x1
+    vector<unsigned char> storage;      // the levels point into this...
+    MappedFile file;                    // ...or into this mapped DDS file
+
+    CompressedImage() : format(0) {}
+
+    size_t bytes() const
+    {
+        size_t total = 0;
+        for (unsigned int i = 0; i < levels.size(); i++)
+            total += levels[i].size;
+        return total;
+    }
+
+    void clear()
+    {
+        format = 0;
+        levels.clear();
+        vector<unsigned char>().swap(storage);
+        file.close();
+    }
+
+    // exchanges the images; the levels keep pointing into the data they came with
+    void swap(CompressedImage &other)
+    {
+        std::swap(format, other.format);
+        levels.swap(other.levels);
+        storage.swap(other.storage);
+        file.swap(other.file);
+    }
+};
+
+// whether the current context can sample S3TC textures. GL thread only.
+inline bool TextureCompressionSupported()
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char *extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension && strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0)
+            return true;
+    }
+    return false;
+}
+
+// compresses every level of a mip chain. No GL calls.
+inline bool CompressImage(const MipChain &chain, CompressedImage &image)
+{
+    image.clear();
+    if (chain.levels.empty())
+        return false;
+    bool alpha = (chain.channels & 1) == 0;
+    image.format = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+
+    vector<size_t> offsets;
+    for (unsigned int i = 0; i < chain.levels.size(); i++)
+    {
+        const MipLevel &level = chain.levels[i];
+        CompressedLevel compressedLevel = { level.width, level.height, nullptr, DXTCompressedSize(level.width, level.height, alpha) };
+        offsets.push_back(image.storage.size());
+        image.storage.resize(image.storage.size() + compressedLevel.size);
+        CompressDXT(chain.data(i), level.width, level.height, chain.channels, alpha, &image.storage[offsets.back()]);
+        image.levels.push_back(compressedLevel);
+    }
+    // storage is final now, so the pointers stay valid
+    for (unsigned int i = 0; i < image.levels.size(); i++)
+        image.levels[i].data = image.storage.data() + offsets[i];
+    return true;
+}
+
+// writes the mip chain as a DDS file, tagged with the hash of the image it was made from and a key for the
+// settings it was made with. Like the mesh cache, the file is written under a temporary name and renamed into place.
+inline bool SaveCompressedImage(const string &path, const CompressedImage &image, uint64_t sourceHash, uint32_t settingsKey)
+{
+    if (image.levels.empty())
+        return false;
+    DDS_header header;
+    memset(&header, 0, sizeof(header));
+    header.dwMagic = ('D' << 0) | ('D' << 8) | ('S' << 16) | (' ' << 24);
+    header.dwSize = 124;
+    header.dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE | DDSD_MIPMAPCOUNT;
+    header.dwWidth = image.levels[0].width;
+    header.dwHeight = image.levels[0].height;
+    header.dwPitchOrLinearSize = static_cast<unsigned int>(image.levels[0].size);
+    header.dwMipMapCount = static_cast<unsigned int>(image.levels.size());
+    header.dwReserved1[0] = DDS_CACHE_TAG;
+    header.dwReserved1[1] = DDS_CACHE_VERSION;
+    header.dwReserved1[2] = static_cast<unsigned int>(sourceHash);
+    header.dwReserved1[3] = static_cast<unsigned int>(sourceHash >> 32);
+    header.dwReserved1[4] = settingsKey;
+    header.sPixelFormat.dwSize = 32;
+    header.sPixelFormat.dwFlags = DDPF_FOURCC;
+    header.sPixelFormat.dwFourCC = image.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? DDS_FOURCC_DXT5 : DDS_FOURCC_DXT1;
+    header.sCaps.dwCaps1 = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+
+    string temporary = path + ".tmp";
+    {
+        ofstream out(temporary.c_str(), ios::binary | ios::trunc);
+        if (!out)
+            return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (unsigned int i = 0; i < image.levels.size(); i++)
+            out.write(reinterpret_cast<const char*>(image.levels[i].data), image.levels[i].size);
+        if (!out)
+            return false;
+    }
+    remove(path.c_str()); // rename() won't replace an existing file on Windows
+    return rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+// maps a DDS file written by SaveCompressedImage; fails if it is missing, malformed or made from another image
+// or with other settings.
+inline bool LoadCompressedImage(const string &path, uint64_t sourceHash, uint32_t settingsKey, CompressedImage &image)
+{
+    image.clear();
+    if (!image.file.open(path) || image.file.size() < sizeof(DDS_header))
+        return false;
+    const DDS_header *header = reinterpret_cast<const DDS_header*>(image.file.data());
+    uint64_t hash = header->dwReserved1[2] | uint64_t(header->dwReserved1[3]) << 32;
+    uint32_t fourCC = header->sPixelFormat.dwFourCC;
+    if (header->dwReserved1[0] != DDS_CACHE_TAG || header->dwReserved1[1] != DDS_CACHE_VERSION || hash != sourceHash || header->dwReserved1[4] != settingsKey ||
+        (fourCC != DDS_FOURCC_DXT1 && fourCC != DDS_FOURCC_DXT5) || header->dwWidth < 1 || header->dwHeight < 1)
+    {
+        image.clear();
+        return false;
+    }
+    image.format = fourCC == DDS_FOURCC_DXT5 ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    size_t blockBytes = fourCC == DDS_FOURCC_DXT5 ? 16 : 8;
+
+    const unsigned char *cursor = reinterpret_cast<const unsigned char*>(image.file.data()) + sizeof(DDS_header);
+    size_t remaining = image.file.size() - sizeof(DDS_header);
+    int width = header->dwWidth, height = header->dwHeight;
+    for (unsigned int i = 0; i < header->dwMipMapCount; i++)
+    {
+        CompressedLevel level = { width, height, cursor, size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes };
+        if (level.size > remaining)
+        {
+            image.clear();
+            return false;
+        }
+        image.levels.push_back(level);
+        cursor += level.size;
+        remaining -= level.size;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    if (image.levels.empty())
+    {
+        image.clear();
+        return false;
+    }
+    return true;
+}
+
+// the GL format of a compressed image, or of its sRGB twin with gamma set
+inline GLenum CompressedImageFormat(const CompressedImage &image, bool gamma)
+{
+    if (!gamma)
+        return image.format;
+    return image.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+}
+
+// uploads levels [first, last) of a compressed mip chain into the bound texture, as the same levels. With gamma
+// set they are sampled as sRGB. With staging the levels are read from there, where they were copied to back to
+// back (see TextureUploadRing); with allocated set the texture has immutable storage for them already.
+inline void UploadCompressedLevels(const CompressedImage &image, bool gamma, int first, int last,
+                                   const TextureStaging *staging = nullptr, bool allocated = false)
+{
+    GLenum format = CompressedImageFormat(image, gamma);
+    for (int i = first; i < last; i++)
+    {
+        const CompressedLevel &level = image.levels[i];
+        const void *data = StagedPointer(level.data, image.levels[first].data, staging);
+        if (allocated)
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level.width, level.height, format, static_cast<GLsizei>(level.size), data);
+        else
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, format, level.width, level.height, 0, static_cast<GLsizei>(level.size), data);
+    }
+}
+
+// creates a GL texture from a compressed mip chain and frees it (unmaps its DDS file). With gamma set the
+// texture is sampled as sRGB.
+inline unsigned int TextureFromCompressedImage(CompressedImage &image, bool gamma = false)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+
+    if (!image.levels.empty())
+    {
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        bool immutable = ImmutableTextureStorageSupported();
+        if (immutable)
+            glTexStorage2D(GL_TEXTURE_2D, static_cast<GLsizei>(image.levels.size()), CompressedImageFormat(image, gamma),
+                           image.levels[0].width, image.levels[0].height);
+        UploadCompressedLevels(image, gamma, 0, static_cast<int>(image.levels.size()), nullptr, immutable);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.levels.size()) - 1);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        image.clear();
+    }
+
+    return textureID;
+}
+
+#endif
@@ -0,0 +1,221 @@
+#ifndef TEXTURE_UPLOAD_H
+#define TEXTURE_UPLOAD_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+using namespace std;
+
+// a piece of the TextureUploadRing one upload is staged in; size 0 for none
+struct TextureStaging
+{
+    unsigned char *data;    // persistently mapped: any thread may fill it
+    size_t offset, size;    // in the ring's buffer
+    uint64_t serial;
+
+    TextureStaging() : data(nullptr), offset(0), size(0), serial(0) {}
+};
+
+// what to hand GL for the bytes at data: data itself, or if the bytes from origin on were copied into staging,
+// their offset in the TextureUploadRing's buffer (which must be bound as GL_PIXEL_UNPACK_BUFFER)
+inline const void *StagedPointer(const unsigned char *data, const unsigned char *origin, const TextureStaging *staging)
+{
+    if (!staging)
+        return data;
+    return reinterpret_cast<const void*>(static_cast<uintptr_t>(staging->offset + (data - origin)));
+}
+
+// textures whose levels never change size can be allocated once, complete, with glTexStorage2D (GL 4.2)
+inline bool ImmutableTextureStorageSupported()
+{
+    return GLAD_GL_VERSION_4_2 != 0;
+}
+
+// A pixel unpack buffer that texture uploads are staged in, mapped once for good (GL 4.4 buffer storage), so
+// the workers that page mips in copy them straight into memory GL reads from, and glTexImage2D from there is
+// a GPU copy rather than one the driver makes of client memory on the GL thread.
+// Allocations are handed out in order around the ring; each is recycled once the GPU is past a fence set
+// after the uploads that read it, which allocate() only polls: when the ring is full it fails and the caller
+// tries again next frame, rather than waiting for the GPU.
+// GL thread only, apart from filling the staged bytes.
+class TextureUploadRing
+{
+public:
+    struct Stats
+    {
+        size_t capacity;        // 0 when the ring is off
+        size_t stagedBytes;     // in total
+        unsigned int uploads;
+        unsigned int full;      // allocations turned down because earlier uploads still used the space
+    };
+
+    static TextureUploadRing &instance()
+    {
+        static TextureUploadRing ring;
+        return ring;
+    }
+
+    // creates the buffer, of bytes in size. Call it on the GL thread once the context is current. Returns false,
+    // and leaves the ring off so uploads read client memory as before, if the context is older than GL 4.4.
+    bool enable(size_t bytes = 32 * 1024 * 1024)
+    {
+        if (buffer != 0)
+            return true;
+        if (!GLAD_GL_VERSION_4_4)
+        {
+            cout << "TEXTURE_UPLOAD:: persistently mapped buffers need GL 4.4, textures upload from client memory" << endl;
+            return false;
+        }
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(bytes), NULL, flags);
+        mapped = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(bytes), flags));
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (!mapped)
+        {
+            cout << "TEXTURE_UPLOAD:: failed to map the upload buffer, textures upload from client memory" << endl;
+            glDeleteBuffers(1, &buffer);
+            buffer = 0;
+            return false;
+        }
+        counters.capacity = bytes;
+        return true;
+    }
+
+    bool enabled() const { return buffer != 0; }
+    size_t capacity() const { return counters.capacity; }
+
+    // reserves size bytes for an upload. Returns false if the ring is off, the uploads before it still use
+    // the space, or it won't fit at all.
+    bool allocate(size_t size, TextureStaging &staging)
+    {
+        if (buffer == 0 || size == 0 || size > counters.capacity)
+            return false;
+        retire();
+        // keeps the levels of DXT blocks and cache lines aligned
+        size_t aligned = (size + TEXTURE_UPLOAD_ALIGNMENT - 1) & ~(TEXTURE_UPLOAD_ALIGNMENT - 1);
+        // the regions in flight take [tail, head), or [tail, capacity) and [0, head) once they wrapped around
+        size_t offset = 0;
+        if (!regions.empty())
+        {
+            size_t tail = regions.front().offset;
+            if (head > tail && head + aligned <= counters.capacity)
+                offset = head;
+            else if (head > tail && aligned < tail)
+                offset = 0;
+            else if (head < tail && head + aligned < tail)
+                offset = head;
+            else
+            {
+                counters.full++;
+                return false;
+            }
+        }
+
+        Region region;
+        region.offset = offset;
+        region.serial = ++serials;
+        region.fence = 0;
+        region.released = false;
+        regions.push_back(region);
+        head = offset + aligned;
+        staging.data = mapped + offset;
+        staging.offset = offset;
+        staging.size = size;
+        staging.serial = region.serial;
+        counters.stagedBytes += size;
+        return true;
+    }
+
+    // binds the buffer for uploads from staged bytes (see StagedPointer()); unbind() once they are issued
+    void bind() { glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer); }
+    void unbind() { glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); }
+
+    // gives staging back once the uploads that read it are issued (or won't be after all); its space is
+    // reused when the GPU is done with them. Clears staging.
+    void release(TextureStaging &staging)
+    {
+        for (unsigned int i = 0; i < regions.size() && staging.size > 0; i++)
+            if (regions[i].serial == staging.serial)
+            {
+                regions[i].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                regions[i].released = true;
+                counters.uploads++;
+            }
+        staging = TextureStaging();
+    }
+
+    Stats stats() const { return counters; }
+
+    void printStats() const
+    {
+        if (buffer == 0)
+            return;
+        cout << "TEXTURE_UPLOAD:: " << counters.capacity / (1024 * 1024) << " MB ring, " << counters.uploads << " uploads ("
+             << counters.stagedBytes / (1024 * 1024) << " MB) staged, " << counters.full << " times full" << endl;
+    }
+
+    // unmaps and frees the buffer. Call it before the GL context goes away, once nothing is staged any more.
+    void clear()
+    {
+        if (buffer == 0)
+            return;
+        for (unsigned int i = 0; i < regions.size(); i++)
+            if (regions[i].fence)
+                glDeleteSync(regions[i].fence);
+        regions.clear();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        mapped = nullptr;
+        head = 0;
+        counters.capacity = 0;
+    }
+
+private:
+    static const size_t TEXTURE_UPLOAD_ALIGNMENT = 64;
+
+    struct Region
+    {
+        size_t offset;
+        uint64_t serial;
+        GLsync fence;       // set by release()
+        bool released;
+    };
+
+    unsigned int buffer;
+    unsigned char *mapped;
+    size_t head;                // where the next allocation goes, if there is room
+    deque<Region> regions;      // in flight, oldest first
+    uint64_t serials;
+    Stats counters;
+
+    TextureUploadRing() : buffer(0), mapped(nullptr), head(0), serials(0)
+    {
+        counters.capacity = counters.stagedBytes = 0;
+        counters.uploads = counters.full = 0;
+    }
+
+    // recycles the oldest regions the GPU is done with, without waiting for any
+    void retire()
+    {
+        while (!regions.empty() && regions.front().released)
+        {
+            GLenum status = glClientWaitSync(regions.front().fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                break;
+            glDeleteSync(regions.front().fence);
+            regions.pop_front();
+        }
+        if (regions.empty())
+            head = 0;
+    }
+};
+
+#endif
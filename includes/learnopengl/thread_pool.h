@@ -0,0 +1,159 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed-size pool of worker threads for the CPU side of asset loading. Nothing submitted here may
+// touch OpenGL: the GL context belongs to the main thread.
+class ThreadPool
+{
+public:
+    // threadCount 0 means one worker per hardware thread.
+    explicit ThreadPool(unsigned int threadCount = 0) : stopping(false)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+
+    // finishes the queued tasks, then joins the workers.
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (unsigned int i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool &operator=(const ThreadPool&) = delete;
+
+    unsigned int size() const { return static_cast<unsigned int>(workers.size()); }
+
+    // process-wide pool for data parallel work within a single load, like parsing the chunks of one big file.
+    // Safe to use from inside the tasks of other pools, since parallelFor lets the caller take part.
+    static ThreadPool &shared()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    // queues a task and returns a future for its result (exceptions are forwarded through the future).
+    template <typename F>
+    std::future<typename std::result_of<F()>::type> submit(F task)
+    {
+        typedef typename std::result_of<F()>::type Result;
+        std::shared_ptr<std::packaged_task<Result()> > packaged = std::make_shared<std::packaged_task<Result()> >(task);
+        std::future<Result> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back([packaged]() { (*packaged)(); });
+        }
+        wakeup.notify_one();
+        return result;
+    }
+
+    // runs body(i) for every i in [0, count) and returns once all of them are done. The calling thread
+    // takes part in the work, so this is safe to call from inside a pool task as well. If body throws, the
+    // indices not started yet are skipped and the first exception is rethrown here, once no thread runs
+    // body any more.
+    template <typename F>
+    void parallelFor(size_t count, F body)
+    {
+        if (count == 0)
+            return;
+        struct Shared
+        {
+            std::atomic<size_t> next;
+            std::atomic<size_t> done;
+            std::atomic<bool> failed;
+            std::exception_ptr error;
+            std::function<void(size_t)> body;
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        std::shared_ptr<Shared> shared = std::make_shared<Shared>();
+        shared->next = 0;
+        shared->done = 0;
+        shared->failed = false;
+        shared->body = body;
+        std::function<void()> work = [shared, count]()
+        {
+            for (size_t i = shared->next++; i < count; i = shared->next++)
+            {
+                if (!shared->failed)
+                {
+                    try
+                    {
+                        shared->body(i);
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard<std::mutex> lock(shared->mutex);
+                        if (!shared->error)
+                            shared->error = std::current_exception();
+                        shared->failed = true;
+                    }
+                }
+                if (++shared->done == count)
+                {
+                    std::lock_guard<std::mutex> lock(shared->mutex);
+                    shared->finished.notify_all();
+                }
+            }
+        };
+        size_t helpers = std::min(count - 1, static_cast<size_t>(size()));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < helpers; i++)
+                tasks.push_back(work);
+        }
+        wakeup.notify_all();
+        work();
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        shared->finished.wait(lock, [shared, count]() { return shared->done == count; });
+        if (shared->error)
+            std::rethrow_exception(shared->error);
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()> > tasks;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping;
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeup.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader_uniforms.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+using namespace std;
+
+// A uniform block backed by one buffer for all programs: T is the C++ struct mirroring the block's std140
+// layout, members lists its fields for the layout check (see UniformBlockRegistry). The buffer stays bound to
+// a binding point of its own, and Shader binds the block of every program that declares it to that point, so
+// an update() once per frame reaches all of them.
+// Construct it on the GL thread before the shaders that use it.
+template<typename T>
+class UniformBuffer
+{
+public:
+    UniformBuffer(const string &blockName, GLuint binding, const vector<UniformBlockMember> &members) : buffer(0)
+    {
+        UniformBlockRegistry::instance().add(blockName, binding, sizeof(T), members);
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+    }
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer &operator=(const UniformBuffer&) = delete;
+
+    void update(const T &data)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // frees the buffer; call it before the GL context goes away
+    void clear()
+    {
+        if (buffer != 0)
+            glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+
+private:
+    unsigned int buffer;
+};
+
+// the binding point of the Camera block
+const GLuint CAMERA_UNIFORMS_BINDING = 0;
+
+// what the Camera block holds each frame, laid out as std140 has it for
+//     layout (std140) uniform Camera
+//     {
+//         mat4 projection;
+//         mat4 view;
+//         mat4 viewProjection;
+//         vec4 cameraPosition;    // w is 1
+//         vec2 viewport;          // in pixels
+//         float time;             // in seconds
+//     };
+struct CameraUniforms
+{
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::mat4 viewProjection;
+    glm::vec4 cameraPosition;
+    glm::vec2 viewport;
+    float time;
+    float padding;              // std140 rounds blocks up to a vec4
+};
+
+static_assert(sizeof(CameraUniforms) == 224 && offsetof(CameraUniforms, viewport) == 208, "CameraUniforms has to match std140");
+
+inline vector<UniformBlockMember> CameraUniformMembers()
+{
+    UniformBlockMember members[] = {
+        UNIFORM_BLOCK_MEMBER(CameraUniforms, projection, GL_FLOAT_MAT4),
+        UNIFORM_BLOCK_MEMBER(CameraUniforms, view, GL_FLOAT_MAT4),
+        UNIFORM_BLOCK_MEMBER(CameraUniforms, viewProjection, GL_FLOAT_MAT4),
+        UNIFORM_BLOCK_MEMBER(CameraUniforms, cameraPosition, GL_FLOAT_VEC4),
+        UNIFORM_BLOCK_MEMBER(CameraUniforms, viewport, GL_FLOAT_VEC2),
+        UNIFORM_BLOCK_MEMBER(CameraUniforms, time, GL_FLOAT)
+    };
+    return vector<UniformBlockMember>(members, members + sizeof(members) / sizeof(members[0]));
+}
+
+// the Camera block's buffer, for every program
+class CameraUniformBuffer : public UniformBuffer<CameraUniforms>
+{
+public:
+    CameraUniformBuffer() : UniformBuffer<CameraUniforms>("Camera", CAMERA_UNIFORMS_BINDING, CameraUniformMembers()) {}
+
+    void update(const glm::mat4 &projection, const glm::mat4 &view, const glm::vec3 &position, const glm::vec2 &viewport, float time)
+    {
+        CameraUniforms data;
+        data.projection = projection;
+        data.view = view;
+        data.viewProjection = projection * view;
+        data.cameraPosition = glm::vec4(position, 1.0f);
+        data.viewport = viewport;
+        data.time = time;
+        data.padding = 0.0f;
+        UniformBuffer<CameraUniforms>::update(data);
+    }
+};
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+using namespace std;
+
+// The vertex attributes of a mesh, as bits of a mask. Bit i is attribute location i, so the mask of a
+// shader's active attributes (Shader::activeAttributeMask) can be used directly.
+enum VertexAttribute {
+    VERTEX_POSITION  = 1 << 0,
+    VERTEX_NORMAL    = 1 << 1,
+    VERTEX_TEXCOORDS = 1 << 2,
+    VERTEX_TANGENT   = 1 << 3,
+    VERTEX_BITANGENT = 1 << 4,
+    VERTEX_ALL       = 0x1F
+};
+const unsigned int VERTEX_ATTRIBUTE_COUNT = 5;
+
+// How the vertices of a mesh are interleaved in its GPU buffer. Only the attributes in the mask are stored,
+// in location order. The full layout stores them as floats; the compact one quantizes them:
+//
+//   location 0  Position   3 x float                  vec3
+//   location 1  Normal     2 x snorm16, oct encoded   vec2 -> decode with OctDecode below
+//   location 2  TexCoords  2 x unorm16 or half float  vec2 (ready to use, the type is picked per mesh)
+//   location 3  Tangent    2 x snorm16, oct encoded   vec2 -> decode with OctDecode below
+//   location 4  Bitangent  1 x snorm16, the sign only float: bitangent = cross(normal, tangent) * sign
+//
+// which takes 28 bytes instead of 56. Positions stay full floats: quantizing them would need a per mesh
+// scale and offset in every vertex shader. Shaders that read normals or tangents from a compact mesh
+// decode them like this:
+//
+//   vec3 OctDecode(vec2 e)
+//   {
+//       vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+//       if (n.z < 0.0)
+//           n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+//       return normalize(n);
+//   }
+struct VertexLayout {
+    unsigned int attributes;    // VertexAttribute mask
+    bool compact;
+    GLenum texCoordType;        // GL_FLOAT; compact layouts use GL_UNSIGNED_SHORT (unorm16) or GL_HALF_FLOAT
+    unsigned int stride;
+    unsigned int offsets[VERTEX_ATTRIBUTE_COUNT];
+
+    VertexLayout() : attributes(0), compact(false), texCoordType(GL_FLOAT), stride(0)
+    {
+        memset(offsets, 0, sizeof(offsets));
+    }
+
+    VertexLayout(unsigned int attributes, bool compact, GLenum texCoordType = GL_FLOAT)
+        : attributes(attributes), compact(compact), texCoordType(compact ? texCoordType : GL_FLOAT), stride(0)
+    {
+        for (unsigned int i = 0; i < VERTEX_ATTRIBUTE_COUNT; i++)
+        {
+            offsets[i] = stride;
+            if (attributes & (1 << i))
+                stride += attributeBytes(i);
+        }
+    }
+
+    bool has(VertexAttribute attribute) const { return (attributes & attribute) != 0; }
+
+    // writes one vertex at out (stride bytes).
+    void pack(const glm::vec3 &position, const glm::vec3 &normal, const glm::vec2 &texCoords,
+              const glm::vec3 &tangent, const glm::vec3 &bitangent, unsigned char *out) const
+    {
+        memset(out, 0, stride);
+        if (has(VERTEX_POSITION))
+            memcpy(out + offsets[0], &position, sizeof(position));
+        if (has(VERTEX_NORMAL))
+        {
+            if (compact)
+                packOctSnorm16(normal, out + offsets[1]);
+            else
+                memcpy(out + offsets[1], &normal, sizeof(normal));
+        }
+        if (has(VERTEX_TEXCOORDS))
+        {
+            if (texCoordType == GL_UNSIGNED_SHORT)
+            {
+                uint16_t uv[2] = { glm::packUnorm1x16(texCoords.x), glm::packUnorm1x16(texCoords.y) };
+                memcpy(out + offsets[2], uv, sizeof(uv));
+            }
+            else if (texCoordType == GL_HALF_FLOAT)
+            {
+                uint16_t uv[2] = { glm::packHalf1x16(texCoords.x), glm::packHalf1x16(texCoords.y) };
+                memcpy(out + offsets[2], uv, sizeof(uv));
+            }
+            else
+                memcpy(out + offsets[2], &texCoords, sizeof(texCoords));
+        }
+        if (has(VERTEX_TANGENT))
+        {
+            if (compact)
+                packOctSnorm16(tangent, out + offsets[3]);
+            else
+                memcpy(out + offsets[3], &tangent, sizeof(tangent));
+        }
+        if (has(VERTEX_BITANGENT))
+        {
+            if (compact)
+            {
+                // handedness of the tangent frame: does the stored bitangent agree with cross(normal, tangent)?
+                int16_t sign = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -32767 : 32767;
+                memcpy(out + offsets[4], &sign, sizeof(sign));
+            }
+            else
+                memcpy(out + offsets[4], &bitangent, sizeof(bitangent));
+        }
+    }
+
+    // sets the attribute pointers for the bound VAO and vertex buffer; attributes not in the layout stay disabled.
+    void setupAttributes() const
+    {
+        for (unsigned int i = 0; i < VERTEX_ATTRIBUTE_COUNT; i++)
+        {
+            if (!(attributes & (1 << i)))
+                continue;
+            GLint size;
+            GLenum type;
+            GLboolean normalized;
+            attributeFormat(i, size, type, normalized);
+            glEnableVertexAttribArray(i);
+            glVertexAttribPointer(i, size, type, normalized, stride, (void*)(size_t)offsets[i]);
+        }
+    }
+
+    // identifies the layout in hashes of packed vertex data
+    uint32_t key() const
+    {
+        return attributes | (compact ? 1u << 8 : 0u) | (uint32_t(texCoordType) << 16);
+    }
+
+private:
+    void attributeFormat(unsigned int attribute, GLint &size, GLenum &type, GLboolean &normalized) const
+    {
+        normalized = GL_FALSE;
+        type = GL_FLOAT;
+        size = attribute == 2 ? 2 : 3;
+        if (attribute == 2)
+        {
+            type = texCoordType;
+            normalized = texCoordType == GL_UNSIGNED_SHORT;
+        }
+        else if (compact && attribute != 0)
+        {
+            type = GL_SHORT;
+            normalized = GL_TRUE;
+            size = attribute == 4 ? 1 : 2;
+        }
+    }
+
+    unsigned int attributeBytes(unsigned int attribute) const
+    {
+        if (attribute == 2)
+            return compact ? 4 : 8;
+        if (!compact || attribute == 0)
+            return 12;
+        return 4; // oct encoded pairs, and the bitangent sign padded to keep offsets 4 byte aligned
+    }
+
+    static void packOctSnorm16(const glm::vec3 &direction, unsigned char *out);
+};
+
+// unorm16 is twice as precise as half floats inside [0, 1], but can't store anything outside (tiling UVs)
+inline bool TexCoordsFitUnorm16(const glm::vec2 &uv)
+{
+    return uv.x >= 0.0f && uv.x <= 1.0f && uv.y >= 0.0f && uv.y <= 1.0f;
+}
+
+// octahedral encoding of a direction into [-1, 1]^2; a zero vector encodes as +z.
+inline glm::vec2 OctEncode(glm::vec3 n)
+{
+    float l1 = fabs(n.x) + fabs(n.y) + fabs(n.z);
+    if (l1 == 0.0f)
+        return glm::vec2(0.0f);
+    n /= l1;
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0.0f)
+    {
+        e.x = (1.0f - fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        e.y = (1.0f - fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return e;
+}
+
+inline glm::vec3 OctDecode(glm::vec2 e)
+{
+    glm::vec3 n(e.x, e.y, 1.0f - fabs(e.x) - fabs(e.y));
+    if (n.z < 0.0f)
+    {
+        n.x = (1.0f - fabs(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f);
+        n.y = (1.0f - fabs(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return glm::normalize(n);
+}
+
+inline void VertexLayout::packOctSnorm16(const glm::vec3 &direction, unsigned char *out)
+{
+    glm::vec2 e = OctEncode(direction);
+    uint16_t packed[2] = { glm::packSnorm1x16(e.x), glm::packSnorm1x16(e.y) };
+    memcpy(out, packed, sizeof(packed));
+}
+
+#endif
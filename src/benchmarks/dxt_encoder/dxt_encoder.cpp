@@ -0,0 +1,89 @@
+#include <stb_image.h>
+extern "C" {
+#include <image_DXT.h>
+}
+
+#include <learnopengl/dxt_encoder.h>
+#include <learnopengl/filesystem.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Compression throughput of the DXT encoders on the planet textures, in megapixels per second: the C encoder
+// of image_DXT.c, dxt_encoder.h on one thread, and dxt_encoder.h on ThreadPool::shared(). Also checks that
+// dxt_encoder.h produces exactly the same bytes.
+
+const char *TEXTURES[] = {
+    "sun/8k_sun.jpg", "mercury/Mercury_Tex.jpg", "venus/Venus_Tex.jpg", "earth/Earth_Tex.jpg", "mars/Mars_Tex.jpg",
+    "jupiter/Jupiter_Tex.jpg", "saturn/Saturn_Tex.jpg", "uranus/Uranus_texture.png", "neptune/Neptune_Tex.jpg"
+};
+const unsigned int RUNS = 3;
+
+template <typename F>
+double MinMilliseconds(F compress)
+{
+    double best = 1e30;
+    for(unsigned int run = 0; run < RUNS; run++)
+    {
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        compress();
+        best = std::min(best, chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count());
+    }
+    return best;
+}
+
+int main()
+{
+    const char *lanes = DXTLanes::LANES == 8 ? "AVX2" : DXTLanes::LANES == 4 ? "SSE2" : "scalar";
+    printf("dxt_encoder.h: %s lanes, thread pool of %u\n", lanes, ThreadPool::shared().size());
+    printf("%-26s %5s %9s %9s %9s %9s %s\n", "texture", "", "MP", "C MP/s", "1T MP/s", "MT MP/s", "result");
+    double totalPixels = 0.0, totalReference = 0.0, totalSingle = 0.0, totalParallel = 0.0;
+    bool allIdentical = true;
+    for(unsigned int t = 0; t < sizeof(TEXTURES) / sizeof(TEXTURES[0]); t++)
+    {
+        string path = FileSystem::getPath(string("resources/objects/planets/") + TEXTURES[t]);
+        int width, height, channels;
+        unsigned char *pixels = stbi_load(path.c_str(), &width, &height, &channels, 0);
+        if(!pixels)
+        {
+            printf("%-26s can't load\n", TEXTURES[t]);
+            continue;
+        }
+        double megapixels = width * double(height) / 1e6;
+        for(int alpha = 0; alpha < 2; alpha++)
+        {
+            int size = 0;
+            unsigned char *reference = nullptr;
+            double referenceMs = MinMilliseconds([&]() {
+                free(reference);
+                reference = alpha ? convert_image_to_DXT5(pixels, width, height, channels, &size)
+                                  : convert_image_to_DXT1(pixels, width, height, channels, &size);
+            });
+            vector<unsigned char> single(DXTCompressedSize(width, height, alpha != 0)), parallel(single.size());
+            double singleMs = MinMilliseconds([&]() { CompressDXT(pixels, width, height, channels, alpha != 0, single.data(), nullptr); });
+            double parallelMs = MinMilliseconds([&]() { CompressDXT(pixels, width, height, channels, alpha != 0, parallel.data()); });
+
+            bool identical = single.size() == size_t(size) && memcmp(single.data(), reference, size) == 0 &&
+                             memcmp(parallel.data(), reference, size) == 0;
+            allIdentical = allIdentical && identical;
+            printf("%-26s %5s %9.1f %9.1f %9.1f %9.1f %s\n", TEXTURES[t], alpha ? "DXT5" : "DXT1", megapixels,
+                   megapixels / (referenceMs / 1000.0), megapixels / (singleMs / 1000.0), megapixels / (parallelMs / 1000.0),
+                   identical ? "identical" : "DIFFERENT");
+            totalPixels += megapixels;
+            totalReference += referenceMs;
+            totalSingle += singleMs;
+            totalParallel += parallelMs;
+            free(reference);
+        }
+        stbi_image_free(pixels);
+    }
+    printf("total: C %.1f MP/s, one thread %.1f MP/s, all threads %.1f MP/s, output %s\n", totalPixels / (totalReference / 1000.0),
+           totalPixels / (totalSingle / 1000.0), totalPixels / (totalParallel / 1000.0), allIdentical ? "identical" : "DIFFERENT");
+    return allIdentical ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+#include <stb_image.h>
+
+#include <learnopengl/filesystem.h>
+#include <learnopengl/jpeg_decoder.h>
+#include <learnopengl/mapped_file.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Decoding throughput on the largest planet JPEGs, in megabytes of JPEG data per second: stb_image, then
+// jpeg_decoder.h on 1, 2, 4, ... threads up to one per hardware thread, each with its speedup over one
+// thread. Also checks that jpeg_decoder.h stays within a few levels of stb_image (the IDCTs round differently).
+
+const char *TEXTURES[] = {
+    "sun/8k_sun.jpg", "saturn/Rhea_Tex.jpg_specular.jpg", "jupiter/Io.jpg_specular.jpg", "neptune/Neptune_Tex.jpg_specular.jpg",
+    "jupiter/Europa_Tex.jpg_specular.jpg", "mercury/Mercury_Tex.jpg", "saturn/Saturn_Tex.jpg_specular.jpg",
+    "saturn/Saturn_Tex.jpg", "saturn/Rhea_Tex.jpg", "jupiter/Io.jpg", "earth/Earth_Tex.jpg_specular.jpg"
+};
+const unsigned int RUNS = 3;
+const int MAX_DIFFERENCE = 4;
+
+template <typename F>
+double MinMilliseconds(F decode)
+{
+    double best = 1e30;
+    for(unsigned int run = 0; run < RUNS; run++)
+    {
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        decode();
+        best = std::min(best, chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count());
+    }
+    return best;
+}
+
+int main()
+{
+    // the calling thread takes part in the work, so n threads is a pool of n - 1
+    vector<unsigned int> threadCounts;
+    unsigned int hardware = std::max(1u, thread::hardware_concurrency());
+    for(unsigned int n = 1; n < hardware; n *= 2)
+        threadCounts.push_back(n);
+    threadCounts.push_back(hardware);
+    vector<unique_ptr<ThreadPool> > pools;
+    for(unsigned int i = 0; i < threadCounts.size(); i++)
+        pools.push_back(unique_ptr<ThreadPool>(threadCounts[i] > 1 ? new ThreadPool(threadCounts[i] - 1) : nullptr));
+
+    printf("jpeg_decoder.h: %s, up to %u threads (MB/s of JPEG data, speedup over one thread)\n",
+#ifdef JPEG_DECODER_SSE2
+           "SSE2",
+#else
+           "scalar",
+#endif
+           hardware);
+    printf("%-38s %6s %8s", "texture", "MB", "stbi");
+    for(unsigned int i = 0; i < threadCounts.size(); i++)
+        printf("  %7uT       ", threadCounts[i]);
+    printf(" result\n");
+
+    double totalMegabytes = 0.0, totalReference = 0.0;
+    vector<double> totalDecoder(threadCounts.size(), 0.0);
+    bool allClose = true;
+    for(unsigned int t = 0; t < sizeof(TEXTURES) / sizeof(TEXTURES[0]); t++)
+    {
+        MappedFile file(FileSystem::getPath(string("resources/objects/planets/") + TEXTURES[t]));
+        if(!file.data())
+        {
+            printf("%-38s can't open\n", TEXTURES[t]);
+            continue;
+        }
+        const unsigned char *bytes = reinterpret_cast<const unsigned char*>(file.data());
+        double megabytes = file.size() / 1e6;
+        int width, height, channels;
+        unsigned char *reference = nullptr;
+        double referenceMs = MinMilliseconds([&]() {
+            stbi_image_free(reference);
+            reference = stbi_load_from_memory(bytes, static_cast<int>(file.size()), &width, &height, &channels, 0);
+        });
+        printf("%-38s %6.2f %8.1f", TEXTURES[t], megabytes, megabytes / (referenceMs / 1000.0));
+
+        int maxDifference = 0;
+        bool handled = true;
+        double singleMs = 0.0;
+        vector<double> milliseconds(threadCounts.size());
+        for(unsigned int i = 0; i < threadCounts.size() && handled; i++)
+        {
+            unsigned char *pixels = nullptr;
+            int decodedWidth = 0, decodedHeight = 0, decodedChannels = 0;
+            milliseconds[i] = MinMilliseconds([&]() {
+                free(pixels);
+                pixels = DecodeJPEG(bytes, file.size(), decodedWidth, decodedHeight, decodedChannels, pools[i].get());
+            });
+            if(!pixels)
+            {
+                handled = false;
+                break;
+            }
+            if(i == 0)
+                singleMs = milliseconds[i];
+            printf("  %7.1f (%4.2fx)", megabytes / (milliseconds[i] / 1000.0), singleMs / milliseconds[i]);
+            if(decodedWidth != width || decodedHeight != height || decodedChannels != channels)
+                maxDifference = 256;
+            else
+                for(size_t p = 0; p < size_t(width) * height * channels; p++)
+                    maxDifference = std::max(maxDifference, abs(int(pixels[p]) - int(reference[p])));
+            free(pixels);
+        }
+        stbi_image_free(reference);
+        if(!handled)
+        {
+            printf("  not baseline, left to stbi\n");
+            continue;
+        }
+        bool close = maxDifference <= MAX_DIFFERENCE;
+        allClose = allClose && close;
+        printf(" %s (max difference %d)\n", close ? "close" : "DIFFERENT", maxDifference);
+        totalMegabytes += megabytes;
+        totalReference += referenceMs;
+        for(unsigned int i = 0; i < threadCounts.size(); i++)
+            totalDecoder[i] += milliseconds[i];
+    }
+    printf("total: stbi %.1f MB/s", totalMegabytes / (totalReference / 1000.0));
+    for(unsigned int i = 0; i < threadCounts.size(); i++)
+        printf(", %uT %.1f MB/s (%.2fx stbi, %.2fx one thread)", threadCounts[i], totalMegabytes / (totalDecoder[i] / 1000.0),
+               totalReference / totalDecoder[i], totalDecoder[0] / totalDecoder[i]);
+    printf("\noutput %s\n", allClose ? "close to stbi" : "DIFFERENT");
+    return allClose ? 0 : 1;
+}
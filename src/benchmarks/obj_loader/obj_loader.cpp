@@ -0,0 +1,144 @@
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/filesystem.h>
+#include <learnopengl/obj_loader.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Times the native OBJ loader against ASSIMP on the solar system's OBJ files, with the import flags Model
+// uses by default, and checks both produce the same meshes. No window or GL context is needed.
+
+const char *OBJECTS[] = {
+    "sun/sun.obj", "mercury/mercury.obj", "venus/venus.obj", "earth/earth.obj", "earth/earth_moon.obj",
+    "mars/mars.obj", "mars/mars_moons.obj", "jupiter/jupiter.obj", "jupiter/jupiter_moons.obj",
+    "saturn/saturn.obj", "uranus/uranus.obj", "neptune/neptune.obj"
+};
+const unsigned int RUNS = 10;
+
+// ASSIMP's meshes converted to what Model::processMesh builds
+void LoadAssimp(const string &path, unsigned int importFlags, vector<ObjMesh> &meshes)
+{
+    meshes.clear();
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(path, importFlags);
+    if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+        return;
+    }
+    meshes.resize(scene->mNumMeshes);
+    for(unsigned int m = 0; m < scene->mNumMeshes; m++)
+    {
+        const aiMesh *mesh = scene->mMeshes[m];
+        ObjMesh &result = meshes[m];
+        result.name = mesh->mName.C_Str();
+        result.vertices.resize(mesh->mNumVertices);
+        for(unsigned int i = 0; i < mesh->mNumVertices; i++)
+        {
+            Vertex &vertex = result.vertices[i];
+            memset(&vertex, 0, sizeof(vertex));
+            vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+            if(mesh->HasNormals())
+                vertex.Normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+            if(mesh->mTextureCoords[0])
+                vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+            if(mesh->HasTangentsAndBitangents())
+            {
+                vertex.Tangent = glm::vec3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
+                vertex.Bitangent = glm::vec3(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z);
+            }
+        }
+        for(unsigned int f = 0; f < mesh->mNumFaces; f++)
+            for(unsigned int j = 0; j < mesh->mFaces[f].mNumIndices; j++)
+                result.indices.push_back(mesh->mFaces[f].mIndices[j]);
+    }
+}
+
+float MaxDifference(const glm::vec3 &a, const glm::vec3 &b)
+{
+    glm::vec3 d = glm::abs(a - b);
+    return std::max(d.x, std::max(d.y, d.z));
+}
+
+// compares the meshes triangle corner by triangle corner, so that vertex order doesn't matter
+bool Compare(const vector<ObjMesh> &native, const vector<ObjMesh> &assimp, float &maxDifference)
+{
+    maxDifference = 0.0f;
+    if(native.size() != assimp.size())
+        return false;
+    bool identical = true;
+    for(unsigned int m = 0; m < native.size(); m++)
+    {
+        const ObjMesh &a = native[m], &b = assimp[m];
+        if(a.vertices.size() != b.vertices.size() || a.indices.size() != b.indices.size())
+            identical = false;
+        for(unsigned int i = 0; i < std::min(a.indices.size(), b.indices.size()); i++)
+        {
+            const Vertex &u = a.vertices[a.indices[i]], &v = b.vertices[b.indices[i]];
+            float difference = std::max(MaxDifference(u.Position, v.Position), MaxDifference(u.Normal, v.Normal));
+            difference = std::max(difference, MaxDifference(glm::vec3(u.TexCoords, 0.0f), glm::vec3(v.TexCoords, 0.0f)));
+            difference = std::max(difference, std::max(MaxDifference(u.Tangent, v.Tangent), MaxDifference(u.Bitangent, v.Bitangent)));
+            maxDifference = std::max(maxDifference, difference);
+        }
+    }
+    return identical && maxDifference == 0.0f;
+}
+
+template <typename F>
+double MinMilliseconds(F load)
+{
+    double best = 1e30;
+    for(unsigned int run = 0; run < RUNS; run++)
+    {
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        load();
+        best = std::min(best, chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count());
+    }
+    return best;
+}
+
+int main()
+{
+    const unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+    double totalNative = 0.0, totalAssimp = 0.0, totalMegabytes = 0.0;
+    printf("%-28s %8s %10s %10s %9s %9s %s\n", "file", "MB", "native ms", "assimp ms", "speedup", "vertices", "result");
+    for(unsigned int i = 0; i < sizeof(OBJECTS) / sizeof(OBJECTS[0]); i++)
+    {
+        string path = FileSystem::getPath(string("resources/objects/planets/") + OBJECTS[i]);
+        MappedFile file;
+        if(!file.open(path))
+        {
+            printf("%-28s can't open\n", OBJECTS[i]);
+            continue;
+        }
+        double megabytes = file.size() / (1024.0 * 1024.0);
+
+        vector<ObjMesh> native, assimp;
+        double nativeMs = MinMilliseconds([&]() { LoadObj(path, importFlags, native); });
+        double assimpMs = MinMilliseconds([&]() { LoadAssimp(path, importFlags, assimp); });
+
+        size_t vertexCount = 0;
+        for(unsigned int m = 0; m < native.size(); m++)
+            vertexCount += native[m].vertices.size();
+        float maxDifference;
+        bool identical = Compare(native, assimp, maxDifference);
+        char result[64];
+        snprintf(result, sizeof(result), identical ? "identical" : "max difference %g", maxDifference);
+        printf("%-28s %8.2f %10.2f %10.2f %8.1fx %9u %s\n", OBJECTS[i], megabytes, nativeMs, assimpMs, assimpMs / nativeMs, (unsigned int)vertexCount, result);
+        totalNative += nativeMs;
+        totalAssimp += assimpMs;
+        totalMegabytes += megabytes;
+    }
+    printf("total: native %.1f ms (%.0f MB/s), assimp %.1f ms (%.0f MB/s)\n", totalNative, totalMegabytes / (totalNative / 1000.0),
+           totalAssimp, totalMegabytes / (totalAssimp / 1000.0));
+    return 0;
+}
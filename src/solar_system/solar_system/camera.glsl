@@ -0,0 +1,10 @@
+// the camera, shared by every program (see uniform_buffer.h)
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    vec2 viewport;
+    float time;
+};
@@ -2,10 +2,16 @@
 out vec4 FragColor;
 
 in vec2 TexCoords;
+flat in float Layer;
 
 uniform sampler2D texture_diffuse1;
+uniform sampler2DArray material_diffuse;
 
 void main()
 {
-    FragColor = texture(texture_diffuse1, TexCoords);
+    // meshes whose map is in the material atlas pass its layer, the rest (like the placeholder) bind a texture
+    if (Layer >= 0.0)
+        FragColor = texture(material_diffuse, vec3(TexCoords, Layer));
+    else
+        FragColor = texture(texture_diffuse1, TexCoords);
 }
\ No newline at end of file
@@ -10,6 +10,14 @@
 #include <learnopengl/shader.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
+#include <learnopengl/asset_manager.h>
+#include <learnopengl/material_atlas.h>
+#include <learnopengl/program_cache.h>
+#include <learnopengl/shader_reload.h>
+#include <learnopengl/shader_variants.h>
+#include <learnopengl/texture_budget.h>
+#include <learnopengl/texture_upload.h>
+#include <learnopengl/uniform_buffer.h>
 
 #include <iostream>
 
@@ -75,9 +83,50 @@ int main()
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
 
+    // the planet textures go up to 8k: keep them DXT compressed on the GPU (compressed once, then loaded from .dds files),
+    // with sharper Kaiser filtered mips than the default box filter. Most bodies cover a few pixels, so only their
+    // coarse mips are uploaded at first and the finer ones are streamed in as the camera gets close. None needs
+    // more than 4k, and gray ones left uncompressed are stored with one channel
+    TextureCache::instance().setMipFilter(MIP_FILTER_KAISER);
+    TextureCache::instance().setLoadPolicy(TextureLoadPolicy::preset(TEXTURE_QUALITY_HIGH));
+    TextureCache::instance().enableCompression();
+    TextureCache::instance().enableStreaming();
+    // and keep all of it within 128 MB of GPU memory, taking mips from the bodies drawn longest ago first
+    TextureBudget::instance().setBudget(128 * 1024 * 1024);
+    // streamed mips are copied into a persistently mapped buffer on the thread pool and uploaded from there (GL 4.4).
+    // Big enough for the finest mips of a whole atlas page at once
+    TextureUploadRing::instance().enable(64 * 1024 * 1024);
+    // every body has a single diffuse map: resample them all to one size and pack them into a texture array, so
+    // the whole system draws with one texture bound once. Wide enough for a body that fills the window
+    MaterialAtlas::instance().setLayerSize(2048, 1024);
+
     // build and compile shaders
     // -------------------------
-    Shader shader("vs_shader.vs", "fs_shader.fs");
+    // linked programs are kept as driver binaries next to the executable, so later runs skip compiling (GL 4.1)
+    ProgramBinaryCache::instance().enable();
+    // the camera goes to every program through one uniform block, updated once per frame
+    CameraUniformBuffer cameraUniforms;
+    // every variant the system draws with is compiled here, together, rather than when it first shows up
+    ShaderVariants &shaderVariants = ShaderVariants::instance();
+    shaderVariants.declare("vs_shader.vs", "fs_shader.fs");
+    shaderVariants.warmUp();
+    Shader &shader = shaderVariants.get("vs_shader.vs", "fs_shader.fs");
+    shaderVariants.printStats();
+    ProgramBinaryCache::instance().printStats();
+    // edits to the shader files show while the system runs: they are compiled in the background and swapped in
+    // once they link. Drivers that can't compile in the background get a hidden window whose context shares
+    // objects with this one, so the programs can compile on the reloader's thread
+    if (!ShaderReloader::parallelCompileSupported())
+    {
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+        GLFWwindow *compileWindow = glfwCreateWindow(1, 1, "", NULL, window);
+        if (compileWindow)
+            ShaderReloader::instance().setCompileContext([compileWindow]() { glfwMakeContextCurrent(compileWindow); });
+    }
+    ShaderReloader::instance().watch(shader);
+    MaterialAtlas::instance().setSamplers(shader);
+    // the uniform set for every body, looked up once
+    Uniform<glm::mat4> modelUniform = shader.uniform<glm::mat4>("model");
 
     // load models
     // -----------
@@ -92,8 +141,19 @@ int main()
         "saturn/saturn.obj", "saturn/saturn_moon_1.obj","saturn/saturn_moon_2.obj","saturn/saturn_moon_3.obj",
         "uranus/uranus.obj", "uranus/uranus_moon_1.obj", "uranus/uranus_moon_2.obj", "uranus/uranus_moon_3.obj",
         "neptune/neptune.obj"};
+    // the sun and planets are dense spheres; reorder them once for the vertex cache (the result is cached on disk)
+    // and upload them compact. Our shader only reads positions and texture coordinates, so nothing else is imported
+    ModelOptions options;
+    options.optimizeMeshes = true;
+    options.compactVertices = true;
+    options.useAttributesOf(shader);
+    // nothing reads the geometry back on the CPU
+    options.residency = MESH_DISCARD_AFTER_UPLOAD;
+    options.materialAtlas = true;
+    // import all bodies in the background; they show up as placeholders until the render loop uploads them
+    AssetManager assets;
     for (int i = 0; i < NUM; i++) {
-        solarSystem[i] = new Model(FileSystem::getPath(path+objects[i]));
+        solarSystem[i] = assets.load(FileSystem::getPath(path+objects[i]), false, options);
     }
 
    
@@ -153,6 +213,23 @@ int main()
         // -----
         processInput(window);
 
+        // upload the bodies that finished loading
+        // ---------------------------------------
+        if (assets.update() > 0 && assets.pending() == 0)
+        {
+            TextureCache::instance().printStats();
+            MaterialAtlas::instance().printStats();
+            GeometryRegistry::instance().printStats();
+            TextureBudget::instance().printStats();
+            TextureUploadRing::instance().printStats();
+        }
+        // pick up the shader edits that compiled by now
+        ShaderReloader::instance().update();
+        // and stream the texture mips the last frame asked for
+        TextureCache::instance().update();
+        MaterialAtlas::instance().update();
+        TextureBudget::instance().update();
+
         // render
         // ------
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
@@ -161,9 +238,8 @@ int main()
         // configure transformation matrices
         glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 200.0f);
         glm::mat4 view = camera.GetViewMatrix();
+        cameraUniforms.update(projection, view, camera.Position, glm::vec2((float)SCR_WIDTH, (float)SCR_HEIGHT), currentFrame);
         shader.use();
-        shader.setMat4("projection", projection);
-        shader.setMat4("view", view);
 
        
 
@@ -174,8 +250,13 @@ int main()
             model = glm::translate(model, glm::vec3(distanceFromSun[i], 0.0f, 0.0f));
             model = glm::rotate(model, currentFrame * rotationSpeed[i] * glm::radians(10.0f), rotationAxis[i]);
             model = glm::scale(model, glm::vec3(scaleFactor[i], scaleFactor[i], scaleFactor[i]));
-            shader.setMat4("model", model);
-            solarSystem[i]->Draw(shader);
+            shader.set(modelUniform, model);
+            float radius = solarSystem[i]->screenRadius(model, view, projection, (float)SCR_HEIGHT);
+            solarSystem[i]->requestTextureDetail(radius);
+            // bodies behind the camera aren't drawn, so their textures are the first to give up memory (bodies
+            // still loading are measured by their placeholders)
+            if (radius > 0.0f)
+                solarSystem[i]->Draw(shader);
         }
      
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
@@ -184,6 +265,12 @@ int main()
         glfwPollEvents();
     }
 
+    assets.clear();
+    MaterialAtlas::instance().clear();
+    ShaderReloader::instance().clear();
+    ShaderVariants::instance().clear();
+    cameraUniforms.clear();
+    TextureUploadRing::instance().clear();
     glfwTerminate();
     return 0;
 }
@@ -1,15 +1,17 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in vec2 aMaterial;
 
 out vec2 TexCoords ;
+flat out float Layer;
 
-uniform mat4 projection;
-uniform mat4 view;
+#include "camera.glsl"
 uniform mat4 model;
 
 void main()
 {
     TexCoords = aTexCoords;
-    gl_Position = projection * view * model * vec4(aPos, 1.0f); 
+    Layer = aMaterial.x;
+    gl_Position = viewProjection * model * vec4(aPos, 1.0f); 
 }
\ No newline at end of file